@@ -140,33 +140,40 @@ namespace ZeroTier {
 					// RX, Handle data incoming from libzt
 					if (FD_ISSET(fd_i, &read_set)) {
 						int wr = 0, rd = 0;
+						struct iovec iov[2];
+						int iovcnt;
 						conn = zmap[fd_i];
 						if (conn == NULL) {
 							DEBUG_ERROR("invalid conn");
 							exit(0);
 						}
-						// read data from libzt and place it on ring buffer
-						conn->rx_m.lock();
+						// read data from libzt directly into the free space of the ring buffer
 						if (conn->RXbuf->count() > 0) {
 							//DEBUG_INFO("libzt has incoming data on fd=%d, RXing via conn=%p, sock=%p", 
 							//	conn->zfd, conn, conn->client_sock);
 						}
-						if ((rd = zts_read(conn->zfd, conn->RXbuf->get_buf(),ZT_MAX_MTU)) < 0) {
-							DEBUG_ERROR("error while reading data from libzt, err=%d", rd);
-						}
-						else {
-							//DEBUG_INFO("LIBZT -> RXBUFFER = %d bytes", rd);
-							conn->RXbuf->produce(rd);
+						if ((iovcnt = conn->RXbuf->get_writable_iov(iov)) > 0) {
+							if ((rd = zts_readv(conn->zfd, iov, iovcnt)) < 0) {
+								DEBUG_ERROR("error while reading data from libzt, err=%d", rd);
+							}
+							else {
+								//DEBUG_INFO("LIBZT -> RXBUFFER = %d bytes", rd);
+								conn->RXbuf->produce(rd);
+							}
 						}
 						// attempt to write data to client from buffer
-						if ((wr = _phy.streamSend(conn->client_sock, conn->RXbuf->get_buf(), conn->RXbuf->count())) < 0) {
-							DEBUG_ERROR("error while writing the data from the RXbuf to the client PhySocket, err=%d", wr);
-						}
-						else {
+						iovcnt = conn->RXbuf->get_readable_iov(iov);
+						for (int i=0; i<iovcnt; i++) {
+							if ((wr = _phy.streamSend(conn->client_sock, iov[i].iov_base, iov[i].iov_len)) < 0) {
+								DEBUG_ERROR("error while writing the data from the RXbuf to the client PhySocket, err=%d", wr);
+								break;
+							}
 							//DEBUG_INFO("RXBUFFER -> CLIENT = %d bytes", wr);
 							conn->RXbuf->consume(wr);
+							if ((size_t)wr < iov[i].iov_len) {
+								break;
+							}
 						}
-						conn->rx_m.unlock();
 					}
 
 					// TX, Handle data outgoing from client to libzt
@@ -177,11 +184,12 @@ namespace ZeroTier {
 							DEBUG_ERROR("invalid conn, possibly closed before transmit was possible");
 						}
 						// read data from client and place it on ring buffer
-						conn->tx_m.lock();
-						if (conn->TXbuf->count() > 0) {
+						struct iovec iov[2];
+						int iovcnt;
+						if ((iovcnt = conn->TXbuf->get_readable_iov(iov)) > 0) {
 							// DEBUG_INFO("client has outgoing data of len=%d on fd=%d, TXing via conn=%p, sock=%p", 
 							//	conn->TXbuf->count(), conn->zfd, conn, conn->client_sock);
-							if ((wr = zts_write(conn->zfd, conn->TXbuf->get_buf(), conn->TXbuf->count())) < 0) {
+							if ((wr = zts_writev(conn->zfd, iov, iovcnt)) < 0) {
 								DEBUG_ERROR("error while sending the data over libzt, err=%d", wr);
 							}
 							else {
@@ -189,7 +197,6 @@ namespace ZeroTier {
 								conn->TXbuf->consume(wr); // data is presumed sent, mark it as such in the ringbuffer
 							}
 						}
-						conn->tx_m.unlock();
 					}
 				}
 			}
@@ -272,9 +279,7 @@ namespace ZeroTier {
 			if (zfd < 0 || err < 0) {
 				// now release TX buffer contents we previously saved, since we can't connect
 				DEBUG_ERROR("error while connecting to remote host (zfd=%d, err=%d)", zfd, err);
-				conn->tx_m.lock();
 				conn->TXbuf->reset();
-				conn->tx_m.unlock();
 				return;
 			}		
 			else {
@@ -291,14 +296,12 @@ namespace ZeroTier {
 			conn_m.unlock();			
 		}
 		// Write data coming from client TCP connection to its TX buffer, later emptied into libzt by threadMain I/O loop
-		conn->tx_m.lock();
 		if ((wr = conn->TXbuf->write((const unsigned char *)data, len)) < 0) {
 			DEBUG_ERROR("there was an error while writing data from client to tx buffer, err=%d", wr);
 		}
 		else {
 			// DEBUG_INFO("CLIENT -> TXBUFFER = %d bytes", wr);
 		}
-		conn->tx_m.unlock();
 	}
 
 	void ZTProxy::phyOnTcpAccept(PhySocket *sockL, PhySocket *sockN, void **uptrL, void **uptrN, 
@@ -54,14 +54,15 @@ namespace ZeroTier {
 	public:
 		int zfd;
 		PhySocket *client_sock;
-		RingBuffer<unsigned char> *TXbuf;
-		RingBuffer<unsigned char> *RXbuf;
-		Mutex tx_m, rx_m;
+		// each buffer has one producer and one consumer, so no locking is needed around them.
+		// They are mirrored so that reads and writes never have to be split at the wrap
+		SPSCRingBuffer<unsigned char> *TXbuf;
+		SPSCRingBuffer<unsigned char> *RXbuf;
 
 		TcpConnection() {
 			zfd = -1;			
-			TXbuf = new RingBuffer<unsigned char>(BUF_SZ);
-			RXbuf = new RingBuffer<unsigned char>(BUF_SZ);
+			TXbuf = new SPSCRingBuffer<unsigned char>(BUF_SZ, true);
+			RXbuf = new SPSCRingBuffer<unsigned char>(BUF_SZ, true);
 		}
 
 		~TcpConnection() {
@@ -0,0 +1,649 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Slab allocator for memp pools (MEMP_MEM_SLAB) and the lwIP heap.
+ *
+ * Each pool carves fixed-size elements out of large regions. Every thread
+ * keeps two magazines of up to MEMP_SLAB_BATCH free elements per pool and
+ * trades whole magazines with the pool through a lock-free stack (the depot),
+ * so allocating and freeing only touch the calling thread's cache except once
+ * every MEMP_SLAB_BATCH calls. When the depot is empty the pool carves a new
+ * magazine from its region, adding a region when that runs out. Regions are
+ * never handed back to the system. Optionally, pools are limited to a number
+ * of elements in use and all slabs together to a budget in bytes. Elements
+ * cached by a thread count against the budget but not against the limit, so
+ * that a pool does not run dry while its free elements sit in other threads'
+ * caches.
+ *
+ * mem_slab_malloc() and friends put the lwIP heap (MEM_LIBC_MALLOC) on the
+ * same slabs with one pool per power of two block size.
+ */
+
+#include "lwip/opt.h"
+
+#if MEMP_MEM_SLAB
+
+#include "lwip/def.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* every element is aligned like malloc() memory */
+#define SLAB_ALIGN          16
+#define SLAB_ALIGN_SIZE(x)  (((x) + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1))
+#define SLAB_PAGE_SIZE(x)   (((x) + 4095) & ~(size_t)4095)
+
+/* bounds for the size of the regions added as a pool grows, each is twice
+   the size of the one before */
+#define SLAB_REGION_MIN     (256 * 1024)
+#define SLAB_REGION_MAX     (16 * 1024 * 1024)
+
+/* heap block sizes, 64 to 4096 bytes including the header */
+#define SLAB_HEAP_CLASSES   7
+#define SLAB_HEAP_MIN       64
+
+/* pools that get a per-thread cache, elements of any further (private) pool
+   come straight from malloc() */
+#define SLAB_MAX_POOLS      (MEMP_MAX + SLAB_HEAP_CLASSES + 8)
+
+/* The depot head packs the top magazine (shifted by the alignment, user space
+   addresses stay below 2^48) with a counter bumped on every change. A pop that
+   raced with other threads popping and pushing back the same magazine then
+   fails its compare-and-swap instead of installing a stale link. */
+#define SLAB_PTR_BITS       44
+#define SLAB_PTR_MASK       ((((uint64_t)1) << SLAB_PTR_BITS) - 1)
+#define SLAB_PTR_LIMIT      (((uint64_t)1) << (SLAB_PTR_BITS + 4))
+
+/* A free element. The first element of a magazine in the depot also links to
+   the magazine below it and knows how many elements it holds. */
+struct slab_elem {
+  struct slab_elem *next;
+  struct slab_elem *next_mag;
+  size_t count;
+};
+
+/* Header at the start of each region */
+struct slab_region {
+  size_t size;
+  size_t used; /* bumped by every carve, may run past size */
+};
+
+struct memp_slab {
+  uint64_t depot;
+  struct slab_region *region;
+  struct slab_region *spare;    /* lost a race to become the region */
+  size_t elem_size;
+  size_t region_size;
+  size_t limit;                 /* 0 for none */
+  size_t used;                  /* elements allocated and not freed yet */
+  size_t carved;                /* elements handed to the depot and caches */
+  unsigned int batch;           /* magazine size */
+  int index;
+  const struct memp_desc *desc;
+};
+
+/* A thread's cache for one pool */
+struct slab_cache {
+  struct slab_elem *loaded;
+  struct slab_elem *prev;
+  unsigned int loaded_count;
+  unsigned int prev_count;
+};
+
+static struct memp_slab *slab_pools[SLAB_MAX_POOLS];
+static int slab_npools;
+static struct memp_slab *slab_heap[SLAB_HEAP_CLASSES];
+static size_t slab_budget;
+static size_t slab_reserved;
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slab_key;
+static __thread struct slab_cache *slab_tcache;
+
+#if MEMP_SLAB_HUGEPAGES
+static u8_t *slab_arena;
+static size_t slab_arena_used;
+
+static void
+slab_arena_init(void)
+{
+  void *p = MAP_FAILED;
+  size_t len = MEMP_SLAB_ARENA_SIZE;
+#ifdef MAP_HUGETLB
+  p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (p == MAP_FAILED) {
+    /* no reserved huge pages, ask for transparent ones on a 2 MB aligned range */
+    const size_t huge = 2 * 1024 * 1024;
+    u8_t *m = (u8_t *)mmap(NULL, len + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u8_t *a;
+    if ((void *)m == MAP_FAILED) {
+      return;
+    }
+    a = (u8_t *)(((uintptr_t)m + huge - 1) & ~(uintptr_t)(huge - 1));
+    /* give back what lies outside the aligned range */
+    if (a > m) {
+      munmap(m, (size_t)(a - m));
+    }
+    if (a + len < m + len + huge) {
+      munmap(a + len, (size_t)((m + len + huge) - (a + len)));
+    }
+    p = a;
+#ifdef MADV_HUGEPAGE
+    madvise(p, len, MADV_HUGEPAGE);
+#endif
+  }
+  if ((uint64_t)(uintptr_t)p + len > SLAB_PTR_LIMIT) {
+    munmap(p, len);
+    return;
+  }
+  slab_arena = (u8_t *)p;
+}
+#endif /* MEMP_SLAB_HUGEPAGES */
+
+/* Memory for a region, from the huge page arena while it lasts */
+static struct slab_region *
+slab_region_new(size_t len)
+{
+  void *p;
+  struct slab_region *r;
+#if MEMP_SLAB_HUGEPAGES
+  if (slab_arena != NULL) {
+    size_t off = __atomic_fetch_add(&slab_arena_used, len, __ATOMIC_RELAXED);
+    if (off + len <= MEMP_SLAB_ARENA_SIZE) {
+      r = (struct slab_region *)(void *)(slab_arena + off);
+      r->size = len;
+      r->used = SLAB_ALIGN_SIZE(sizeof(struct slab_region));
+      return r;
+    }
+  }
+#endif /* MEMP_SLAB_HUGEPAGES */
+  p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  if ((uint64_t)(uintptr_t)p + len > SLAB_PTR_LIMIT) {
+    munmap(p, len);
+    return NULL;
+  }
+  r = (struct slab_region *)p;
+  r->size = len;
+  r->used = SLAB_ALIGN_SIZE(sizeof(struct slab_region));
+  return r;
+}
+
+static void
+slab_region_free(struct slab_region *r)
+{
+#if MEMP_SLAB_HUGEPAGES
+  if (slab_arena != NULL && (u8_t *)r >= slab_arena && (u8_t *)r < slab_arena + MEMP_SLAB_ARENA_SIZE) {
+    return; /* stays with the arena */
+  }
+#endif /* MEMP_SLAB_HUGEPAGES */
+  munmap(r, r->size);
+}
+
+/* Take bytes out of the budget */
+static int
+slab_reserve_bytes(size_t bytes)
+{
+  size_t budget = __atomic_load_n(&slab_budget, __ATOMIC_RELAXED);
+  size_t reserved = __atomic_load_n(&slab_reserved, __ATOMIC_RELAXED);
+  do {
+    if (budget != 0 && reserved + bytes > budget) {
+      return 0;
+    }
+  } while (!__atomic_compare_exchange_n(&slab_reserved, &reserved, reserved + bytes, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return 1;
+}
+
+/* Take batch elements out of the budget, returns how many may be carved */
+static unsigned int
+slab_reserve(struct memp_slab *s, unsigned int batch)
+{
+  if (!slab_reserve_bytes(batch * s->elem_size)) {
+    return 0;
+  }
+  __atomic_fetch_add(&s->carved, batch, __ATOMIC_RELAXED);
+  return batch;
+}
+
+static void
+slab_unreserve(struct memp_slab *s, unsigned int count)
+{
+  __atomic_fetch_sub(&s->carved, count, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&slab_reserved, count * s->elem_size, __ATOMIC_RELAXED);
+}
+
+static uint64_t
+slab_pack(struct slab_elem *mag, uint64_t old)
+{
+  return ((old & ~SLAB_PTR_MASK) + (SLAB_PTR_MASK + 1)) | ((uint64_t)(uintptr_t)mag >> 4);
+}
+
+static struct slab_elem *
+slab_unpack(uint64_t v)
+{
+  return (struct slab_elem *)(uintptr_t)((v & SLAB_PTR_MASK) << 4);
+}
+
+static void
+slab_depot_push(struct memp_slab *s, struct slab_elem *mag, unsigned int count)
+{
+  uint64_t old = __atomic_load_n(&s->depot, __ATOMIC_RELAXED);
+  mag->count = count;
+  do {
+    mag->next_mag = slab_unpack(old);
+  } while (!__atomic_compare_exchange_n(&s->depot, &old, slab_pack(mag, old), 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static struct slab_elem *
+slab_depot_pop(struct memp_slab *s)
+{
+  uint64_t old = __atomic_load_n(&s->depot, __ATOMIC_ACQUIRE);
+  struct slab_elem *mag, *below;
+  do {
+    mag = slab_unpack(old);
+    if (mag == NULL) {
+      return NULL;
+    }
+    /* mag may be handed out by another thread meanwhile, its memory stays
+       mapped though and the counter makes the swap below fail then */
+    below = __atomic_load_n(&mag->next_mag, __ATOMIC_RELAXED);
+  } while (!__atomic_compare_exchange_n(&s->depot, &old, slab_pack(below, old), 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+  return mag;
+}
+
+/* Link count consecutive elements into a magazine */
+static struct slab_elem *
+slab_link(struct memp_slab *s, u8_t *base, unsigned int count)
+{
+  struct slab_elem *head = NULL, *e;
+  unsigned int i;
+  for (i = count; i > 0; i--) {
+    e = (struct slab_elem *)(void *)(base + (i - 1) * s->elem_size);
+    e->next = head;
+    head = e;
+  }
+  head->count = count;
+  return head;
+}
+
+/* Carve a magazine from the pool's region, adding a region if it is used up */
+static struct slab_elem *
+slab_carve(struct memp_slab *s)
+{
+  unsigned int count = slab_reserve(s, __atomic_load_n(&s->batch, __ATOMIC_RELAXED));
+  const size_t len = s->elem_size * count;
+  struct slab_region *r, *nr;
+  size_t off, grow;
+
+  if (count == 0) {
+    return NULL;
+  }
+  for (;;) {
+    r = __atomic_load_n(&s->region, __ATOMIC_ACQUIRE);
+    if (r != NULL) {
+      off = __atomic_fetch_add(&r->used, len, __ATOMIC_RELAXED);
+      if (off + len <= r->size) {
+        return slab_link(s, (u8_t *)r + off, count);
+      }
+    }
+    nr = __atomic_exchange_n(&s->spare, (struct slab_region *)NULL, __ATOMIC_ACQUIRE);
+    if (nr == NULL) {
+      grow = __atomic_load_n(&s->region_size, __ATOMIC_RELAXED);
+      nr = slab_region_new(grow);
+      if (nr == NULL) {
+        slab_unreserve(s, count);
+        return NULL;
+      }
+      __atomic_store_n(&s->region_size, LWIP_MIN(grow * 2, (size_t)SLAB_REGION_MAX), __ATOMIC_RELAXED);
+    }
+    if (__atomic_compare_exchange_n(&s->region, &r, nr, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+#if MEMP_STATS
+      /* counted once installed, a region that loses the race may be freed. Others may carve
+         from it already, so its space is not taken from nr->used */
+      if (s->desc != NULL) {
+        __atomic_fetch_add(&s->desc->stats->avail,
+                           (nr->size - SLAB_ALIGN_SIZE(sizeof(struct slab_region))) / s->elem_size, __ATOMIC_RELAXED);
+      }
+#endif /* MEMP_STATS */
+    } else {
+      /* another thread grew the pool meanwhile, keep ours for the next time */
+      nr = __atomic_exchange_n(&s->spare, nr, __ATOMIC_ACQ_REL);
+      if (nr != NULL) {
+        slab_region_free(nr);
+      }
+    }
+  }
+}
+
+/* Thread exit, hand the cached magazines back to their pools */
+static void
+slab_cache_release(void *arg)
+{
+  struct slab_cache *c = (struct slab_cache *)arg;
+  int i, n = LWIP_MIN(__atomic_load_n(&slab_npools, __ATOMIC_ACQUIRE), SLAB_MAX_POOLS);
+  for (i = 0; i < n; i++) {
+    struct memp_slab *s = __atomic_load_n(&slab_pools[i], __ATOMIC_ACQUIRE);
+    if (s == NULL) {
+      continue;
+    }
+    if (c[i].loaded_count > 0) {
+      slab_depot_push(s, c[i].loaded, c[i].loaded_count);
+    }
+    if (c[i].prev_count > 0) {
+      slab_depot_push(s, c[i].prev, c[i].prev_count);
+    }
+  }
+  slab_tcache = NULL;
+  free(c);
+}
+
+static struct memp_slab *
+slab_pool_new(size_t size, u16_t num, const struct memp_desc *desc)
+{
+  struct memp_slab *s = (struct memp_slab *)calloc(1, sizeof(struct memp_slab));
+  size_t elems;
+  if (s == NULL) {
+    return NULL;
+  }
+  s->elem_size = SLAB_ALIGN_SIZE(LWIP_MAX(size, sizeof(struct slab_elem)));
+  /* the first region holds num elements, rounded up to whole magazines */
+  elems = ((LWIP_MAX(num, 1) + MEMP_SLAB_BATCH - 1) / MEMP_SLAB_BATCH) * MEMP_SLAB_BATCH;
+  s->region_size = SLAB_PAGE_SIZE(SLAB_ALIGN_SIZE(sizeof(struct slab_region)) + elems * s->elem_size);
+  s->batch = MEMP_SLAB_BATCH;
+  s->desc = desc;
+  s->index = __atomic_fetch_add(&slab_npools, 1, __ATOMIC_ACQ_REL);
+  if (s->index < SLAB_MAX_POOLS) {
+    __atomic_store_n(&slab_pools[s->index], s, __ATOMIC_RELEASE);
+  } else {
+    s->index = -1;
+  }
+  return s;
+}
+
+static void
+slab_init(void)
+{
+  int i;
+  pthread_key_create(&slab_key, slab_cache_release);
+#if MEMP_SLAB_HUGEPAGES
+  slab_arena_init();
+#endif
+  for (i = 0; i < SLAB_HEAP_CLASSES; i++) {
+    slab_heap[i] = slab_pool_new((size_t)SLAB_HEAP_MIN << i, MEMP_SLAB_BATCH, NULL);
+  }
+}
+
+static struct slab_cache *
+slab_cache_get(struct memp_slab *s)
+{
+  struct slab_cache *c = slab_tcache;
+  if (c == NULL) {
+    c = (struct slab_cache *)calloc(SLAB_MAX_POOLS, sizeof(struct slab_cache));
+    if (c == NULL) {
+      return NULL;
+    }
+    slab_tcache = c;
+    pthread_setspecific(slab_key, c);
+  }
+  return &c[s->index];
+}
+
+static void *
+slab_alloc(struct memp_slab *s)
+{
+  struct slab_cache *c;
+  struct slab_elem *e;
+
+  if (s->index < 0) {
+    return malloc(s->elem_size);
+  }
+  c = slab_cache_get(s);
+  if (c == NULL) {
+    return NULL;
+  }
+  if (c->loaded_count == 0) {
+    if (c->prev_count > 0) {
+      c->loaded = c->prev;
+      c->loaded_count = c->prev_count;
+      c->prev = NULL;
+      c->prev_count = 0;
+    } else {
+      e = slab_depot_pop(s);
+      if (e == NULL) {
+        e = slab_carve(s);
+        if (e == NULL) {
+          return NULL;
+        }
+      }
+      c->loaded = e;
+      c->loaded_count = (unsigned int)e->count;
+    }
+  }
+  e = c->loaded;
+  c->loaded = e->next;
+  c->loaded_count--;
+  return e;
+}
+
+static void
+slab_free(struct memp_slab *s, void *mem)
+{
+  struct slab_elem *e = (struct slab_elem *)mem;
+  struct slab_cache *c;
+
+  if (s->index < 0) {
+    free(mem);
+    return;
+  }
+  c = slab_cache_get(s);
+  if (c == NULL) {
+    e->next = NULL;
+    slab_depot_push(s, e, 1);
+    return;
+  }
+  if (c->loaded_count >= __atomic_load_n(&s->batch, __ATOMIC_RELAXED)) {
+    if (c->prev_count > 0) {
+      slab_depot_push(s, c->prev, c->prev_count);
+    }
+    c->prev = c->loaded;
+    c->prev_count = c->loaded_count;
+    c->loaded = NULL;
+    c->loaded_count = 0;
+  }
+  e->next = c->loaded;
+  c->loaded = e;
+  c->loaded_count++;
+}
+
+void
+memp_slab_init(const struct memp_desc *desc)
+{
+  pthread_once(&slab_once, slab_init);
+  if (*desc->slab == NULL) {
+    *desc->slab = slab_pool_new(desc->size, desc->num, desc);
+  }
+}
+
+/* Count an element as used, unless the pool is at its limit */
+static int
+slab_take(struct memp_slab *s)
+{
+  size_t limit = __atomic_load_n(&s->limit, __ATOMIC_RELAXED);
+  size_t used = __atomic_add_fetch(&s->used, 1, __ATOMIC_RELAXED);
+  if (limit != 0 && used > limit) {
+    __atomic_fetch_sub(&s->used, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  return 1;
+}
+
+void *
+memp_slab_alloc(const struct memp_desc *desc)
+{
+  struct memp_slab *s = *desc->slab;
+  void *mem = NULL;
+  if (s != NULL && slab_take(s)) {
+    mem = slab_alloc(s);
+    if (mem == NULL) {
+      __atomic_fetch_sub(&s->used, 1, __ATOMIC_RELAXED);
+    }
+  }
+#if MEMP_STATS
+  if (mem != NULL) {
+    mem_size_t used = __atomic_add_fetch(&desc->stats->used, 1, __ATOMIC_RELAXED);
+    if (used > __atomic_load_n(&desc->stats->max, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&desc->stats->max, used, __ATOMIC_RELAXED);
+    }
+  } else {
+    __atomic_fetch_add(&desc->stats->err, 1, __ATOMIC_RELAXED);
+  }
+#endif /* MEMP_STATS */
+  return mem;
+}
+
+void
+memp_slab_free(const struct memp_desc *desc, void *mem)
+{
+#if MEMP_STATS
+  __atomic_fetch_sub(&desc->stats->used, 1, __ATOMIC_RELAXED);
+#endif /* MEMP_STATS */
+  __atomic_fetch_sub(&(*desc->slab)->used, 1, __ATOMIC_RELAXED);
+  slab_free(*desc->slab, mem);
+}
+
+void
+memp_slab_set_limit(const struct memp_desc *desc, size_t num)
+{
+  struct memp_slab *s = *desc->slab;
+  if (s == NULL) {
+    return;
+  }
+  __atomic_store_n(&s->limit, num, __ATOMIC_RELAXED);
+  /* smaller magazines for small pools, so that few elements sit in the caches
+     of threads that do not need them */
+  __atomic_store_n(&s->batch, num == 0 ? MEMP_SLAB_BATCH :
+                   (unsigned int)LWIP_MAX(1, LWIP_MIN(MEMP_SLAB_BATCH, num / 16)), __ATOMIC_RELAXED);
+}
+
+void
+memp_slab_set_budget(size_t bytes)
+{
+  __atomic_store_n(&slab_budget, bytes, __ATOMIC_RELAXED);
+}
+
+size_t
+memp_slab_reserved(const struct memp_desc *desc, size_t *bytes)
+{
+  struct memp_slab *s = desc != NULL ? *desc->slab : NULL;
+  size_t count = 0, size;
+  if (desc == NULL) {
+    size = __atomic_load_n(&slab_reserved, __ATOMIC_RELAXED);
+  } else if (s != NULL) {
+    count = __atomic_load_n(&s->carved, __ATOMIC_RELAXED);
+    size = count * s->elem_size;
+  } else {
+    size = 0;
+  }
+  if (bytes != NULL) {
+    *bytes = size;
+  }
+  return count;
+}
+
+/* Heap blocks start with a header holding their size class, blocks too large
+   for any class come from malloc() and also record their size */
+void *
+mem_slab_malloc(size_t size)
+{
+  size_t *hdr;
+  size_t i = 0;
+
+  size += SLAB_ALIGN;
+  while (i < SLAB_HEAP_CLASSES && ((size_t)SLAB_HEAP_MIN << i) < size) {
+    i++;
+  }
+  if (i < SLAB_HEAP_CLASSES) {
+    pthread_once(&slab_once, slab_init);
+    hdr = (size_t *)(slab_heap[i] != NULL ? slab_alloc(slab_heap[i]) : NULL);
+  } else if (slab_reserve_bytes(size)) {
+    hdr = (size_t *)malloc(size);
+    if (hdr == NULL) {
+      __atomic_fetch_sub(&slab_reserved, size, __ATOMIC_RELAXED);
+    } else {
+      hdr[1] = size;
+    }
+  } else {
+    hdr = NULL;
+  }
+  if (hdr == NULL) {
+    return NULL;
+  }
+  hdr[0] = i;
+  return (u8_t *)hdr + SLAB_ALIGN;
+}
+
+void
+mem_slab_free(void *mem)
+{
+  size_t *hdr = (size_t *)(void *)((u8_t *)mem - SLAB_ALIGN);
+  if (hdr[0] < SLAB_HEAP_CLASSES) {
+    slab_free(slab_heap[hdr[0]], hdr);
+  } else {
+    __atomic_fetch_sub(&slab_reserved, hdr[1], __ATOMIC_RELAXED);
+    free(hdr);
+  }
+}
+
+void *
+mem_slab_calloc(size_t count, size_t size)
+{
+  void *mem;
+  if (size != 0 && count > ((size_t)-1 - SLAB_ALIGN) / size) {
+    return NULL;
+  }
+  mem = mem_slab_malloc(count * size);
+  if (mem != NULL) {
+    memset(mem, 0, count * size);
+  }
+  return mem;
+}
+
+#endif /* MEMP_MEM_SLAB */
@@ -53,6 +53,11 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#endif
 
 #include "lwip/def.h"
 
@@ -88,20 +93,54 @@ get_monotonic_time(struct timespec *ts)
 static struct sys_thread *threads = NULL;
 static pthread_mutex_t threads_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-struct sys_mbox_msg {
-  struct sys_mbox_msg *next;
-  void *msg;
+/* Default mailbox depth, used when sys_mbox_new() is given a size of 0 (rounded up to a power of two) */
+#ifndef SYS_MBOX_SIZE
+#define SYS_MBOX_SIZE 128
+#endif
+
+#ifndef SYS_MBOX_CACHE_LINE
+#define SYS_MBOX_CACHE_LINE 64
+#endif
+
+/* Mailbox cells come from the stack's heap, so that the slab allocator counts them against
+   its budget like the messages they carry */
+#if MEMP_MEM_SLAB
+#define sys_mbox_cells_malloc mem_slab_malloc
+#define sys_mbox_cells_free   mem_slab_free
+#else
+#define sys_mbox_cells_malloc malloc
+#define sys_mbox_cells_free   free
+#endif
+
+/* Sleeping side of a mailbox. Posters and fetchers never take a lock on the fast path,
+   they only go through here when the mailbox is empty (fetch) or full (post), and a
+   wakeup is only issued when a waiter has announced itself */
+struct sys_mbox_waitq {
+  u32_t seq;       /* bumped on every wakeup, the futex word on linux */
+  u32_t waiters;   /* number of threads sleeping or about to sleep on seq */
+  u32_t signalled; /* a wakeup has been issued since the last waiter went to sleep */
+#ifndef __linux__
+  pthread_condattr_t condattr;
+  pthread_cond_t cond;
+  pthread_mutex_t mutex;
+#endif
 };
 
-#define SYS_MBOX_SIZE 128
+struct sys_mbox_cell {
+  unsigned long seq;
+  void *msg;
+};
 
+/* Bounded lock-free multi-producer queue (after D. Vyukov). Each cell carries a sequence
+   number telling posters and fetchers whose turn it is, so head and tail are the only
+   shared words and they live on separate cache lines */
 struct sys_mbox {
-  int first, last;
-  void *msgs[SYS_MBOX_SIZE];
-  struct sys_sem *not_empty;
-  struct sys_sem *not_full;
-  struct sys_sem *mutex;
-  int wait_send;
+  struct sys_mbox_cell *cells;
+  unsigned long mask;
+  struct sys_mbox_waitq not_empty;
+  struct sys_mbox_waitq not_full;
+  unsigned long head __attribute__((aligned(SYS_MBOX_CACHE_LINE)));
+  unsigned long tail __attribute__((aligned(SYS_MBOX_CACHE_LINE)));
 };
 
 struct sys_sem {
@@ -182,21 +221,191 @@ sys_thread_new(const char *name, lwip_thread_fn function, void *arg, int stacksi
 
 /*-----------------------------------------------------------------------------------*/
 /* Mailbox */
+
+static void
+mbox_waitq_init(struct sys_mbox_waitq *q)
+{
+  q->seq = 0;
+  q->waiters = 0;
+  q->signalled = 0;
+#ifndef __linux__
+  pthread_condattr_init(&(q->condattr));
+#if !(defined(LWIP_UNIX_MACH) || (defined(LWIP_UNIX_ANDROID) && __ANDROID_API__ < 21))
+  pthread_condattr_setclock(&(q->condattr), CLOCK_MONOTONIC);
+#endif
+  pthread_cond_init(&(q->cond), &(q->condattr));
+  pthread_mutex_init(&(q->mutex), NULL);
+#endif
+}
+
+static void
+mbox_waitq_destroy(struct sys_mbox_waitq *q)
+{
+#ifndef __linux__
+  pthread_cond_destroy(&(q->cond));
+  pthread_condattr_destroy(&(q->condattr));
+  pthread_mutex_destroy(&(q->mutex));
+#else
+  LWIP_UNUSED_ARG(q);
+#endif
+}
+
+/* Announce that the caller is about to sleep. The caller must re-check the mailbox after
+   this and before mbox_waitq_wait(), and call mbox_waitq_done() once it is awake */
+static u32_t
+mbox_waitq_prepare(struct sys_mbox_waitq *q)
+{
+  u32_t seq = __atomic_load_n(&q->seq, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&q->signalled, 0, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&q->waiters, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return seq;
+}
+
+static void
+mbox_waitq_done(struct sys_mbox_waitq *q)
+{
+  __atomic_fetch_sub(&q->waiters, 1, __ATOMIC_RELAXED);
+  /* let the next post/fetch wake whoever is still sleeping */
+  __atomic_store_n(&q->signalled, 0, __ATOMIC_RELEASE);
+}
+
+/* Sleep until seq moves away from the value returned by mbox_waitq_prepare(), or until
+   timeout (ms, 0 = forever) passes. Returns SYS_ARCH_TIMEOUT on timeout */
+static u32_t
+mbox_waitq_wait(struct sys_mbox_waitq *q, u32_t seq, u32_t timeout)
+{
+#ifdef __linux__
+  struct timespec ts;
+  ts.tv_sec = timeout / 1000L;
+  ts.tv_nsec = (timeout % 1000L) * 1000000L;
+  if (syscall(SYS_futex, &q->seq, FUTEX_WAIT_PRIVATE, seq, timeout ? &ts : NULL, NULL, 0) == -1
+      && errno == ETIMEDOUT) {
+    return SYS_ARCH_TIMEOUT;
+  }
+  return 0;
+#else
+  u32_t ret = 0;
+  pthread_mutex_lock(&(q->mutex));
+  if (__atomic_load_n(&q->seq, __ATOMIC_ACQUIRE) == seq) {
+    ret = cond_wait(&(q->cond), &(q->mutex), timeout);
+  }
+  pthread_mutex_unlock(&(q->mutex));
+  return ret == SYS_ARCH_TIMEOUT ? SYS_ARCH_TIMEOUT : 0;
+#endif
+}
+
+/* Called after a successful post/fetch. Wakes up to n sleepers on the other side, but only if
+   there are any and nobody has woken them yet, so a burst of posts costs one wakeup */
+static void
+mbox_waitq_wake(struct sys_mbox_waitq *q, int n)
+{
+  /* pairs with the fence in mbox_waitq_prepare(): either the waiter sees our queue update, or we see it */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&q->waiters, __ATOMIC_ACQUIRE) == 0
+      || __atomic_exchange_n(&q->signalled, 1, __ATOMIC_ACQ_REL)) {
+    return;
+  }
+#ifdef __linux__
+  __atomic_fetch_add(&q->seq, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &q->seq, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+#else
+  pthread_mutex_lock(&(q->mutex));
+  __atomic_fetch_add(&q->seq, 1, __ATOMIC_RELEASE);
+  if (n == 1) {
+    pthread_cond_signal(&(q->cond));
+  } else {
+    pthread_cond_broadcast(&(q->cond));
+  }
+  pthread_mutex_unlock(&(q->mutex));
+#endif
+}
+
+static int
+mbox_enqueue(struct sys_mbox *mbox, void *msg)
+{
+  struct sys_mbox_cell *cell;
+  unsigned long pos = __atomic_load_n(&mbox->head, __ATOMIC_RELAXED);
+  for (;;) {
+    long dif;
+    cell = &mbox->cells[pos & mbox->mask];
+    dif = (long)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&mbox->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (dif < 0) {
+      return 0; /* full */
+    } else {
+      pos = __atomic_load_n(&mbox->head, __ATOMIC_RELAXED);
+    }
+  }
+  cell->msg = msg;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static int
+mbox_dequeue(struct sys_mbox *mbox, void **msg)
+{
+  struct sys_mbox_cell *cell;
+  unsigned long pos = __atomic_load_n(&mbox->tail, __ATOMIC_RELAXED);
+  for (;;) {
+    long dif;
+    cell = &mbox->cells[pos & mbox->mask];
+    dif = (long)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&mbox->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (dif < 0) {
+      return 0; /* empty */
+    } else {
+      pos = __atomic_load_n(&mbox->tail, __ATOMIC_RELAXED);
+    }
+  }
+  if (msg != NULL) {
+    *msg = cell->msg;
+  }
+  __atomic_store_n(&cell->seq, pos + mbox->mask + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static u32_t
+elapsed_ms(const struct timespec *since)
+{
+  struct timespec now;
+  get_monotonic_time(&now);
+  return (u32_t)((now.tv_sec - since->tv_sec) * 1000L + (now.tv_nsec - since->tv_nsec) / 1000000L);
+}
+
 err_t
 sys_mbox_new(struct sys_mbox **mb, int size)
 {
   struct sys_mbox *mbox;
-  LWIP_UNUSED_ARG(size);
+  unsigned long i, depth = 2;
 
-  mbox = (struct sys_mbox *)malloc(sizeof(struct sys_mbox));
-  if (mbox == NULL) {
+  if (size <= 0) {
+    size = SYS_MBOX_SIZE;
+  }
+  while (depth < (unsigned long)size) {
+    depth <<= 1;
+  }
+  if (posix_memalign((void **)&mbox, SYS_MBOX_CACHE_LINE, sizeof(struct sys_mbox)) != 0) {
+    return ERR_MEM;
+  }
+  memset(mbox, 0, sizeof(struct sys_mbox));
+  mbox->cells = (struct sys_mbox_cell *)sys_mbox_cells_malloc(depth * sizeof(struct sys_mbox_cell));
+  if (mbox->cells == NULL) {
+    free(mbox);
     return ERR_MEM;
   }
-  mbox->first = mbox->last = 0;
-  mbox->not_empty = sys_sem_new_internal(0);
-  mbox->not_full = sys_sem_new_internal(0);
-  mbox->mutex = sys_sem_new_internal(1);
-  mbox->wait_send = 0;
+  for (i = 0; i < depth; i++) {
+    mbox->cells[i].seq = i;
+  }
+  mbox->mask = depth - 1;
+  mbox_waitq_init(&mbox->not_empty);
+  mbox_waitq_init(&mbox->not_full);
 
   SYS_STATS_INC_USED(mbox);
   *mb = mbox;
@@ -209,13 +418,10 @@ sys_mbox_free(struct sys_mbox **mb)
   if ((mb != NULL) && (*mb != SYS_MBOX_NULL)) {
     struct sys_mbox *mbox = *mb;
     SYS_STATS_DEC(mbox.used);
-    sys_arch_sem_wait(&mbox->mutex, 0);
-    
-    sys_sem_free_internal(mbox->not_empty);
-    sys_sem_free_internal(mbox->not_full);
-    sys_sem_free_internal(mbox->mutex);
-    mbox->not_empty = mbox->not_full = mbox->mutex = NULL;
+    mbox_waitq_destroy(&mbox->not_empty);
+    mbox_waitq_destroy(&mbox->not_full);
     /*  LWIP_DEBUGF("sys_mbox_free: mbox 0x%lx\n", mbox); */
+    sys_mbox_cells_free(mbox->cells);
     free(mbox);
   }
 }
@@ -223,75 +429,40 @@ sys_mbox_free(struct sys_mbox **mb)
 err_t
 sys_mbox_trypost(struct sys_mbox **mb, void *msg)
 {
-  u8_t first;
   struct sys_mbox *mbox;
   LWIP_ASSERT("invalid mbox", (mb != NULL) && (*mb != NULL));
   mbox = *mb;
 
-  sys_arch_sem_wait(&mbox->mutex, 0);
-
   LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_trypost: mbox %p msg %p\n",
                           (void *)mbox, (void *)msg));
 
-  if ((mbox->last + 1) >= (mbox->first + SYS_MBOX_SIZE)) {
-    sys_sem_signal(&mbox->mutex);
+  if (!mbox_enqueue(mbox, msg)) {
     return ERR_MEM;
   }
-
-  mbox->msgs[mbox->last % SYS_MBOX_SIZE] = msg;
-
-  if (mbox->last == mbox->first) {
-    first = 1;
-  } else {
-    first = 0;
-  }
-
-  mbox->last++;
-
-  if (first) {
-    sys_sem_signal(&mbox->not_empty);
-  }
-
-  sys_sem_signal(&mbox->mutex);
-
+  mbox_waitq_wake(&mbox->not_empty, INT_MAX);
   return ERR_OK;
 }
 
 void
 sys_mbox_post(struct sys_mbox **mb, void *msg)
 {
-  u8_t first;
   struct sys_mbox *mbox;
   LWIP_ASSERT("invalid mbox", (mb != NULL) && (*mb != NULL));
   mbox = *mb;
 
-  sys_arch_sem_wait(&mbox->mutex, 0);
-
   LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_post: mbox %p msg %p\n", (void *)mbox, (void *)msg));
 
-  while ((mbox->last + 1) >= (mbox->first + SYS_MBOX_SIZE)) {
-    mbox->wait_send++;
-    sys_sem_signal(&mbox->mutex);
-    sys_arch_sem_wait(&mbox->not_full, 0);
-    sys_arch_sem_wait(&mbox->mutex, 0);
-    mbox->wait_send--;
-  }
-
-  mbox->msgs[mbox->last % SYS_MBOX_SIZE] = msg;
-
-  if (mbox->last == mbox->first) {
-    first = 1;
-  } else {
-    first = 0;
-  }
-
-  mbox->last++;
-
-  if (first) {
-    sys_sem_signal(&mbox->not_empty);
+  while (!mbox_enqueue(mbox, msg)) {
+    /* full: announce ourselves, re-check, then sleep until a fetch makes room */
+    u32_t seq = mbox_waitq_prepare(&mbox->not_full);
+    if (mbox_enqueue(mbox, msg)) {
+      mbox_waitq_done(&mbox->not_full);
+      break;
+    }
+    mbox_waitq_wait(&mbox->not_full, seq, 0);
+    mbox_waitq_done(&mbox->not_full);
   }
-
-  sys_sem_signal(&mbox->mutex);
+  mbox_waitq_wake(&mbox->not_empty, INT_MAX);
 }
 
 u32_t
@@ -301,79 +472,54 @@ sys_arch_mbox_tryfetch(struct sys_mbox **mb, void **msg)
   LWIP_ASSERT("invalid mbox", (mb != NULL) && (*mb != NULL));
   mbox = *mb;
 
-  sys_arch_sem_wait(&mbox->mutex, 0);
-
-  if (mbox->first == mbox->last) {
-    sys_sem_signal(&mbox->mutex);
+  if (!mbox_dequeue(mbox, msg)) {
     return SYS_MBOX_EMPTY;
   }
-
-  if (msg != NULL) {
-    LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_tryfetch: mbox %p msg %p\n", (void *)mbox, *msg));
-    *msg = mbox->msgs[mbox->first % SYS_MBOX_SIZE];
-  }
-  else{
-    LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_tryfetch: mbox %p, null msg\n", (void *)mbox));
-  }
-
-  mbox->first++;
-
-  if (mbox->wait_send) {
-    sys_sem_signal(&mbox->not_full);
-  }
-
-  sys_sem_signal(&mbox->mutex);
-
+  LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_tryfetch: mbox %p msg %p\n", (void *)mbox, msg ? *msg : NULL));
+  mbox_waitq_wake(&mbox->not_full, 1);
   return 0;
 }
 
 u32_t
 sys_arch_mbox_fetch(struct sys_mbox **mb, void **msg, u32_t timeout)
 {
+  struct timespec start;
   u32_t time_needed = 0;
   struct sys_mbox *mbox;
   LWIP_ASSERT("invalid mbox", (mb != NULL) && (*mb != NULL));
   mbox = *mb;
 
-  /* The mutex lock is quick so we don't bother with the timeout
-     stuff here. */
-  sys_arch_sem_wait(&mbox->mutex, 0);
-
-  while (mbox->first == mbox->last) {
-    sys_sem_signal(&mbox->mutex);
-
-    /* We block while waiting for a mail to arrive in the mailbox. We
-       must be prepared to timeout. */
-    if (timeout != 0) {
-      time_needed = sys_arch_sem_wait(&mbox->not_empty, timeout);
-
-      if (time_needed == SYS_ARCH_TIMEOUT) {
-        return SYS_ARCH_TIMEOUT;
+  if (mbox_dequeue(mbox, msg)) {
+    mbox_waitq_wake(&mbox->not_full, 1);
+    return 0;
+  }
+  get_monotonic_time(&start);
+  for (;;) {
+    /* empty: announce ourselves, re-check, then sleep until a post arrives or we time out */
+    int got;
+    u32_t seq = mbox_waitq_prepare(&mbox->not_empty);
+    got = mbox_dequeue(mbox, msg);
+    if (!got) {
+      u32_t remaining = 0;
+      if (timeout != 0) {
+        time_needed = elapsed_ms(&start);
+        if (time_needed >= timeout) {
+          mbox_waitq_done(&mbox->not_empty);
+          return SYS_ARCH_TIMEOUT;
+        }
+        remaining = timeout - time_needed;
       }
-    } else {
-      sys_arch_sem_wait(&mbox->not_empty, 0);
+      mbox_waitq_wait(&mbox->not_empty, seq, remaining);
+      got = mbox_dequeue(mbox, msg);
+    }
+    mbox_waitq_done(&mbox->not_empty);
+    if (got) {
+      break;
     }
-
-    sys_arch_sem_wait(&mbox->mutex, 0);
-  }
-
-  if (msg != NULL) {
-    LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_fetch: mbox %p msg %p\n", (void *)mbox, *msg));
-    *msg = mbox->msgs[mbox->first % SYS_MBOX_SIZE];
-  }
-  else{
-    LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_fetch: mbox %p, null msg\n", (void *)mbox));
-  }
-
-  mbox->first++;
-
-  if (mbox->wait_send) {
-    sys_sem_signal(&mbox->not_full);
   }
-
-  sys_sem_signal(&mbox->mutex);
-
-  return time_needed;
+  LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_fetch: mbox %p msg %p\n", (void *)mbox, msg ? *msg : NULL));
+  mbox_waitq_wake(&mbox->not_full, 1);
+  return elapsed_ms(&start);
 }
 
 /*-----------------------------------------------------------------------------------*/
@@ -717,6 +717,40 @@ netconn_send(struct netconn *conn, struct netbuf *buf)
   return err;
 }
 
+/**
+ * @ingroup netconn_udp
+ * Send several netbufs over a UDP or RAW netconn with a single call into
+ * tcpip_thread. Sending stops at the first netbuf that fails.
+ *
+ * @param conn the UDP or RAW netconn over which to send data
+ * @param bufs the netbufs to send (each with its destination set as for netconn_send)
+ * @param count number of netbufs in bufs
+ * @param sent receives the number of netbufs that were sent
+ * @return ERR_OK if all netbufs were sent, else the error of the first one that wasn't
+ */
+err_t
+netconn_send_batch(struct netconn *conn, struct netbuf **bufs, u16_t count, u16_t *sent)
+{
+  API_MSG_VAR_DECLARE(msg);
+  err_t err;
+
+  LWIP_ERROR("netconn_send_batch: invalid conn",  (conn != NULL), return ERR_ARG;);
+  LWIP_ERROR("netconn_send_batch: invalid sent",  (sent != NULL), return ERR_ARG;);
+
+  LWIP_DEBUGF(API_LIB_DEBUG, ("netconn_send_batch: sending %"U16_F" netbufs\n", count));
+
+  API_MSG_VAR_ALLOC(msg);
+  API_MSG_VAR_REF(msg).conn = conn;
+  API_MSG_VAR_REF(msg).msg.bb.bufs = bufs;
+  API_MSG_VAR_REF(msg).msg.bb.count = count;
+  API_MSG_VAR_REF(msg).msg.bb.sent = 0;
+  err = netconn_apimsg(lwip_netconn_do_send_batch, &API_MSG_VAR_REF(msg));
+  *sent = API_MSG_VAR_REF(msg).msg.bb.sent;
+  API_MSG_VAR_FREE(msg);
+
+  return err;
+}
+
 /**
  * @ingroup netconn_tcp
  * Send data over a TCP netconn.
@@ -1382,54 +1382,92 @@ lwip_netconn_do_listen(void *m)
 #endif /* LWIP_TCP */
 
 /**
- * Send some data on a RAW or UDP pcb contained in a netconn
- * Called from netconn_send
+ * Send a netbuf over the pcb of a UDP or RAW netconn.
+ * Must be called from tcpip_thread.
  *
- * @param m the api_msg_msg pointing to the connection
+ * @param conn the netconn to send on
+ * @param b the netbuf to send
+ * @return ERR_OK if the data was sent, any other err_t on error
  */
-void
-lwip_netconn_do_send(void *m)
+static err_t
+lwip_netconn_send_netbuf(struct netconn *conn, struct netbuf *b)
 {
-  struct api_msg *msg = (struct api_msg*)m;
+  err_t err;
 
-  if (ERR_IS_FATAL(msg->conn->last_err)) {
-    msg->err = msg->conn->last_err;
-  } else {
-    msg->err = ERR_CONN;
-    if (msg->conn->pcb.tcp != NULL) {
-      switch (NETCONNTYPE_GROUP(msg->conn->type)) {
+  if (ERR_IS_FATAL(conn->last_err)) {
+    return conn->last_err;
+  }
+  err = ERR_CONN;
+  if (conn->pcb.tcp != NULL) {
+    switch (NETCONNTYPE_GROUP(conn->type)) {
 #if LWIP_RAW
-      case NETCONN_RAW:
-        if (ip_addr_isany(&msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-          msg->err = raw_send(msg->conn->pcb.raw, msg->msg.b->p);
-        } else {
-          msg->err = raw_sendto(msg->conn->pcb.raw, msg->msg.b->p, &msg->msg.b->addr);
-        }
-        break;
+    case NETCONN_RAW:
+      if (ip_addr_isany(&b->addr) || IP_IS_ANY_TYPE_VAL(b->addr)) {
+        err = raw_send(conn->pcb.raw, b->p);
+      } else {
+        err = raw_sendto(conn->pcb.raw, b->p, &b->addr);
+      }
+      break;
 #endif
 #if LWIP_UDP
-      case NETCONN_UDP:
+    case NETCONN_UDP:
 #if LWIP_CHECKSUM_ON_COPY
-        if (ip_addr_isany(&msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-          msg->err = udp_send_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-            msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
-        } else {
-          msg->err = udp_sendto_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-            &msg->msg.b->addr, msg->msg.b->port,
-            msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
-        }
+      if (ip_addr_isany(&b->addr) || IP_IS_ANY_TYPE_VAL(b->addr)) {
+        err = udp_send_chksum(conn->pcb.udp, b->p,
+          b->flags & NETBUF_FLAG_CHKSUM, b->toport_chksum);
+      } else {
+        err = udp_sendto_chksum(conn->pcb.udp, b->p,
+          &b->addr, b->port,
+          b->flags & NETBUF_FLAG_CHKSUM, b->toport_chksum);
+      }
 #else /* LWIP_CHECKSUM_ON_COPY */
-        if (ip_addr_isany_val(msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-          msg->err = udp_send(msg->conn->pcb.udp, msg->msg.b->p);
-        } else {
-          msg->err = udp_sendto(msg->conn->pcb.udp, msg->msg.b->p, &msg->msg.b->addr, msg->msg.b->port);
-        }
+      if (ip_addr_isany_val(b->addr) || IP_IS_ANY_TYPE_VAL(b->addr)) {
+        err = udp_send(conn->pcb.udp, b->p);
+      } else {
+        err = udp_sendto(conn->pcb.udp, b->p, &b->addr, b->port);
+      }
 #endif /* LWIP_CHECKSUM_ON_COPY */
-        break;
+      break;
 #endif /* LWIP_UDP */
-      default:
-        break;
-      }
+    default:
+      break;
+    }
+  }
+  return err;
+}
+
+/**
+ * Send some data on a RAW or UDP pcb contained in a netconn
+ * Called from netconn_send
+ *
+ * @param m the api_msg_msg pointing to the connection
+ */
+void
+lwip_netconn_do_send(void *m)
+{
+  struct api_msg *msg = (struct api_msg*)m;
+
+  msg->err = lwip_netconn_send_netbuf(msg->conn, msg->msg.b);
+  TCPIP_APIMSG_ACK(msg);
+}
+
+/**
+ * Send several netbufs over a UDP or RAW pcb in one call from the
+ * application thread. Stops at the first netbuf that could not be sent.
+ * Called from netconn_send_batch
+ *
+ * @param m the api_msg_msg pointing to the connection
+ */
+void
+lwip_netconn_do_send_batch(void *m)
+{
+  struct api_msg *msg = (struct api_msg*)m;
+
+  msg->err = ERR_OK;
+  for (msg->msg.bb.sent = 0; msg->msg.bb.sent < msg->msg.bb.count; msg->msg.bb.sent++) {
+    msg->err = lwip_netconn_send_netbuf(msg->conn, msg->msg.bb.bufs[msg->msg.bb.sent]);
+    if (msg->err != ERR_OK) {
+      break;
     }
   }
   TCPIP_APIMSG_ACK(msg);
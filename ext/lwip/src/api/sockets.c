@@ -189,6 +189,11 @@ static void sockaddr_to_ipaddr_port(const struct sockaddr* sockaddr, ip_addr_t*
 
 #define NUM_SOCKETS MEMP_NUM_NETCONN
 
+/** Number of datagrams lwip_sendmmsg hands to tcpip_thread at once */
+#ifndef LWIP_SENDMMSG_BATCH
+#define LWIP_SENDMMSG_BATCH 32
+#endif
+
 /** This is overridable for the rare case where more than 255 threads
  * select on the same socket...
  */
@@ -216,6 +221,10 @@ struct lwip_sock {
   u8_t err;
   /** counter of how many threads are waiting for this socket using select */
   SELWAIT_T select_waiting;
+#if LWIP_SOCKET_EPOLL
+  /** epoll interest set entries watching this socket */
+  struct lwip_epitem *epitems;
+#endif /* LWIP_SOCKET_EPOLL */
 };
 
 #if LWIP_NETCONN_SEM_PER_THREAD
@@ -238,12 +247,55 @@ struct lwip_select_cb {
   fd_set *writeset;
   /** unimplemented: exceptset passed to select */
   fd_set *exceptset;
+#if LWIP_SOCKET_POLL
+  /** fds passed to poll; NULL if select */
+  struct lwip_pollfd *poll_fds;
+  /** nfds passed to poll; 0 if select */
+  lwip_nfds_t poll_nfds;
+#endif /* LWIP_SOCKET_POLL */
   /** don't signal the same semaphore twice: set to 1 when signalled */
   int sem_signalled;
   /** semaphore to wake up a task waiting for select */
   SELECT_SEM_T sem;
 };
 
+#if LWIP_SOCKET_EPOLL
+/** An entry of an epoll interest set: one socket watched by one epoll instance */
+struct lwip_epitem {
+  /** next entry watching the same socket */
+  struct lwip_epitem *sock_next;
+  /** next entry of the same interest set */
+  struct lwip_epitem *ep_next;
+  /** neighbours on the ready list of the epoll instance */
+  struct lwip_epitem *rdl_next;
+  struct lwip_epitem *rdl_prev;
+  struct lwip_epoll *ep;
+  struct lwip_sock *sock;
+  /** events and data passed to epoll_ctl */
+  u32_t events;
+  lwip_epoll_data_t data;
+  /** 1 while on the ready list */
+  u8_t ready;
+  /** 1 after a EPOLLONESHOT event was reported, until re-armed with EPOLL_CTL_MOD */
+  u8_t disabled;
+};
+
+/** An epoll instance */
+struct lwip_epoll {
+  /** 1 if this instance is in use */
+  u8_t used;
+  /** number of threads blocked in lwip_epoll_wait */
+  int waiting;
+  /** the interest set */
+  struct lwip_epitem *items;
+  /** entries which may have events to report, in the order they became ready */
+  struct lwip_epitem *rdl_head;
+  struct lwip_epitem *rdl_tail;
+  /** semaphore to wake up threads blocked in lwip_epoll_wait */
+  sys_sem_t sem;
+};
+#endif /* LWIP_SOCKET_EPOLL */
+
 /** A struct sockaddr replacement that has the same alignment as sockaddr_in/
  *  sockaddr_in6 if instantiated.
  */
@@ -288,6 +340,14 @@ static struct lwip_select_cb *select_cb_list;
 /** This counter is increased from lwip_select when the list is changed
     and checked in event_callback to see if it has changed. */
 static volatile int select_cb_ctr;
+#if LWIP_SOCKET_EPOLL
+/** The global array of epoll instances */
+static struct lwip_epoll epolls[LWIP_SOCKET_EPOLL_MAX];
+
+static void lwip_epoll_sock_event(struct lwip_sock *sock);
+static void lwip_epoll_drop_socket(struct lwip_sock *sock);
+static int lwip_epoll_close(int epfd);
+#endif /* LWIP_SOCKET_EPOLL */
 
 #if LWIP_SOCKET_SET_ERRNO
 #ifndef set_errno
@@ -613,6 +673,12 @@ lwip_close(int s)
 
   LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_close(%d)\n", s));
 
+#if LWIP_SOCKET_EPOLL
+  if ((s >= LWIP_EPOLL_OFFSET) && (s < LWIP_EPOLL_OFFSET + LWIP_SOCKET_EPOLL_MAX)) {
+    return lwip_epoll_close(s);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
+
   sock = get_socket(s);
   if (!sock) {
     return -1;
@@ -635,6 +701,10 @@ lwip_close(int s)
     return -1;
   }
 
+#if LWIP_SOCKET_EPOLL
+  /* a closed socket is removed from all interest sets */
+  lwip_epoll_drop_socket(sock);
+#endif /* LWIP_SOCKET_EPOLL */
   free_socket(sock, is_tcp);
   set_errno(0);
   return 0;
@@ -961,6 +1031,109 @@ lwip_send(int s, const void *data, size_t size, int flags)
   return (err == ERR_OK ? (int)written : -1);
 }
 
+#if LWIP_UDP || LWIP_RAW
+/**
+ * Create a netbuf for sending the message described by msg on a UDP or RAW
+ * socket. Unless LWIP_NETIF_TX_SINGLE_PBUF is set, the netbuf references the
+ * data of the IO vectors, so it has to be sent before they are modified.
+ *
+ * @param msg destination and IO vectors of the message
+ * @param out receives the netbuf (free with netbuf_delete()) if ERR_OK is returned
+ * @param size receives the length of the message
+ * @return ERR_OK on success, any other err_t on error
+ */
+static err_t
+lwip_sock_msg_to_netbuf(const struct msghdr *msg, struct netbuf **out, int *size)
+{
+  struct netbuf *chain_buf;
+  err_t err = ERR_OK;
+  int i;
+
+  LWIP_ERROR("lwip_sendmsg: invalid msghdr iov", (msg->msg_iov != NULL && msg->msg_iovlen != 0),
+             return ERR_ARG;);
+  LWIP_ERROR("lwip_sendmsg: invalid msghdr name", (((msg->msg_name == NULL) && (msg->msg_namelen == 0)) ||
+             IS_SOCK_ADDR_LEN_VALID(msg->msg_namelen)) ,
+             return ERR_ARG;);
+
+  *size = 0;
+  /* initialize chain buffer with destination */
+  chain_buf = netbuf_new();
+  if (!chain_buf) {
+    return ERR_MEM;
+  }
+  if (msg->msg_name) {
+    u16_t remote_port;
+    SOCKADDR_TO_IPADDR_PORT((const struct sockaddr *)msg->msg_name, &chain_buf->addr, remote_port);
+    netbuf_fromport(chain_buf) = remote_port;
+  }
+#if LWIP_NETIF_TX_SINGLE_PBUF
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    *size += msg->msg_iov[i].iov_len;
+  }
+  /* Allocate a new netbuf and copy the data into it. */
+  if (netbuf_alloc(chain_buf, (u16_t)*size) == NULL) {
+     err = ERR_MEM;
+  } else {
+    /* flatten the IO vectors */
+    size_t offset = 0;
+    for (i = 0; i < msg->msg_iovlen; i++) {
+      MEMCPY(&((u8_t*)chain_buf->p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      offset += msg->msg_iov[i].iov_len;
+    }
+#if LWIP_CHECKSUM_ON_COPY
+    {
+      /* This can be improved by using LWIP_CHKSUM_COPY() and aggregating the checksum for each IO vector */
+      u16_t chksum = ~inet_chksum_pbuf(chain_buf->p);
+      netbuf_set_chksum(chain_buf, chksum);
+    }
+#endif /* LWIP_CHECKSUM_ON_COPY */
+    err = ERR_OK;
+  }
+#else /* LWIP_NETIF_TX_SINGLE_PBUF */
+  /* create a chained netbuf from the IO vectors. NOTE: we assemble a pbuf chain
+     manually to avoid having to allocate, chain, and delete a netbuf for each iov */
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_REF);
+    if (p == NULL) {
+      err = ERR_MEM; /* let netbuf_delete() cleanup chain_buf */
+      break;
+    }
+    p->payload = msg->msg_iov[i].iov_base;
+    LWIP_ASSERT("iov_len < u16_t", msg->msg_iov[i].iov_len <= 0xFFFF);
+    p->len = p->tot_len = (u16_t)msg->msg_iov[i].iov_len;
+    /* netbuf empty, add new pbuf */
+    if (chain_buf->p == NULL) {
+      chain_buf->p = chain_buf->ptr = p;
+      /* add pbuf to existing pbuf chain */
+    } else {
+      pbuf_cat(chain_buf->p, p);
+    }
+  }
+  /* save size of total chain */
+  if (err == ERR_OK) {
+    *size = netbuf_len(chain_buf);
+  }
+#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
+
+  if (err == ERR_OK) {
+#if LWIP_IPV4 && LWIP_IPV6
+    /* Dual-stack: Unmap IPv4 mapped IPv6 addresses */
+    if (IP_IS_V6_VAL(chain_buf->addr) && ip6_addr_isipv4mappedipv6(ip_2_ip6(&chain_buf->addr))) {
+      unmap_ipv4_mapped_ipv6(ip_2_ip4(&chain_buf->addr), ip_2_ip6(&chain_buf->addr));
+      IP_SET_TYPE_VAL(chain_buf->addr, IPADDR_TYPE_V4);
+    }
+#endif /* LWIP_IPV4 && LWIP_IPV6 */
+  }
+
+  if (err != ERR_OK) {
+    netbuf_delete(chain_buf);
+    return err;
+  }
+  *out = chain_buf;
+  return ERR_OK;
+}
+#endif /* LWIP_UDP || LWIP_RAW */
+
 int
 lwip_sendmsg(int s, const struct msghdr *msg, int flags)
 {
@@ -1029,88 +1202,220 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
     struct netbuf *chain_buf;
 
     LWIP_UNUSED_ARG(flags);
-    LWIP_ERROR("lwip_sendmsg: invalid msghdr name", (((msg->msg_name == NULL) && (msg->msg_namelen == 0)) ||
-               IS_SOCK_ADDR_LEN_VALID(msg->msg_namelen)) ,
-               sock_set_errno(sock, err_to_errno(ERR_ARG)); return -1;);
+    err = lwip_sock_msg_to_netbuf(msg, &chain_buf, &size);
+    if (err == ERR_OK) {
+      /* send the data */
+      err = netconn_send(sock->conn, chain_buf);
+      /* deallocated the buffer */
+      netbuf_delete(chain_buf);
+    }
 
-    /* initialize chain buffer with destination */
-    chain_buf = netbuf_new();
-    if (!chain_buf) {
-      sock_set_errno(sock, err_to_errno(ERR_MEM));
-      return -1;
+    sock_set_errno(sock, err_to_errno(err));
+    return (err == ERR_OK ? size : -1);
+  }
+#else /* LWIP_UDP || LWIP_RAW */
+  sock_set_errno(sock, err_to_errno(ERR_ARG));
+  return -1;
+#endif /* LWIP_UDP || LWIP_RAW */
+}
+
+/**
+ * Send several messages with one call. For UDP and RAW sockets the messages
+ * are handed to tcpip_thread in batches of LWIP_SENDMMSG_BATCH, so there is one
+ * round trip per batch instead of one per message. Stream sockets send the
+ * messages one by one.
+ *
+ * @return number of messages sent (msg_len is set for each of them), -1 if
+ *         the first message could not be sent
+ */
+int
+lwip_sendmmsg(int s, struct lwip_mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  struct lwip_sock *sock;
+  unsigned int done = 0;
+  err_t err = ERR_OK;
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  LWIP_ERROR("lwip_sendmmsg: invalid msgvec", (msgvec != NULL) || (vlen == 0),
+             sock_set_errno(sock, err_to_errno(ERR_ARG)); return -1;);
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    for (; done < vlen; done++) {
+      int ret = lwip_sendmsg(s, &msgvec[done].msg_hdr, flags);
+      if (ret < 0) {
+        break;
+      }
+      msgvec[done].msg_len = (unsigned int)ret;
     }
-    if (msg->msg_name) {
-      u16_t remote_port;
-      SOCKADDR_TO_IPADDR_PORT((const struct sockaddr *)msg->msg_name, &chain_buf->addr, remote_port);
-      netbuf_fromport(chain_buf) = remote_port;
+    if (done > 0) {
+      sock_set_errno(sock, 0);
+      return (int)done;
     }
-#if LWIP_NETIF_TX_SINGLE_PBUF
-    for (i = 0; i < msg->msg_iovlen; i++) {
-      size += msg->msg_iov[i].iov_len;
+    return -1;
+  }
+#if LWIP_UDP || LWIP_RAW
+  while ((done < vlen) && (err == ERR_OK)) {
+    struct netbuf *bufs[LWIP_SENDMMSG_BATCH];
+    int sizes[LWIP_SENDMMSG_BATCH];
+    u16_t n = 0, sent = 0, i;
+
+    while ((n < LWIP_SENDMMSG_BATCH) && (done + n < vlen)) {
+      err = lwip_sock_msg_to_netbuf(&msgvec[done + n].msg_hdr, &bufs[n], &sizes[n]);
+      if (err != ERR_OK) {
+        break;
+      }
+      n++;
     }
-    /* Allocate a new netbuf and copy the data into it. */
-    if (netbuf_alloc(chain_buf, (u16_t)size) == NULL) {
-       err = ERR_MEM;
-    } else {
-      /* flatten the IO vectors */
-      size_t offset = 0;
-      for (i = 0; i < msg->msg_iovlen; i++) {
-        MEMCPY(&((u8_t*)chain_buf->p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
-        offset += msg->msg_iov[i].iov_len;
+    if (n > 0) {
+      err_t send_err = netconn_send_batch(sock->conn, bufs, n, &sent);
+      for (i = 0; i < n; i++) {
+        if (i < sent) {
+          msgvec[done + i].msg_len = (unsigned int)sizes[i];
+        }
+        netbuf_delete(bufs[i]);
       }
-#if LWIP_CHECKSUM_ON_COPY
-      {
-        /* This can be improved by using LWIP_CHKSUM_COPY() and aggregating the checksum for each IO vector */
-        u16_t chksum = ~inet_chksum_pbuf(chain_buf->p);
-        netbuf_set_chksum(chain_buf, chksum);
+      done += sent;
+      if (sent < n) {
+        /* an earlier message failed to send, its error takes precedence */
+        err = send_err;
       }
-#endif /* LWIP_CHECKSUM_ON_COPY */
-      err = ERR_OK;
     }
-#else /* LWIP_NETIF_TX_SINGLE_PBUF */
-    /* create a chained netbuf from the IO vectors. NOTE: we assemble a pbuf chain
-       manually to avoid having to allocate, chain, and delete a netbuf for each iov */
+  }
+  if (done > 0) {
+    sock_set_errno(sock, 0);
+    return (int)done;
+  }
+  sock_set_errno(sock, err_to_errno(err));
+  return -1;
+#else /* LWIP_UDP || LWIP_RAW */
+  sock_set_errno(sock, err_to_errno(ERR_ARG));
+  return -1;
+#endif /* LWIP_UDP || LWIP_RAW */
+}
+
+/**
+ * Receive a message into the IO vectors of msg.
+ *
+ * For UDP and RAW sockets one datagram is received; if it does not fit into
+ * the IO vectors the rest is discarded and MSG_TRUNC is set in msg_flags.
+ * The source address is stored in msg_name if given. For stream sockets the
+ * IO vectors are filled like repeated calls to recv() would, without blocking
+ * again once some data has been received. Ancillary data is not supported
+ * (msg_controllen is always set to 0).
+ *
+ * @return number of bytes received, -1 on error
+ */
+int
+lwip_recvmsg(int s, struct msghdr *msg, int flags)
+{
+  struct lwip_sock *sock;
+  int i;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmsg(%d, %p, 0x%x)\n", s, (void*)msg, flags));
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  LWIP_ERROR("lwip_recvmsg: invalid msghdr", (msg != NULL) && (msg->msg_iov != NULL) && (msg->msg_iovlen > 0),
+             sock_set_errno(sock, err_to_errno(ERR_ARG)); return -1;);
+
+  msg->msg_flags = 0;
+  msg->msg_controllen = 0;
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    int total = 0;
     for (i = 0; i < msg->msg_iovlen; i++) {
-      struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_REF);
-      if (p == NULL) {
-        err = ERR_MEM; /* let netbuf_delete() cleanup chain_buf */
+      int ret;
+      if (msg->msg_iov[i].iov_len == 0) {
+        continue;
+      }
+      ret = lwip_recvfrom(s, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len,
+                          (total > 0) ? (flags | MSG_DONTWAIT) : flags, NULL, NULL);
+      if (ret < 0) {
+        if (total > 0) {
+          /* already received data, return that */
+          break;
+        }
+        return -1;
+      }
+      total += ret;
+      if ((size_t)ret < msg->msg_iov[i].iov_len) {
         break;
       }
-      p->payload = msg->msg_iov[i].iov_base;
-      LWIP_ASSERT("iov_len < u16_t", msg->msg_iov[i].iov_len <= 0xFFFF);
-      p->len = p->tot_len = (u16_t)msg->msg_iov[i].iov_len;
-      /* netbuf empty, add new pbuf */
-      if (chain_buf->p == NULL) {
-        chain_buf->p = chain_buf->ptr = p;
-        /* add pbuf to existing pbuf chain */
-      } else {
-        pbuf_cat(chain_buf->p, p);
+    }
+    msg->msg_namelen = 0;
+    sock_set_errno(sock, 0);
+    return total;
+  }
+#if LWIP_UDP || LWIP_RAW
+  {
+    struct netbuf *buf;
+    struct pbuf *p;
+    u16_t copied = 0;
+    err_t err;
+
+    /* Check if there is data left from a previous MSG_PEEK */
+    buf = (struct netbuf *)sock->lastdata;
+    if (buf == NULL) {
+      /* If this is non-blocking call, then check first */
+      if (((flags & MSG_DONTWAIT) || netconn_is_nonblocking(sock->conn)) &&
+          (sock->rcvevent <= 0)) {
+        LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmsg(%d): returning EWOULDBLOCK\n", s));
+        set_errno(EWOULDBLOCK);
+        return -1;
+      }
+      err = netconn_recv(sock->conn, &buf);
+      if (err != ERR_OK) {
+        sock_set_errno(sock, err_to_errno(err));
+        return (err == ERR_CLSD) ? 0 : -1;
       }
+      sock->lastdata = buf;
     }
-    /* save size of total chain */
-    if (err == ERR_OK) {
-      size = netbuf_len(chain_buf);
+
+    p = buf->p;
+    for (i = 0; (i < msg->msg_iovlen) && (copied < p->tot_len); i++) {
+      u16_t copylen = p->tot_len - copied;
+      if (msg->msg_iov[i].iov_len < copylen) {
+        copylen = (u16_t)msg->msg_iov[i].iov_len;
+      }
+      pbuf_copy_partial(p, msg->msg_iov[i].iov_base, copylen, copied);
+      copied += copylen;
+    }
+    if (copied < p->tot_len) {
+      msg->msg_flags |= MSG_TRUNC;
     }
-#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
 
-    if (err == ERR_OK) {
+    if ((msg->msg_name != NULL) && (msg->msg_namelen > 0)) {
+      u16_t port = netbuf_fromport(buf);
+      ip_addr_t *fromaddr = netbuf_fromaddr(buf);
+      union sockaddr_aligned saddr;
 #if LWIP_IPV4 && LWIP_IPV6
-      /* Dual-stack: Unmap IPv4 mapped IPv6 addresses */
-      if (IP_IS_V6_VAL(chain_buf->addr) && ip6_addr_isipv4mappedipv6(ip_2_ip6(&chain_buf->addr))) {
-        unmap_ipv4_mapped_ipv6(ip_2_ip4(&chain_buf->addr), ip_2_ip6(&chain_buf->addr));
-        IP_SET_TYPE_VAL(chain_buf->addr, IPADDR_TYPE_V4);
+      /* Dual-stack: Map IPv4 addresses to IPv4 mapped IPv6 */
+      if (NETCONNTYPE_ISIPV6(netconn_type(sock->conn)) && IP_IS_V4(fromaddr)) {
+        ip4_2_ipv4_mapped_ipv6(ip_2_ip6(fromaddr), ip_2_ip4(fromaddr));
+        IP_SET_TYPE(fromaddr, IPADDR_TYPE_V6);
       }
 #endif /* LWIP_IPV4 && LWIP_IPV6 */
-
-      /* send the data */
-      err = netconn_send(sock->conn, chain_buf);
+      IPADDR_PORT_TO_SOCKADDR(&saddr, fromaddr, port);
+      if (msg->msg_namelen > saddr.sa.sa_len) {
+        msg->msg_namelen = saddr.sa.sa_len;
+      }
+      MEMCPY(msg->msg_name, &saddr, msg->msg_namelen);
     }
 
-    /* deallocated the buffer */
-    netbuf_delete(chain_buf);
-
-    sock_set_errno(sock, err_to_errno(err));
-    return (err == ERR_OK ? size : -1);
+    /* If we don't peek the incoming message, the datagram is consumed */
+    if ((flags & MSG_PEEK) == 0) {
+      sock->lastdata = NULL;
+      sock->lastoffset = 0;
+      netbuf_delete(buf);
+    }
+    sock_set_errno(sock, 0);
+    return copied;
   }
 #else /* LWIP_UDP || LWIP_RAW */
   sock_set_errno(sock, err_to_errno(ERR_ARG));
@@ -1118,6 +1423,37 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
 #endif /* LWIP_UDP || LWIP_RAW */
 }
 
+/**
+ * Receive up to vlen messages. Only the first message is waited for (unless
+ * the socket is non-blocking); the others are only taken if they have already
+ * arrived.
+ *
+ * @return number of messages received (msg_len is set for each of them), -1
+ *         if the first message could not be received
+ */
+int
+lwip_recvmmsg(int s, struct lwip_mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  unsigned int done;
+
+  if ((msgvec == NULL) && (vlen != 0)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  for (done = 0; done < vlen; done++) {
+    int ret = lwip_recvmsg(s, &msgvec[done].msg_hdr, (done > 0) ? (flags | MSG_DONTWAIT) : flags);
+    if (ret < 0) {
+      break;
+    }
+    msgvec[done].msg_len = (unsigned int)ret;
+  }
+  if (done > 0) {
+    set_errno(0);
+    return (int)done;
+  }
+  return -1;
+}
+
 int
 lwip_sendto(int s, const void *data, size_t size, int flags,
        const struct sockaddr *to, socklen_t tolen)
@@ -1288,6 +1624,21 @@ lwip_writev(int s, const struct iovec *iov, int iovcnt)
   return lwip_sendmsg(s, &msg, 0);
 }
 
+int
+lwip_readv(int s, const struct iovec *iov, int iovcnt)
+{
+  struct msghdr msg;
+
+  msg.msg_name = NULL;
+  msg.msg_namelen = 0;
+  msg.msg_iov = LWIP_CONST_CAST(struct iovec *, iov);
+  msg.msg_iovlen = iovcnt;
+  msg.msg_control = NULL;
+  msg.msg_controllen = 0;
+  msg.msg_flags = 0;
+  return lwip_recvmsg(s, &msg, 0);
+}
+
 /**
  * Go through the readset and writeset lists and see which socket of the sockets
  * set in the sets has events. On return, readset, writeset and exceptset have
@@ -1411,6 +1762,10 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
     select_cb.readset = readset;
     select_cb.writeset = writeset;
     select_cb.exceptset = exceptset;
+#if LWIP_SOCKET_POLL
+    select_cb.poll_fds = NULL;
+    select_cb.poll_nfds = 0;
+#endif /* LWIP_SOCKET_POLL */
     select_cb.sem_signalled = 0;
 #if LWIP_NETCONN_SEM_PER_THREAD
     select_cb.sem = LWIP_NETCONN_THREAD_SEM_GET();
@@ -1563,56 +1918,746 @@ return_copy_fdsets:
   return nready;
 }
 
+#if LWIP_SOCKET_POLL
+/** Options for the lwip_pollscan function. */
+enum lwip_pollscan_opts
+{
+  /** Clear revents in each struct pollfd. */
+  LWIP_POLLSCAN_CLEAR = 1,
+
+  /** Increment select_waiting in each struct lwip_sock. */
+  LWIP_POLLSCAN_INC_WAIT = 2,
+
+  /** Decrement select_waiting in each struct lwip_sock. */
+  LWIP_POLLSCAN_DEC_WAIT = 4
+};
+
 /**
- * Callback registered in the netconn layer for each socket-netconn.
- * Processes recvevent (data available) and wakes up tasks waiting for select.
+ * Go through the pollfds and update revents with the current state of each socket.
+ * Unlike lwip_selscan, this only visits the descriptors passed in, so its cost
+ * does not depend on the value of the largest descriptor.
+ *
+ * @param fds array of descriptors to check
+ * @param nfds number of descriptors in fds
+ * @param opts see enum lwip_pollscan_opts
+ * @return number of descriptors with a non-zero revents (>= 0)
  */
-static void
-event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
+static int
+lwip_pollscan(struct lwip_pollfd *fds, lwip_nfds_t nfds, enum lwip_pollscan_opts opts)
 {
-  int s;
+  int nready = 0;
+  lwip_nfds_t fdi;
   struct lwip_sock *sock;
-  struct lwip_select_cb *scb;
-  int last_select_cb_ctr;
   SYS_ARCH_DECL_PROTECT(lev);
 
-  LWIP_UNUSED_ARG(len);
+  for (fdi = 0; fdi < nfds; fdi++) {
+    if ((opts & LWIP_POLLSCAN_CLEAR) != 0) {
+      fds[fdi].revents = 0;
+    }
 
-  /* Get socket */
-  if (conn) {
-    s = conn->socket;
-    if (s < 0) {
-      /* Data comes in right away after an accept, even though
-       * the server task might not have created a new socket yet.
-       * Just count down (or up) if that's the case and we
-       * will use the data later. Note that only receive events
-       * can happen before the new socket is set up. */
+    /* Negative fd means the caller wants us to ignore this struct. */
+    if (fds[fdi].fd >= 0) {
       SYS_ARCH_PROTECT(lev);
-      if (conn->socket < 0) {
-        if (evt == NETCONN_EVT_RCVPLUS) {
-          conn->socket--;
+      sock = tryget_socket(fds[fdi].fd);
+      if (sock != NULL) {
+        void* lastdata = sock->lastdata;
+        s16_t rcvevent = sock->rcvevent;
+        u16_t sendevent = sock->sendevent;
+        u16_t errevent = sock->errevent;
+
+        if ((opts & LWIP_POLLSCAN_INC_WAIT) != 0) {
+          sock->select_waiting++;
+          LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
+        } else if ((opts & LWIP_POLLSCAN_DEC_WAIT) != 0) {
+          /* for now, handle select_waiting==0... */
+          LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
+          if (sock->select_waiting > 0) {
+            sock->select_waiting--;
+          }
         }
         SYS_ARCH_UNPROTECT(lev);
-        return;
+
+        /* See if netconn of this socket is ready for read */
+        if ((fds[fdi].events & (LWIP_POLLIN | LWIP_POLLRDNORM)) && ((lastdata != NULL) || (rcvevent > 0))) {
+          fds[fdi].revents |= fds[fdi].events & (LWIP_POLLIN | LWIP_POLLRDNORM);
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_pollscan: fd=%d ready for reading\n", fds[fdi].fd));
+        }
+        /* See if netconn of this socket is ready for write */
+        if ((fds[fdi].events & (LWIP_POLLOUT | LWIP_POLLWRNORM)) && (sendevent != 0)) {
+          fds[fdi].revents |= fds[fdi].events & (LWIP_POLLOUT | LWIP_POLLWRNORM);
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_pollscan: fd=%d ready for writing\n", fds[fdi].fd));
+        }
+        /* POLLERR is always reported, whether it was asked for or not */
+        if (errevent != 0) {
+          fds[fdi].revents |= LWIP_POLLERR;
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_pollscan: fd=%d ready for exception\n", fds[fdi].fd));
+        }
+      } else {
+        SYS_ARCH_UNPROTECT(lev);
+        /* Not a valid socket */
+        fds[fdi].revents |= LWIP_POLLNVAL;
       }
-      s = conn->socket;
-      SYS_ARCH_UNPROTECT(lev);
     }
 
-    sock = get_socket(s);
-    if (!sock) {
-      return;
+    /* Will return the number of structures that have events,
+       not the number of events. */
+    if (fds[fdi].revents != 0) {
+      nready++;
     }
-  } else {
-    return;
   }
 
-  SYS_ARCH_PROTECT(lev);
-  /* Set event as required */
-  switch (evt) {
-    case NETCONN_EVT_RCVPLUS:
-      sock->rcvevent++;
-      break;
+  LWIP_ASSERT("nready >= 0", nready >= 0);
+  return nready;
+}
+
+/**
+ * Check whether event_callback should wake up a thread waiting in
+ * lwip_poll for an event on socket s.
+ */
+static int
+lwip_poll_should_wake(const struct lwip_select_cb *scb, int s, struct lwip_sock *sock)
+{
+  lwip_nfds_t fdi;
+  for (fdi = 0; fdi < scb->poll_nfds; fdi++) {
+    const struct lwip_pollfd *pollfd = &scb->poll_fds[fdi];
+    if (pollfd->fd == s) {
+      if ((sock->rcvevent > 0) && (pollfd->events & (LWIP_POLLIN | LWIP_POLLRDNORM))) {
+        return 1;
+      }
+      if ((sock->sendevent != 0) && (pollfd->events & (LWIP_POLLOUT | LWIP_POLLWRNORM))) {
+        return 1;
+      }
+      if (sock->errevent != 0) {
+        /* POLLERR is always reported, whether it was asked for or not */
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * Wait for events on a set of sockets. This shares the wakeup mechanism of
+ * lwip_select (select_cb_list and the select_waiting counters), so a thread
+ * blocked here is woken by event_callback as soon as one of its sockets has
+ * an event it asked for.
+ *
+ * @param fds array of descriptors and the events to wait for
+ * @param nfds number of descriptors in fds
+ * @param timeout time to wait in milliseconds, 0 to return immediately,
+ *        negative to wait forever
+ * @return number of descriptors with a non-zero revents, 0 on timeout, -1 on error
+ */
+int
+lwip_poll(struct lwip_pollfd *fds, lwip_nfds_t nfds, int timeout)
+{
+  u32_t waitres = 0;
+  int nready;
+  u32_t msectimeout;
+  struct lwip_select_cb select_cb;
+#if LWIP_NETCONN_SEM_PER_THREAD
+  int waited = 0;
+#endif
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll(%p, %d, %d)\n",
+                  (void*)fds, (int)nfds, timeout));
+  if ((fds == NULL) && (nfds != 0)) {
+    set_errno(EFAULT);
+    return -1;
+  }
+
+  nready = lwip_pollscan(fds, nfds, LWIP_POLLSCAN_CLEAR);
+
+  /* If we don't have any current events, then suspend if we are supposed to */
+  if (!nready) {
+    if (timeout == 0) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll: no timeout, returning 0\n"));
+      goto return_success;
+    }
+
+    /* None ready: add our semaphore to list.
+       Our entry on the list is only valid while we are in this function. */
+    select_cb.next = NULL;
+    select_cb.prev = NULL;
+    select_cb.readset = NULL;
+    select_cb.writeset = NULL;
+    select_cb.exceptset = NULL;
+    select_cb.poll_fds = fds;
+    select_cb.poll_nfds = nfds;
+    select_cb.sem_signalled = 0;
+#if LWIP_NETCONN_SEM_PER_THREAD
+    select_cb.sem = LWIP_NETCONN_THREAD_SEM_GET();
+#else /* LWIP_NETCONN_SEM_PER_THREAD */
+    if (sys_sem_new(&select_cb.sem, 0) != ERR_OK) {
+      /* failed to create semaphore */
+      set_errno(ENOMEM);
+      return -1;
+    }
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+    /* Protect the select_cb_list */
+    SYS_ARCH_PROTECT(lev);
+
+    /* Put this select_cb on top of list */
+    select_cb.next = select_cb_list;
+    if (select_cb_list != NULL) {
+      select_cb_list->prev = &select_cb;
+    }
+    select_cb_list = &select_cb;
+    /* Increasing this counter tells event_callback that the list has changed. */
+    select_cb_ctr++;
+
+    /* Now we can safely unprotect */
+    SYS_ARCH_UNPROTECT(lev);
+
+    /* Increase select_waiting for each socket we are interested in.
+       Also, check for events again: there could have been events between
+       the last scan (without us on the list) and putting us on the list! */
+    nready = lwip_pollscan(fds, nfds, LWIP_POLLSCAN_INC_WAIT);
+
+    if (!nready) {
+      /* Still none ready, just wait to be woken */
+      if (timeout < 0) {
+        /* Wait forever */
+        msectimeout = 0;
+      } else {
+        msectimeout = (u32_t)timeout;
+      }
+
+      waitres = sys_arch_sem_wait(SELECT_SEM_PTR(select_cb.sem), msectimeout);
+#if LWIP_NETCONN_SEM_PER_THREAD
+      waited = 1;
+#endif
+    }
+
+    /* Decrease select_waiting for each socket we are interested in,
+       and check which events occurred while we waited. */
+    nready = lwip_pollscan(fds, nfds, LWIP_POLLSCAN_DEC_WAIT);
+
+    /* Take us off the list */
+    SYS_ARCH_PROTECT(lev);
+    if (select_cb.next != NULL) {
+      select_cb.next->prev = select_cb.prev;
+    }
+    if (select_cb_list == &select_cb) {
+      LWIP_ASSERT("select_cb.prev == NULL", select_cb.prev == NULL);
+      select_cb_list = select_cb.next;
+    } else {
+      LWIP_ASSERT("select_cb.prev != NULL", select_cb.prev != NULL);
+      select_cb.prev->next = select_cb.next;
+    }
+    /* Increasing this counter tells event_callback that the list has changed. */
+    select_cb_ctr++;
+    SYS_ARCH_UNPROTECT(lev);
+
+#if LWIP_NETCONN_SEM_PER_THREAD
+    if (select_cb.sem_signalled && (!waited || (waitres == SYS_ARCH_TIMEOUT))) {
+      /* don't leave the thread-local semaphore signalled */
+      sys_arch_sem_wait(select_cb.sem, 1);
+    }
+#else /* LWIP_NETCONN_SEM_PER_THREAD */
+    sys_sem_free(&select_cb.sem);
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+    if (waitres == SYS_ARCH_TIMEOUT) {
+      /* Timeout */
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll: timeout expired\n"));
+    }
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll: nready=%d\n", nready));
+return_success:
+  set_errno(0);
+  return nready;
+}
+#endif /* LWIP_SOCKET_POLL */
+
+#if LWIP_SOCKET_EPOLL
+/** Events an epoll entry always reports, whether they were asked for or not */
+#define LWIP_EPOLL_ALWAYS (LWIP_EPOLLERR | LWIP_EPOLLHUP)
+
+/**
+ * Map an epoll descriptor to its instance.
+ * Sets errno and returns NULL if epfd is not an open epoll instance.
+ */
+static struct lwip_epoll *
+get_epoll(int epfd)
+{
+  int i = epfd - LWIP_EPOLL_OFFSET;
+  if ((i < 0) || (i >= LWIP_SOCKET_EPOLL_MAX) || !epolls[i].used) {
+    set_errno(EBADF);
+    return NULL;
+  }
+  return &epolls[i];
+}
+
+/** Current readiness of a socket. Call with SYS_ARCH protected. */
+static u32_t
+lwip_epoll_sock_state(struct lwip_sock *sock)
+{
+  u32_t ev = 0;
+  if ((sock->lastdata != NULL) || (sock->rcvevent > 0)) {
+    ev |= LWIP_EPOLLIN;
+  }
+  if (sock->sendevent != 0) {
+    ev |= LWIP_EPOLLOUT;
+  }
+  if (sock->errevent != 0) {
+    ev |= LWIP_EPOLLERR;
+  }
+  return ev;
+}
+
+/** Events of item which are currently pending. Call with SYS_ARCH protected. */
+static u32_t
+lwip_epitem_pending(struct lwip_epitem *item)
+{
+  if (item->disabled) {
+    return 0;
+  }
+  return lwip_epoll_sock_state(item->sock) & (item->events | LWIP_EPOLL_ALWAYS);
+}
+
+/** Append item to the ready list of its epoll instance and wake up a waiter.
+    Call with SYS_ARCH protected. */
+static void
+lwip_epitem_make_ready(struct lwip_epitem *item)
+{
+  struct lwip_epoll *ep = item->ep;
+  if (item->ready) {
+    return;
+  }
+  item->ready = 1;
+  item->rdl_next = NULL;
+  item->rdl_prev = ep->rdl_tail;
+  if (ep->rdl_tail != NULL) {
+    ep->rdl_tail->rdl_next = item;
+  } else {
+    ep->rdl_head = item;
+  }
+  ep->rdl_tail = item;
+  if (ep->waiting > 0) {
+    sys_sem_signal(&ep->sem);
+  }
+}
+
+/** Take item off the ready list. Call with SYS_ARCH protected. */
+static void
+lwip_epitem_unready(struct lwip_epitem *item)
+{
+  struct lwip_epoll *ep = item->ep;
+  if (!item->ready) {
+    return;
+  }
+  if (item->rdl_prev != NULL) {
+    item->rdl_prev->rdl_next = item->rdl_next;
+  } else {
+    ep->rdl_head = item->rdl_next;
+  }
+  if (item->rdl_next != NULL) {
+    item->rdl_next->rdl_prev = item->rdl_prev;
+  } else {
+    ep->rdl_tail = item->rdl_prev;
+  }
+  item->rdl_next = item->rdl_prev = NULL;
+  item->ready = 0;
+}
+
+/** Unlink item from the entry lists of its socket and its epoll instance.
+    Call with SYS_ARCH protected. */
+static void
+lwip_epitem_unlink(struct lwip_epitem *item)
+{
+  struct lwip_epitem **pp;
+  lwip_epitem_unready(item);
+  for (pp = &item->sock->epitems; *pp != NULL; pp = &(*pp)->sock_next) {
+    if (*pp == item) {
+      *pp = item->sock_next;
+      break;
+    }
+  }
+  for (pp = &item->ep->items; *pp != NULL; pp = &(*pp)->ep_next) {
+    if (*pp == item) {
+      *pp = item->ep_next;
+      break;
+    }
+  }
+}
+
+/** Called from event_callback: queue all entries of sock which now have events.
+    Call with SYS_ARCH protected. */
+static void
+lwip_epoll_sock_event(struct lwip_sock *sock)
+{
+  struct lwip_epitem *item;
+  for (item = sock->epitems; item != NULL; item = item->sock_next) {
+    if (lwip_epitem_pending(item)) {
+      lwip_epitem_make_ready(item);
+    }
+  }
+}
+
+/** Remove sock from all interest sets (it is being closed) */
+static void
+lwip_epoll_drop_socket(struct lwip_sock *sock)
+{
+  struct lwip_epitem *item, *dead = NULL;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  while ((item = sock->epitems) != NULL) {
+    lwip_epitem_unlink(item);
+    item->sock_next = dead;
+    dead = item;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  while ((item = dead) != NULL) {
+    dead = item->sock_next;
+    mem_free(item);
+  }
+}
+
+/**
+ * Create an epoll instance.
+ *
+ * @param size ignored (as on Linux), but must be greater than zero
+ * @return descriptor of the new instance, -1 on error
+ */
+int
+lwip_epoll_create(int size)
+{
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (size <= 0) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  for (i = 0; i < LWIP_SOCKET_EPOLL_MAX; i++) {
+    SYS_ARCH_PROTECT(lev);
+    if (!epolls[i].used) {
+      epolls[i].used = 1;
+      SYS_ARCH_UNPROTECT(lev);
+      epolls[i].waiting = 0;
+      epolls[i].items = NULL;
+      epolls[i].rdl_head = NULL;
+      epolls[i].rdl_tail = NULL;
+      if (sys_sem_new(&epolls[i].sem, 0) != ERR_OK) {
+        SYS_ARCH_SET(epolls[i].used, 0);
+        set_errno(ENOMEM);
+        return -1;
+      }
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_create() = %d\n", i + LWIP_EPOLL_OFFSET));
+      set_errno(0);
+      return i + LWIP_EPOLL_OFFSET;
+    }
+    SYS_ARCH_UNPROTECT(lev);
+  }
+  set_errno(EMFILE);
+  return -1;
+}
+
+/** Close an epoll instance, called from lwip_close */
+static int
+lwip_epoll_close(int epfd)
+{
+  struct lwip_epoll *ep;
+  struct lwip_epitem *item, *dead = NULL;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_close(%d)\n", epfd));
+  SYS_ARCH_PROTECT(lev);
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    SYS_ARCH_UNPROTECT(lev);
+    return -1;
+  }
+  if (ep->waiting > 0) {
+    /* the semaphore is still in use */
+    SYS_ARCH_UNPROTECT(lev);
+    set_errno(EBUSY);
+    return -1;
+  }
+  while ((item = ep->items) != NULL) {
+    lwip_epitem_unlink(item);
+    item->ep_next = dead;
+    dead = item;
+  }
+  ep->used = 0;
+  SYS_ARCH_UNPROTECT(lev);
+
+  sys_sem_free(&ep->sem);
+  while ((item = dead) != NULL) {
+    dead = item->ep_next;
+    mem_free(item);
+  }
+  set_errno(0);
+  return 0;
+}
+
+/**
+ * Add, modify or remove a socket in the interest set of an epoll instance.
+ *
+ * @param epfd epoll instance
+ * @param op LWIP_EPOLL_CTL_ADD, LWIP_EPOLL_CTL_MOD or LWIP_EPOLL_CTL_DEL
+ * @param fd socket to watch
+ * @param event events to watch for (LWIP_EPOLLIN, LWIP_EPOLLOUT, optionally
+ *        LWIP_EPOLLET and LWIP_EPOLLONESHOT) and data to report with them;
+ *        may be NULL for LWIP_EPOLL_CTL_DEL
+ * @return 0 on success, -1 on error
+ */
+int
+lwip_epoll_ctl(int epfd, int op, int fd, struct lwip_epoll_event *event)
+{
+  struct lwip_epoll *ep;
+  struct lwip_sock *sock;
+  struct lwip_epitem *item, *newitem = NULL;
+  int err = 0;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_ctl(%d, %d, %d)\n", epfd, op, fd));
+  if ((op != LWIP_EPOLL_CTL_ADD) && (op != LWIP_EPOLL_CTL_MOD) && (op != LWIP_EPOLL_CTL_DEL)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  if ((op != LWIP_EPOLL_CTL_DEL) && (event == NULL)) {
+    set_errno(EFAULT);
+    return -1;
+  }
+  if (op == LWIP_EPOLL_CTL_ADD) {
+    /* allocate before taking the lock, it is freed again if not needed */
+    newitem = (struct lwip_epitem *)mem_malloc(sizeof(struct lwip_epitem));
+    if (newitem == NULL) {
+      set_errno(ENOMEM);
+      return -1;
+    }
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  ep = get_epoll(epfd);
+  sock = get_socket(fd);
+  if ((ep == NULL) || (sock == NULL)) {
+    SYS_ARCH_UNPROTECT(lev);
+    if (newitem != NULL) {
+      mem_free(newitem);
+    }
+    return -1;
+  }
+  for (item = sock->epitems; item != NULL; item = item->sock_next) {
+    if (item->ep == ep) {
+      break;
+    }
+  }
+  switch (op) {
+    case LWIP_EPOLL_CTL_ADD:
+      if (item != NULL) {
+        err = EEXIST;
+        break;
+      }
+      item = newitem;
+      newitem = NULL;
+      memset(item, 0, sizeof(struct lwip_epitem));
+      item->ep = ep;
+      item->sock = sock;
+      item->events = event->events;
+      item->data = event->data;
+      item->sock_next = sock->epitems;
+      sock->epitems = item;
+      item->ep_next = ep->items;
+      ep->items = item;
+      if (lwip_epitem_pending(item)) {
+        lwip_epitem_make_ready(item);
+      }
+      break;
+    case LWIP_EPOLL_CTL_MOD:
+      if (item == NULL) {
+        err = ENOENT;
+        break;
+      }
+      item->events = event->events;
+      item->data = event->data;
+      item->disabled = 0;
+      if (lwip_epitem_pending(item)) {
+        lwip_epitem_make_ready(item);
+      }
+      break;
+    default: /* LWIP_EPOLL_CTL_DEL */
+      if (item == NULL) {
+        err = ENOENT;
+        break;
+      }
+      lwip_epitem_unlink(item);
+      /* reuse newitem to free it below, outside of the lock */
+      newitem = item;
+      break;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  if (newitem != NULL) {
+    mem_free(newitem);
+  }
+  set_errno(err);
+  return err ? -1 : 0;
+}
+
+/**
+ * Move pending events from the ready list of ep into events.
+ * Call with SYS_ARCH protected.
+ *
+ * Level-triggered entries stay ready and are moved to the end of the list so
+ * that they do not starve other entries. Edge-triggered and one-shot entries
+ * are dropped from the list until event_callback (or lwip_epoll_ctl) queues them again.
+ */
+static int
+lwip_epoll_collect(struct lwip_epoll *ep, struct lwip_epoll_event *events, int maxevents)
+{
+  struct lwip_epitem *item, *next;
+  struct lwip_epitem *lt_head = NULL, *lt_tail = NULL;
+  int n = 0;
+
+  for (item = ep->rdl_head; (item != NULL) && (n < maxevents); item = next) {
+    u32_t pending = lwip_epitem_pending(item);
+    next = item->rdl_next;
+    lwip_epitem_unready(item);
+    if (pending == 0) {
+      /* events were consumed since the entry was queued */
+      continue;
+    }
+    events[n].events = pending;
+    events[n].data = item->data;
+    n++;
+    if (item->events & LWIP_EPOLLONESHOT) {
+      item->disabled = 1;
+    } else if (!(item->events & LWIP_EPOLLET)) {
+      /* level-triggered: requeue below */
+      item->rdl_next = NULL;
+      if (lt_tail != NULL) {
+        lt_tail->rdl_next = item;
+      } else {
+        lt_head = item;
+      }
+      lt_tail = item;
+    }
+  }
+  for (item = lt_head; item != NULL; item = next) {
+    next = item->rdl_next;
+    lwip_epitem_make_ready(item);
+  }
+  return n;
+}
+
+/**
+ * Wait for events on the interest set of an epoll instance. Only entries on
+ * the ready list are examined, so the cost does not depend on the number of
+ * sockets being watched.
+ *
+ * @param epfd epoll instance
+ * @param events array receiving the events
+ * @param maxevents size of events (> 0)
+ * @param timeout time to wait in milliseconds, 0 to return immediately,
+ *        negative to wait forever
+ * @return number of events stored in events, 0 on timeout, -1 on error
+ */
+int
+lwip_epoll_wait(int epfd, struct lwip_epoll_event *events, int maxevents, int timeout)
+{
+  struct lwip_epoll *ep;
+  u32_t start, elapsed, msectimeout;
+  int n;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if ((events == NULL) || (maxevents <= 0)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  start = sys_now();
+
+  SYS_ARCH_PROTECT(lev);
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    SYS_ARCH_UNPROTECT(lev);
+    return -1;
+  }
+  for (;;) {
+    n = lwip_epoll_collect(ep, events, maxevents);
+    if ((n > 0) || (timeout == 0)) {
+      break;
+    }
+    if (timeout > 0) {
+      elapsed = sys_now() - start;
+      if (elapsed >= (u32_t)timeout) {
+        break;
+      }
+      msectimeout = (u32_t)timeout - elapsed;
+    } else {
+      /* wait forever */
+      msectimeout = 0;
+    }
+    ep->waiting++;
+    SYS_ARCH_UNPROTECT(lev);
+    sys_arch_sem_wait(&ep->sem, msectimeout);
+    SYS_ARCH_PROTECT(lev);
+    ep->waiting--;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_wait(%d): n=%d\n", epfd, n));
+  set_errno(0);
+  return n;
+}
+#endif /* LWIP_SOCKET_EPOLL */
+
+/**
+ * Callback registered in the netconn layer for each socket-netconn.
+ * Processes recvevent (data available) and wakes up tasks waiting for select.
+ */
+static void
+event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
+{
+  int s;
+  struct lwip_sock *sock;
+  struct lwip_select_cb *scb;
+  int last_select_cb_ctr;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_UNUSED_ARG(len);
+
+  /* Get socket */
+  if (conn) {
+    s = conn->socket;
+    if (s < 0) {
+      /* Data comes in right away after an accept, even though
+       * the server task might not have created a new socket yet.
+       * Just count down (or up) if that's the case and we
+       * will use the data later. Note that only receive events
+       * can happen before the new socket is set up. */
+      SYS_ARCH_PROTECT(lev);
+      if (conn->socket < 0) {
+        if (evt == NETCONN_EVT_RCVPLUS) {
+          conn->socket--;
+        }
+        SYS_ARCH_UNPROTECT(lev);
+        return;
+      }
+      s = conn->socket;
+      SYS_ARCH_UNPROTECT(lev);
+    }
+
+    sock = get_socket(s);
+    if (!sock) {
+      return;
+    }
+  } else {
+    return;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  /* Set event as required */
+  switch (evt) {
+    case NETCONN_EVT_RCVPLUS:
+      sock->rcvevent++;
+      break;
     case NETCONN_EVT_RCVMINUS:
       sock->rcvevent--;
       break;
@@ -1630,6 +2675,13 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
       break;
   }
 
+#if LWIP_SOCKET_EPOLL
+  /* only events that add readiness can make an epoll entry ready */
+  if ((sock->epitems != NULL) && (evt != NETCONN_EVT_RCVMINUS) && (evt != NETCONN_EVT_SENDMINUS)) {
+    lwip_epoll_sock_event(sock);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
+
   if (sock->select_waiting == 0) {
     /* noone is waiting for this socket, no need to check select_cb_list */
     SYS_ARCH_UNPROTECT(lev);
@@ -1649,6 +2701,11 @@ again:
     if (scb->sem_signalled == 0) {
       /* semaphore not signalled yet */
       int do_signal = 0;
+#if LWIP_SOCKET_POLL
+      if (scb->poll_fds != NULL) {
+        do_signal = lwip_poll_should_wake(scb, s, sock);
+      }
+#endif /* LWIP_SOCKET_POLL */
       /* Test this select call for our socket */
       if (sock->rcvevent > 0) {
         if (scb->readset && FD_ISSET(s, scb->readset)) {
@@ -10,7 +10,7 @@
  * \#define LWIP_CHKSUM your_checksum_routine
  * 
  * Or you can select from the implementations below by defining
- * LWIP_CHKSUM_ALGORITHM to 1, 2 or 3.
+ * LWIP_CHKSUM_ALGORITHM to 1, 2, 3 or 4.
  */
 
 /*
@@ -53,6 +53,16 @@
 
 #include <string.h>
 
+#if (LWIP_CHKSUM_ALGORITHM == 4) && defined(__GNUC__)
+#if defined(__SSE2__)
+#define LWIP_CHKSUM_SSE2 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LWIP_CHKSUM_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
 #ifndef LWIP_CHKSUM
 # define LWIP_CHKSUM lwip_standard_chksum
 # ifndef LWIP_CHKSUM_ALGORITHM
@@ -255,6 +265,278 @@ lwip_standard_chksum(const void *dataptr, int len)
 }
 #endif
 
+#if (LWIP_CHKSUM_ALGORITHM == 4) /* SIMD version #4 */
+/*
+ * SSE2/AVX2 (x86) or NEON (ARM) checksum, picked on first use from what the
+ * CPU supports, with a portable fallback. Bytes are paired from the start of
+ * the buffer and summed as host order 16-bit words in 64-bit accumulators;
+ * folding that sum gives the same result as versions #1 to #3.
+ */
+
+/** The copying and plain variants of each routine share one body, a NULL
+ * destination is a constant after inlining so the plain ones lose the stores */
+#define LWIP_CHKSUM_INLINE inline __attribute__((always_inline))
+
+/** Number of vector blocks summed into 32-bit lanes before they are widened,
+ * each block adds at most 2 * 0xffff to a lane */
+#define CHKSUM_FLUSH_BLOCKS 16384
+
+typedef u16_t (*chksum_fn)(const void *dataptr, int len);
+
+typedef u16_t (*chksum_copy_fn)(void *dst, const void *src, int len);
+
+/** Add the host order 16-bit words of a buffer, a trailing odd byte is padded
+ * with zero. The bytes are also copied to dst unless it is NULL. */
+static LWIP_CHKSUM_INLINE uint64_t
+chksum_words(u8_t *dst, const u8_t *pb, int len, uint64_t sum)
+{
+  u32_t w32;
+  u16_t w = 0;
+
+  if (dst != NULL) {
+    MEMCPY(dst, pb, len);
+  }
+  while (len > 3) {
+    MEMCPY(&w32, pb, sizeof(w32));
+    sum += w32;
+    pb += 4;
+    len -= 4;
+  }
+  if (len > 1) {
+    MEMCPY(&w, pb, sizeof(w));
+    sum += w;
+    pb += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    w = 0;
+    ((u8_t *)&w)[0] = *pb;
+    sum += w;
+  }
+  return sum;
+}
+
+/** Fold a 64-bit sum to 16 bits (0 only if all summed words were 0) */
+static u16_t
+chksum_fold(uint64_t sum)
+{
+  u32_t sum32;
+
+  sum = (sum >> 32) + (sum & 0xffffffffUL);
+  sum = (sum >> 32) + (sum & 0xffffffffUL);
+  sum32 = (u32_t)sum;
+  sum32 = FOLD_U32T(sum32);
+  sum32 = FOLD_U32T(sum32);
+  return (u16_t)sum32;
+}
+
+static u16_t
+chksum_scalar(const void *dataptr, int len)
+{
+  return chksum_fold(chksum_words(NULL, (const u8_t *)dataptr, len, 0));
+}
+
+static u16_t
+chksum_copy_scalar(void *dst, const void *src, int len)
+{
+  return chksum_fold(chksum_words((u8_t *)dst, (const u8_t *)src, len, 0));
+}
+
+#if LWIP_CHKSUM_SSE2
+static LWIP_CHKSUM_INLINE u16_t
+chksum_sse2_body(u8_t *dst, const void *dataptr, int len)
+{
+  const u8_t *pb = (const u8_t *)dataptr;
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t sum = 0;
+  uint64_t lanes[2];
+
+  while (len >= 32) {
+    __m128i acc0 = zero, acc1 = zero, acc;
+    int blocks = 0;
+    for (; (len >= 32) && (blocks < CHKSUM_FLUSH_BLOCKS); blocks++) {
+      __m128i v0 = _mm_loadu_si128((const __m128i *)(const void *)pb);
+      __m128i v1 = _mm_loadu_si128((const __m128i *)(const void *)(pb + 16));
+      if (dst != NULL) {
+        _mm_storeu_si128((__m128i *)(void *)dst, v0);
+        _mm_storeu_si128((__m128i *)(void *)(dst + 16), v1);
+        dst += 32;
+      }
+      acc0 = _mm_add_epi32(acc0, _mm_add_epi32(_mm_unpacklo_epi16(v0, zero), _mm_unpackhi_epi16(v0, zero)));
+      acc1 = _mm_add_epi32(acc1, _mm_add_epi32(_mm_unpacklo_epi16(v1, zero), _mm_unpackhi_epi16(v1, zero)));
+      pb += 32;
+      len -= 32;
+    }
+    /* widen to 64-bit lanes, each 32-bit lane is below 2^31 here */
+    acc = _mm_add_epi64(_mm_add_epi64(_mm_unpacklo_epi32(acc0, zero), _mm_unpackhi_epi32(acc0, zero)),
+                        _mm_add_epi64(_mm_unpacklo_epi32(acc1, zero), _mm_unpackhi_epi32(acc1, zero)));
+    _mm_storeu_si128((__m128i *)(void *)lanes, acc);
+    sum += lanes[0] + lanes[1];
+  }
+  return chksum_fold(chksum_words(dst, pb, len, sum));
+}
+
+static u16_t
+chksum_sse2(const void *dataptr, int len)
+{
+  return chksum_sse2_body(NULL, dataptr, len);
+}
+
+static u16_t
+chksum_copy_sse2(void *dst, const void *src, int len)
+{
+  return chksum_sse2_body((u8_t *)dst, src, len);
+}
+
+__attribute__((target("avx2")))
+static LWIP_CHKSUM_INLINE u16_t
+chksum_avx2_body(u8_t *dst, const void *dataptr, int len)
+{
+  const u8_t *pb = (const u8_t *)dataptr;
+  const __m256i zero = _mm256_setzero_si256();
+  uint64_t sum = 0;
+  uint64_t lanes[4];
+
+  while (len >= 64) {
+    __m256i acc0 = zero, acc1 = zero, acc;
+    int blocks = 0;
+    for (; (len >= 64) && (blocks < CHKSUM_FLUSH_BLOCKS); blocks++) {
+      __m256i v0 = _mm256_loadu_si256((const __m256i *)(const void *)pb);
+      __m256i v1 = _mm256_loadu_si256((const __m256i *)(const void *)(pb + 32));
+      if (dst != NULL) {
+        _mm256_storeu_si256((__m256i *)(void *)dst, v0);
+        _mm256_storeu_si256((__m256i *)(void *)(dst + 32), v1);
+        dst += 64;
+      }
+      acc0 = _mm256_add_epi32(acc0, _mm256_add_epi32(_mm256_unpacklo_epi16(v0, zero), _mm256_unpackhi_epi16(v0, zero)));
+      acc1 = _mm256_add_epi32(acc1, _mm256_add_epi32(_mm256_unpacklo_epi16(v1, zero), _mm256_unpackhi_epi16(v1, zero)));
+      pb += 64;
+      len -= 64;
+    }
+    acc = _mm256_add_epi64(_mm256_add_epi64(_mm256_unpacklo_epi32(acc0, zero), _mm256_unpackhi_epi32(acc0, zero)),
+                           _mm256_add_epi64(_mm256_unpacklo_epi32(acc1, zero), _mm256_unpackhi_epi32(acc1, zero)));
+    _mm256_storeu_si256((__m256i *)(void *)lanes, acc);
+    sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  return chksum_fold(chksum_words(dst, pb, len, sum));
+}
+
+__attribute__((target("avx2")))
+static u16_t
+chksum_avx2(const void *dataptr, int len)
+{
+  return chksum_avx2_body(NULL, dataptr, len);
+}
+
+__attribute__((target("avx2")))
+static u16_t
+chksum_copy_avx2(void *dst, const void *src, int len)
+{
+  return chksum_avx2_body((u8_t *)dst, src, len);
+}
+#endif /* LWIP_CHKSUM_SSE2 */
+
+#if LWIP_CHKSUM_NEON
+static LWIP_CHKSUM_INLINE u16_t
+chksum_neon_body(u8_t *dst, const void *dataptr, int len)
+{
+  const u8_t *pb = (const u8_t *)dataptr;
+  uint64_t sum = 0;
+
+  while (len >= 32) {
+    uint32x4_t acc0 = vdupq_n_u32(0), acc1 = vdupq_n_u32(0);
+    uint64x2_t acc;
+    int blocks = 0;
+    for (; (len >= 32) && (blocks < CHKSUM_FLUSH_BLOCKS); blocks++) {
+      uint8x16_t v0 = vld1q_u8(pb);
+      uint8x16_t v1 = vld1q_u8(pb + 16);
+      if (dst != NULL) {
+        vst1q_u8(dst, v0);
+        vst1q_u8(dst + 16, v1);
+        dst += 32;
+      }
+      acc0 = vpadalq_u16(acc0, vreinterpretq_u16_u8(v0));
+      acc1 = vpadalq_u16(acc1, vreinterpretq_u16_u8(v1));
+      pb += 32;
+      len -= 32;
+    }
+    acc = vaddq_u64(vpaddlq_u32(acc0), vpaddlq_u32(acc1));
+    sum += vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+  }
+  return chksum_fold(chksum_words(dst, pb, len, sum));
+}
+
+static u16_t
+chksum_neon(const void *dataptr, int len)
+{
+  return chksum_neon_body(NULL, dataptr, len);
+}
+
+static u16_t
+chksum_copy_neon(void *dst, const void *src, int len)
+{
+  return chksum_neon_body((u8_t *)dst, src, len);
+}
+#endif /* LWIP_CHKSUM_NEON */
+
+static u16_t chksum_select(const void *dataptr, int len);
+static u16_t chksum_copy_select(void *dst, const void *src, int len);
+
+/** Implementations in use, chosen by chksum_pick() on the first call. Racing
+ * first calls all store the same pointers. */
+static chksum_fn chksum_impl = chksum_select;
+static chksum_copy_fn chksum_copy_impl = chksum_copy_select;
+
+static void
+chksum_pick(void)
+{
+  chksum_fn impl = chksum_scalar;
+  chksum_copy_fn copy_impl = chksum_copy_scalar;
+#if LWIP_CHKSUM_SSE2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    impl = chksum_avx2;
+    copy_impl = chksum_copy_avx2;
+  } else {
+    impl = chksum_sse2;
+    copy_impl = chksum_copy_sse2;
+  }
+#elif LWIP_CHKSUM_NEON
+  impl = chksum_neon;
+  copy_impl = chksum_copy_neon;
+#endif
+  chksum_impl = impl;
+  chksum_copy_impl = copy_impl;
+}
+
+static u16_t
+chksum_select(const void *dataptr, int len)
+{
+  chksum_pick();
+  return chksum_impl(dataptr, len);
+}
+
+static u16_t
+chksum_copy_select(void *dst, const void *src, int len)
+{
+  chksum_pick();
+  return chksum_copy_impl(dst, src, len);
+}
+
+/**
+ * lwip checksum
+ *
+ * @param dataptr points to start of data to be summed at any boundary
+ * @param len length of data to be summed
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
+ */
+u16_t
+lwip_standard_chksum(const void *dataptr, int len)
+{
+  return chksum_impl(dataptr, len);
+}
+#endif
+
 /** Parts of the pseudo checksum which are common to IPv4 and IPv6 */
 static u16_t
 inet_cksum_pseudo_base(struct pbuf *p, u8_t proto, u16_t proto_len, u32_t acc)
@@ -607,3 +889,14 @@ lwip_chksum_copy(void *dst, const void *src, u16_t len)
   return LWIP_CHKSUM(dst, len);
 }
 #endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 1) */
+
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2) && (LWIP_CHKSUM_ALGORITHM == 4) /* Version #2 */
+/** Copies and sums in a single pass over the source with the routine picked
+ * for LWIP_CHKSUM_ALGORITHM 4, each block is summed while it is in registers.
+ */
+u16_t
+lwip_chksum_copy(void *dst, const void *src, u16_t len)
+{
+  return chksum_copy_impl(dst, src, len);
+}
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) */
@@ -155,6 +155,9 @@ PACK_STRUCT_END
   #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h (or enable window scaling)"
 #endif
 #endif /* LWIP_WND_SCALE */
+#if (LWIP_TCP && LWIP_TCP_SACK && !TCP_QUEUE_OOSEQ)
+  #error "LWIP_TCP_SACK needs TCP_QUEUE_OOSEQ to hold the data it reports"
+#endif
 #if (LWIP_TCP && (TCP_SND_QUEUELEN > 0xffff))
   #error "If you want to use TCP, TCP_SND_QUEUELEN must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
@@ -294,6 +297,9 @@ PACK_STRUCT_END
 #error "LWIP_HOOK_MEMP_AVAILABLE doesn't make sense with MEMP_MEM_MALLOC"
 #endif
 #endif /* MEMP_MEM_MALLOC */
+#if MEMP_MEM_SLAB && (!MEMP_MEM_MALLOC || MEMP_OVERFLOW_CHECK)
+#error "MEMP_MEM_SLAB needs MEMP_MEM_MALLOC and cannot be used with MEMP_OVERFLOW_CHECK"
+#endif
 
 /* TCP sanity checks */
 #if !LWIP_DISABLE_TCP_SANITY_CHECKS
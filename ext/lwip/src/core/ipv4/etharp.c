@@ -101,14 +101,35 @@ struct etharp_entry {
   struct eth_addr ethaddr;
   u16_t ctime;
   u8_t state;
+#if LWIP_NEIGHBOR_HASH
+  /* links are index + 1, 0 terminates */
+  /** next entry in the same hash bucket, or on the free list */
+  u16_t hnext;
+  /** neighbours in least-recently-used order */
+  u16_t lru_prev;
+  u16_t lru_next;
+#endif /* LWIP_NEIGHBOR_HASH */
 };
 
 static struct etharp_entry arp_table[ARP_TABLE_SIZE];
 
 #if !LWIP_NETIF_HWADDRHINT
-static u8_t etharp_cached_entry;
+static u16_t etharp_cached_entry;
 #endif /* !LWIP_NETIF_HWADDRHINT */
 
+#if LWIP_NEIGHBOR_HASH
+/** hash buckets by IP address (index + 1 of the first entry) */
+static u16_t arp_hash[LWIP_NEIGHBOR_HASH_SIZE];
+/** most and least recently used entries (index + 1) */
+static u16_t arp_lru_head, arp_lru_tail;
+/** entries freed after use (index + 1), chained through hnext */
+static u16_t arp_free;
+/** entries [arp_unused, ARP_TABLE_SIZE) have never been used */
+static u16_t arp_unused;
+
+#define ETHARP_HASH(ipaddr) etharp_hash(ip4_addr_get_u32(ipaddr))
+#endif /* LWIP_NEIGHBOR_HASH */
+
 /** Try hard to create a new entry - we want the IP address to appear in
     the cache (even if this means removing an active entry or so). */
 #define ETHARP_FLAG_TRY_HARD     1
@@ -126,8 +147,11 @@ static u8_t etharp_cached_entry;
 
 
 /* Some checks, instead of etharp_init(): */
-#if (LWIP_ARP && (ARP_TABLE_SIZE > 0x7f))
-  #error "ARP_TABLE_SIZE must fit in an s8_t, you have to reduce it in your lwipopts.h"
+#if (LWIP_ARP && (ARP_TABLE_SIZE > 0x7fff))
+  #error "ARP_TABLE_SIZE must fit in an s16_t, you have to reduce it in your lwipopts.h"
+#endif
+#if (LWIP_ARP && LWIP_NEIGHBOR_HASH && (LWIP_NEIGHBOR_HASH_SIZE & (LWIP_NEIGHBOR_HASH_SIZE - 1)))
+  #error "LWIP_NEIGHBOR_HASH_SIZE must be a power of two"
 #endif
 
 
@@ -165,10 +189,108 @@ free_etharp_q(struct etharp_q_entry *q)
 
 #endif /* ARP_QUEUEING */
 
+#if LWIP_NEIGHBOR_HASH
+static u16_t
+etharp_hash(u32_t addr)
+{
+  addr ^= addr >> 16;
+  addr *= 0x45d9f3b;
+  addr ^= addr >> 16;
+  return (u16_t)(addr & (LWIP_NEIGHBOR_HASH_SIZE - 1));
+}
+
+/** Move an entry to the most recently used end of the LRU list */
+static void
+etharp_lru_touch(s16_t i)
+{
+  u16_t link = (u16_t)(i + 1);
+  if (arp_lru_head == link) {
+    return;
+  }
+  /* unlink (not linked yet if both are 0 and it is not the only entry) */
+  if (arp_table[i].lru_prev != 0) {
+    arp_table[arp_table[i].lru_prev - 1].lru_next = arp_table[i].lru_next;
+    if (arp_table[i].lru_next != 0) {
+      arp_table[arp_table[i].lru_next - 1].lru_prev = arp_table[i].lru_prev;
+    } else {
+      arp_lru_tail = arp_table[i].lru_prev;
+    }
+  }
+  arp_table[i].lru_prev = 0;
+  arp_table[i].lru_next = arp_lru_head;
+  if (arp_lru_head != 0) {
+    arp_table[arp_lru_head - 1].lru_prev = link;
+  } else {
+    arp_lru_tail = link;
+  }
+  arp_lru_head = link;
+}
+
+/** Take an unused entry and link it into the hash table and LRU list */
+static s16_t
+etharp_hash_alloc(const ip4_addr_t *ipaddr)
+{
+  s16_t i;
+  u16_t *bucket;
+
+  if (arp_free != 0) {
+    i = (s16_t)(arp_free - 1);
+    arp_free = arp_table[i].hnext;
+  } else if (arp_unused < ARP_TABLE_SIZE) {
+    i = (s16_t)arp_unused++;
+  } else {
+    return -1;
+  }
+  if (ipaddr != NULL) {
+    ip4_addr_copy(arp_table[i].ipaddr, *ipaddr);
+  } else {
+    ip4_addr_set_zero(&arp_table[i].ipaddr);
+  }
+  bucket = &arp_hash[ETHARP_HASH(&arp_table[i].ipaddr)];
+  arp_table[i].hnext = *bucket;
+  *bucket = (u16_t)(i + 1);
+  arp_table[i].lru_prev = arp_table[i].lru_next = 0;
+  etharp_lru_touch(i);
+  ETHARP_CACHE_STATS_INC(insert);
+  ETHARP_CACHE_STATS_USED(1);
+  return i;
+}
+
+/** Unlink an entry from the hash table and LRU list and put it on the free list */
+static void
+etharp_hash_free(s16_t i)
+{
+  u16_t link = (u16_t)(i + 1);
+  u16_t *bucket = &arp_hash[ETHARP_HASH(&arp_table[i].ipaddr)];
+
+  while (*bucket != link) {
+    LWIP_ASSERT("etharp_hash_free: entry not in its bucket", *bucket != 0);
+    bucket = &arp_table[*bucket - 1].hnext;
+  }
+  *bucket = arp_table[i].hnext;
+  if (arp_table[i].lru_prev != 0) {
+    arp_table[arp_table[i].lru_prev - 1].lru_next = arp_table[i].lru_next;
+  } else {
+    arp_lru_head = arp_table[i].lru_next;
+  }
+  if (arp_table[i].lru_next != 0) {
+    arp_table[arp_table[i].lru_next - 1].lru_prev = arp_table[i].lru_prev;
+  } else {
+    arp_lru_tail = arp_table[i].lru_prev;
+  }
+  arp_table[i].hnext = arp_free;
+  arp_free = link;
+  ETHARP_CACHE_STATS_USED(-1);
+}
+#endif /* LWIP_NEIGHBOR_HASH */
+
 /** Clean up ARP table entries */
 static void
 etharp_free_entry(int i)
 {
+#if LWIP_NEIGHBOR_HASH
+  etharp_hash_free((s16_t)i);
+#endif /* LWIP_NEIGHBOR_HASH */
   /* remove from SNMP ARP index tree */
   mib2_remove_arp_entry(arp_table[i].netif, &arp_table[i].ipaddr);
   /* and empty packet queue */
@@ -198,12 +320,25 @@ etharp_free_entry(int i)
 void
 etharp_tmr(void)
 {
-  u8_t i;
+#if LWIP_NEIGHBOR_HASH
+  s16_t i;
+  u16_t next;
+
+  LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer\n"));
+  /* remove expired entries from the ARP table, only visiting used ones */
+  for (next = arp_lru_head; next != 0; ) {
+    u8_t state;
+    i = (s16_t)(next - 1);
+    next = arp_table[i].lru_next;
+    state = arp_table[i].state;
+#else /* LWIP_NEIGHBOR_HASH */
+  u16_t i;
 
   LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer\n"));
   /* remove expired entries from the ARP table */
   for (i = 0; i < ARP_TABLE_SIZE; ++i) {
     u8_t state = arp_table[i].state;
+#endif /* LWIP_NEIGHBOR_HASH */
     if (state != ETHARP_STATE_EMPTY
 #if ETHARP_SUPPORT_STATIC_ENTRIES
       && (state != ETHARP_STATE_STATIC)
@@ -254,14 +389,105 @@ etharp_tmr(void)
  * @return The ARP entry index that matched or is created, ERR_MEM if no
  * entry is found or could be recycled.
  */
-static s8_t
+#if LWIP_NEIGHBOR_HASH
+static s16_t
+etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
+{
+  s16_t i;
+  u16_t link;
+  s16_t old_pending = -1, old_queue = -1;
+
+  LWIP_UNUSED_ARG(netif);
+
+  ETHARP_CACHE_STATS_INC(lookup);
+  if (ipaddr != NULL) {
+    /* look in the address's bucket only; entries that are linked but still
+       EMPTY were handed out earlier and are reused for the same address */
+    for (link = arp_hash[ETHARP_HASH(ipaddr)]; link != 0; link = arp_table[i].hnext) {
+      i = (s16_t)(link - 1);
+      if (ip4_addr_cmp(ipaddr, &arp_table[i].ipaddr) &&
+          ((arp_table[i].state != ETHARP_STATE_EMPTY) || ((flags & ETHARP_FLAG_FIND_ONLY) == 0))
+#if ETHARP_TABLE_MATCH_NETIF
+          && ((netif == NULL) || (netif == arp_table[i].netif))
+#endif /* ETHARP_TABLE_MATCH_NETIF */
+        ) {
+        LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: found matching entry %"U16_F"\n", (u16_t)i));
+        ETHARP_CACHE_STATS_INC(hit);
+        etharp_lru_touch(i);
+        return i;
+      }
+    }
+  }
+
+  /* don't create new entry, only search? */
+  if ((flags & ETHARP_FLAG_FIND_ONLY) != 0) {
+    return (s16_t)ERR_MEM;
+  }
+
+  i = etharp_hash_alloc(ipaddr);
+  if (i < 0) {
+    if ((flags & ETHARP_FLAG_TRY_HARD) == 0) {
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no empty entry found and not allowed to recycle\n"));
+      ETHARP_CACHE_STATS_INC(full);
+      return (s16_t)ERR_MEM;
+    }
+    /* recycle the least recently used entry, preferring (as the linear
+       search does) stable over pending and pending without queued packets
+       over pending with queued packets; static entries are never evicted */
+    for (link = arp_lru_tail; link != 0; link = arp_table[i].lru_prev) {
+      u8_t state;
+      i = (s16_t)(link - 1);
+      state = arp_table[i].state;
+      if ((state == ETHARP_STATE_EMPTY) ||
+          ((state >= ETHARP_STATE_STABLE)
+#if ETHARP_SUPPORT_STATIC_ENTRIES
+           && (state < ETHARP_STATE_STATIC)
+#endif /* ETHARP_SUPPORT_STATIC_ENTRIES */
+          )) {
+        break;
+      }
+      if (state == ETHARP_STATE_PENDING) {
+        if (arp_table[i].q == NULL) {
+          if (old_pending < 0) {
+            old_pending = i;
+          }
+        } else if (old_queue < 0) {
+          old_queue = i;
+        }
+      }
+    }
+    if (link == 0) {
+      i = (old_pending >= 0) ? old_pending : old_queue;
+    }
+    if (i < 0) {
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no empty or recyclable entries found\n"));
+      ETHARP_CACHE_STATS_INC(full);
+      return (s16_t)ERR_MEM;
+    }
+    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: recycling entry %"U16_F"\n", (u16_t)i));
+    etharp_free_entry(i);
+    ETHARP_CACHE_STATS_INC(evict);
+    i = etharp_hash_alloc(ipaddr);
+    LWIP_ASSERT("recycled entry available", i >= 0);
+  }
+
+  LWIP_ASSERT("arp_table[i].state == ETHARP_STATE_EMPTY",
+    arp_table[i].state == ETHARP_STATE_EMPTY);
+  arp_table[i].ctime = 0;
+#if ETHARP_TABLE_MATCH_NETIF
+  arp_table[i].netif = netif;
+#endif /* ETHARP_TABLE_MATCH_NETIF*/
+  return i;
+}
+#else /* LWIP_NEIGHBOR_HASH */
+static s16_t
 etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
 {
-  s8_t old_pending = ARP_TABLE_SIZE, old_stable = ARP_TABLE_SIZE;
-  s8_t empty = ARP_TABLE_SIZE;
-  u8_t i = 0;
+  s16_t old_pending = ARP_TABLE_SIZE, old_stable = ARP_TABLE_SIZE;
+  s16_t empty = ARP_TABLE_SIZE;
+  s16_t i = 0;
   /* oldest entry with packets on queue */
-  s8_t old_queue = ARP_TABLE_SIZE;
+  s16_t old_queue = ARP_TABLE_SIZE;
   /* its age */
   u16_t age_queue = 0, age_pending = 0, age_stable = 0;
 
@@ -341,7 +567,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
       /* or no empty entry found and not allowed to recycle? */
       ((empty == ARP_TABLE_SIZE) && ((flags & ETHARP_FLAG_TRY_HARD) == 0))) {
     LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no empty entry found and not allowed to recycle\n"));
-    return (s8_t)ERR_MEM;
+    return (s16_t)ERR_MEM;
   }
 
   /* b) choose the least destructive entry to recycle:
@@ -378,7 +604,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
       /* no empty or recyclable entries found */
     } else {
       LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no empty or recyclable entries found\n"));
-      return (s8_t)ERR_MEM;
+      return (s16_t)ERR_MEM;
     }
 
     /* { empty or recyclable entry found } */
@@ -399,8 +625,9 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
 #if ETHARP_TABLE_MATCH_NETIF
   arp_table[i].netif = netif;
 #endif /* ETHARP_TABLE_MATCH_NETIF*/
-  return (err_t)i;
+  return i;
 }
+#endif /* LWIP_NEIGHBOR_HASH */
 
 /**
  * Update (or insert) a IP/MAC address pair in the ARP cache.
@@ -423,7 +650,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
 static err_t
 etharp_update_arp_entry(struct netif *netif, const ip4_addr_t *ipaddr, struct eth_addr *ethaddr, u8_t flags)
 {
-  s8_t i;
+  s16_t i;
   LWIP_ASSERT("netif->hwaddr_len == ETH_HWADDR_LEN", netif->hwaddr_len == ETH_HWADDR_LEN);
   LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_update_arp_entry: %"U16_F".%"U16_F".%"U16_F".%"U16_F" - %02"X16_F":%02"X16_F":%02"X16_F":%02"X16_F":%02"X16_F":%02"X16_F"\n",
     ip4_addr1_16(ipaddr), ip4_addr2_16(ipaddr), ip4_addr3_16(ipaddr), ip4_addr4_16(ipaddr),
@@ -529,7 +756,7 @@ etharp_add_static_entry(const ip4_addr_t *ipaddr, struct eth_addr *ethaddr)
 err_t
 etharp_remove_static_entry(const ip4_addr_t *ipaddr)
 {
-  s8_t i;
+  s16_t i;
   LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_remove_static_entry: %"U16_F".%"U16_F".%"U16_F".%"U16_F"\n",
     ip4_addr1_16(ipaddr), ip4_addr2_16(ipaddr), ip4_addr3_16(ipaddr), ip4_addr4_16(ipaddr)));
 
@@ -558,7 +785,19 @@ etharp_remove_static_entry(const ip4_addr_t *ipaddr)
 void
 etharp_cleanup_netif(struct netif *netif)
 {
-  u8_t i;
+#if LWIP_NEIGHBOR_HASH
+  s16_t i;
+  u16_t next;
+
+  for (next = arp_lru_head; next != 0; ) {
+    i = (s16_t)(next - 1);
+    next = arp_table[i].lru_next;
+    if (arp_table[i].netif == netif) {
+      etharp_free_entry(i);
+    }
+  }
+#else /* LWIP_NEIGHBOR_HASH */
+  u16_t i;
 
   for (i = 0; i < ARP_TABLE_SIZE; ++i) {
     u8_t state = arp_table[i].state;
@@ -566,6 +805,7 @@ etharp_cleanup_netif(struct netif *netif)
       etharp_free_entry(i);
     }
   }
+#endif /* LWIP_NEIGHBOR_HASH */
 }
 
 /**
@@ -579,11 +819,11 @@ etharp_cleanup_netif(struct netif *netif)
  * @param ip_ret points to return pointer
  * @return table index if found, -1 otherwise
  */
-s8_t
+s16_t
 etharp_find_addr(struct netif *netif, const ip4_addr_t *ipaddr,
          struct eth_addr **eth_ret, const ip4_addr_t **ip_ret)
 {
-  s8_t i;
+  s16_t i;
 
   LWIP_ASSERT("eth_ret != NULL && ip_ret != NULL",
     eth_ret != NULL && ip_ret != NULL);
@@ -609,7 +849,7 @@ etharp_find_addr(struct netif *netif, const ip4_addr_t *ipaddr,
  * @return 1 on valid index, 0 otherwise
  */
 u8_t
-etharp_get_entry(u8_t i, ip4_addr_t **ipaddr, struct netif **netif, struct eth_addr **eth_ret)
+etharp_get_entry(u16_t i, ip4_addr_t **ipaddr, struct netif **netif, struct eth_addr **eth_ret)
 {
   LWIP_ASSERT("ipaddr != NULL", ipaddr != NULL);
   LWIP_ASSERT("netif != NULL", netif != NULL);
@@ -743,7 +983,7 @@ etharp_input(struct pbuf *p, struct netif *netif)
  * in the arp_table specified by the index 'arp_idx'.
  */
 static err_t
-etharp_output_to_arp_index(struct netif *netif, struct pbuf *q, u8_t arp_idx)
+etharp_output_to_arp_index(struct netif *netif, struct pbuf *q, u16_t arp_idx)
 {
   LWIP_ASSERT("arp_table[arp_idx].state >= ETHARP_STATE_STABLE",
               arp_table[arp_idx].state >= ETHARP_STATE_STABLE);
@@ -816,7 +1056,7 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
     dest = &mcastaddr;
   /* unicast destination IP address? */
   } else {
-    s8_t i;
+    s16_t i;
     /* outside local network? if so, this can neither be a global broadcast nor
        a subnet broadcast. */
     if (!ip4_addr_netcmp(ipaddr, netif_ip4_addr(netif), netif_ip4_netmask(netif)) &&
@@ -852,7 +1092,7 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
 #if LWIP_NETIF_HWADDRHINT
     if (netif->addr_hint != NULL) {
       /* per-pcb cached entry was given */
-      u8_t etharp_cached_entry = *(netif->addr_hint);
+      u16_t etharp_cached_entry = *(netif->addr_hint);
       if (etharp_cached_entry < ARP_TABLE_SIZE) {
 #endif /* LWIP_NETIF_HWADDRHINT */
         if ((arp_table[etharp_cached_entry].state >= ETHARP_STATE_STABLE) &&
@@ -862,6 +1102,10 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
             (ip4_addr_cmp(dst_addr, &arp_table[etharp_cached_entry].ipaddr))) {
           /* the per-pcb-cached entry is stable and the right one! */
           ETHARP_STATS_INC(etharp.cachehit);
+#if LWIP_NEIGHBOR_HASH
+          /* keep the entry in use from being evicted, as a hashed lookup does */
+          etharp_lru_touch((s16_t)etharp_cached_entry);
+#endif /* LWIP_NEIGHBOR_HASH */
           return etharp_output_to_arp_index(netif, q, etharp_cached_entry);
         }
 #if LWIP_NETIF_HWADDRHINT
@@ -869,6 +1113,14 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
     }
 #endif /* LWIP_NETIF_HWADDRHINT */
 
+#if LWIP_NEIGHBOR_HASH
+    /* find stable entry: the hashed lookup is cheap enough to use directly */
+    i = etharp_find_entry(dst_addr, ETHARP_FLAG_FIND_ONLY, netif);
+    if ((i >= 0) && (arp_table[i].state >= ETHARP_STATE_STABLE)) {
+      ETHARP_SET_HINT(netif, (u16_t)i);
+      return etharp_output_to_arp_index(netif, q, (u16_t)i);
+    }
+#else /* LWIP_NEIGHBOR_HASH */
     /* find stable entry: do this here since this is a critical path for
        throughput and etharp_find_entry() is kind of slow */
     for (i = 0; i < ARP_TABLE_SIZE; i++) {
@@ -882,6 +1134,7 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
         return etharp_output_to_arp_index(netif, q, i);
       }
     }
+#endif /* LWIP_NEIGHBOR_HASH */
     /* no stable entry found, use the (slower) query function:
        queue on destination Ethernet address belonging to ipaddr */
     return etharp_query(netif, dst_addr, q);
@@ -932,7 +1185,7 @@ etharp_query(struct netif *netif, const ip4_addr_t *ipaddr, struct pbuf *q)
   struct eth_addr * srcaddr = (struct eth_addr *)netif->hwaddr;
   err_t result = ERR_MEM;
   int is_new_entry = 0;
-  s8_t i; /* ARP entry index */
+  s16_t i; /* ARP entry index */
 
   /* non-unicast address? */
   if (ip4_addr_isbroadcast(ipaddr, netif) ||
@@ -71,6 +71,12 @@
 #if LWIP_IPV6_DUP_DETECT_ATTEMPTS > IP6_ADDR_TENTATIVE_COUNT_MASK
 #error LWIP_IPV6_DUP_DETECT_ATTEMPTS > IP6_ADDR_TENTATIVE_COUNT_MASK
 #endif
+#if LWIP_ND6_NUM_NEIGHBORS > 0x7fff
+#error LWIP_ND6_NUM_NEIGHBORS must fit in an s16_t
+#endif
+#if LWIP_NEIGHBOR_HASH && (LWIP_NEIGHBOR_HASH_SIZE & (LWIP_NEIGHBOR_HASH_SIZE - 1))
+#error LWIP_NEIGHBOR_HASH_SIZE must be a power of two
+#endif
 
 /* Router tables. */
 struct nd6_neighbor_cache_entry neighbor_cache[LWIP_ND6_NUM_NEIGHBORS];
@@ -83,9 +89,19 @@ u32_t reachable_time = LWIP_ND6_REACHABLE_TIME;
 u32_t retrans_timer = LWIP_ND6_RETRANS_TIMER; /* @todo implement this value in timer */
 
 /* Index for cache entries. */
-static u8_t nd6_cached_neighbor_index;
+static u16_t nd6_cached_neighbor_index;
 static u8_t nd6_cached_destination_index;
 
+#if LWIP_NEIGHBOR_HASH
+/* Neighbor cache index: hash buckets by address, LRU list and free list,
+ * all holding neighbor_cache index + 1 (0 terminates). */
+static u16_t nd6_neighbor_hash[LWIP_NEIGHBOR_HASH_SIZE];
+static u16_t nd6_lru_head, nd6_lru_tail;
+static u16_t nd6_neighbor_free;
+/* entries [nd6_neighbor_unused, LWIP_ND6_NUM_NEIGHBORS) have never been used */
+static u16_t nd6_neighbor_unused;
+#endif /* LWIP_NEIGHBOR_HASH */
+
 /* Multicast address holder. */
 static ip6_addr_t multicast_address;
 
@@ -93,9 +109,9 @@ static ip6_addr_t multicast_address;
 static u8_t nd6_ra_buffer[sizeof(struct prefix_option)];
 
 /* Forward declarations. */
-static s8_t nd6_find_neighbor_cache_entry(const ip6_addr_t *ip6addr);
-static s8_t nd6_new_neighbor_cache_entry(void);
-static void nd6_free_neighbor_cache_entry(s8_t i);
+static s16_t nd6_find_neighbor_cache_entry(const ip6_addr_t *ip6addr);
+static s16_t nd6_new_neighbor_cache_entry(const ip6_addr_t *ip6addr);
+static void nd6_free_neighbor_cache_entry(s16_t i);
 static s8_t nd6_find_destination_cache_entry(const ip6_addr_t *ip6addr);
 static s8_t nd6_new_destination_cache_entry(void);
 static s8_t nd6_is_prefix_in_netif(const ip6_addr_t *ip6addr, struct netif *netif);
@@ -104,8 +120,8 @@ static s8_t nd6_get_router(const ip6_addr_t *router_addr, struct netif *netif);
 static s8_t nd6_new_router(const ip6_addr_t *router_addr, struct netif *netif);
 static s8_t nd6_get_onlink_prefix(ip6_addr_t *prefix, struct netif *netif);
 static s8_t nd6_new_onlink_prefix(ip6_addr_t *prefix, struct netif *netif);
-static s8_t nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif);
-static err_t nd6_queue_packet(s8_t neighbor_index, struct pbuf *q);
+static s16_t nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif);
+static err_t nd6_queue_packet(s16_t neighbor_index, struct pbuf *q);
 
 #define ND6_SEND_FLAG_MULTICAST_DEST 0x01
 #define ND6_SEND_FLAG_ALLNODES_DEST 0x02
@@ -121,7 +137,7 @@ static void nd6_free_q(struct nd6_q_entry *q);
 #else /* LWIP_ND6_QUEUEING */
 #define nd6_free_q(q) pbuf_free(q)
 #endif /* LWIP_ND6_QUEUEING */
-static void nd6_send_q(s8_t i);
+static void nd6_send_q(s16_t i);
 
 
 /**
@@ -134,7 +150,7 @@ void
 nd6_input(struct pbuf *p, struct netif *inp)
 {
   u8_t msg_type;
-  s8_t i;
+  s16_t i;
 
   ND6_STATS_INC(nd6.recv);
 
@@ -361,7 +377,7 @@ nd6_input(struct pbuf *p, struct netif *inp)
         /* Add their IPv6 address and link-layer address to neighbor cache.
          * We will need it at least to send a unicast NA message, but most
          * likely we will also be communicating with this node soon. */
-        i = nd6_new_neighbor_cache_entry();
+        i = nd6_new_neighbor_cache_entry(ip6_current_src_addr());
         if (i < 0) {
           /* We couldn't assign a cache entry for this neighbor.
            * we won't be able to reply. drop it. */
@@ -371,7 +387,6 @@ nd6_input(struct pbuf *p, struct netif *inp)
         }
         neighbor_cache[i].netif = inp;
         MEMCPY(neighbor_cache[i].lladdr, lladdr_opt->addr, inp->hwaddr_len);
-        ip6_addr_set(&(neighbor_cache[i].next_hop_address), ip6_current_src_addr());
 
         /* Receiving a message does not prove reachability: only in one direction.
          * Delay probe in case we get confirmation of reachability from upper layer (TCP). */
@@ -631,11 +646,10 @@ nd6_input(struct pbuf *p, struct netif *inp)
 
         i = nd6_find_neighbor_cache_entry(&tmp);
         if (i < 0) {
-          i = nd6_new_neighbor_cache_entry();
+          i = nd6_new_neighbor_cache_entry(&tmp);
           if (i >= 0) {
             neighbor_cache[i].netif = inp;
             MEMCPY(neighbor_cache[i].lladdr, lladdr_opt->addr, inp->hwaddr_len);
-            ip6_addr_set(&(neighbor_cache[i].next_hop_address), &tmp);
 
             /* Receiving a message does not prove reachability: only in one direction.
              * Delay probe in case we get confirmation of reachability from upper layer (TCP). */
@@ -715,11 +729,20 @@ nd6_input(struct pbuf *p, struct netif *inp)
 void
 nd6_tmr(void)
 {
-  s8_t i;
+  s16_t i;
   struct netif *netif;
+#if LWIP_NEIGHBOR_HASH
+  u16_t next;
+
+  /* Process neighbor entries, only visiting used ones. */
+  for (next = nd6_lru_head; next != 0; ) {
+    i = (s16_t)(next - 1);
+    next = neighbor_cache[i].lru_next;
+#else /* LWIP_NEIGHBOR_HASH */
 
   /* Process neighbor entries. */
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
+#endif /* LWIP_NEIGHBOR_HASH */
     switch (neighbor_cache[i].state) {
     case ND6_INCOMPLETE:
       if ((neighbor_cache[i].counter.probes_sent >= LWIP_ND6_MAX_MULTICAST_SOLICIT) &&
@@ -1116,6 +1139,43 @@ nd6_send_rs(struct netif *netif)
 }
 #endif /* LWIP_IPV6_SEND_ROUTER_SOLICIT */
 
+#if LWIP_NEIGHBOR_HASH
+static u16_t
+nd6_neighbor_hash_index(const ip6_addr_t *ip6addr)
+{
+  u32_t h = ip6addr->addr[0] ^ ip6addr->addr[1] ^ ip6addr->addr[2] ^ ip6addr->addr[3];
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return (u16_t)(h & (LWIP_NEIGHBOR_HASH_SIZE - 1));
+}
+
+/** Move a neighbor cache entry to the most recently used end of the LRU list */
+static void
+nd6_neighbor_lru_touch(s16_t i)
+{
+  u16_t link = (u16_t)(i + 1);
+  if (nd6_lru_head == link) {
+    return;
+  }
+  if (neighbor_cache[i].lru_prev != 0) {
+    neighbor_cache[neighbor_cache[i].lru_prev - 1].lru_next = neighbor_cache[i].lru_next;
+    if (neighbor_cache[i].lru_next != 0) {
+      neighbor_cache[neighbor_cache[i].lru_next - 1].lru_prev = neighbor_cache[i].lru_prev;
+    } else {
+      nd6_lru_tail = neighbor_cache[i].lru_prev;
+    }
+  }
+  neighbor_cache[i].lru_prev = 0;
+  neighbor_cache[i].lru_next = nd6_lru_head;
+  if (nd6_lru_head != 0) {
+    neighbor_cache[nd6_lru_head - 1].lru_prev = link;
+  } else {
+    nd6_lru_tail = link;
+  }
+  nd6_lru_head = link;
+}
+
 /**
  * Search for a neighbor cache entry
  *
@@ -1123,10 +1183,169 @@ nd6_send_rs(struct netif *netif)
  * @return The neighbor cache entry index that matched, -1 if no
  * entry is found
  */
-static s8_t
+static s16_t
 nd6_find_neighbor_cache_entry(const ip6_addr_t *ip6addr)
 {
-  s8_t i;
+  u16_t link;
+  ND6_CACHE_STATS_INC(lookup);
+  for (link = nd6_neighbor_hash[nd6_neighbor_hash_index(ip6addr)]; link != 0;
+       link = neighbor_cache[link - 1].hnext) {
+    if (ip6_addr_cmp(ip6addr, &(neighbor_cache[link - 1].next_hop_address))) {
+      ND6_CACHE_STATS_INC(hit);
+      nd6_neighbor_lru_touch((s16_t)(link - 1));
+      return (s16_t)(link - 1);
+    }
+  }
+  return -1;
+}
+
+/**
+ * Create a new neighbor cache entry for an address.
+ *
+ * If no unused entry is found, will try to recycle the least recently
+ * used entry of the same kind the linear search would pick: stale,
+ * probe, delay, reachable, incomplete without and then with queued
+ * packets. Routers are never recycled.
+ *
+ * @param ip6addr the IPv6 address of the neighbor
+ * @return The neighbor cache entry index that was created, -1 if no
+ * entry could be created
+ */
+static s16_t
+nd6_new_neighbor_cache_entry(const ip6_addr_t *ip6addr)
+{
+  s16_t i;
+  u16_t link, *bucket;
+
+  if (nd6_neighbor_free != 0) {
+    i = (s16_t)(nd6_neighbor_free - 1);
+    nd6_neighbor_free = neighbor_cache[i].hnext;
+  } else if (nd6_neighbor_unused < LWIP_ND6_NUM_NEIGHBORS) {
+    i = (s16_t)nd6_neighbor_unused++;
+  } else {
+    /* Best candidate per recycling class, in the order above. */
+    s16_t candidate[6] = { -1, -1, -1, -1, -1, -1 };
+    u8_t rank;
+
+    for (link = nd6_lru_tail; link != 0; link = neighbor_cache[link - 1].lru_prev) {
+      i = (s16_t)(link - 1);
+      if (neighbor_cache[i].isrouter) {
+        continue;
+      }
+      switch (neighbor_cache[i].state) {
+      case ND6_STATIC:     /* cheap to recreate through the hook */
+      case ND6_STALE:      rank = 0; break;
+      case ND6_PROBE:      rank = 1; break;
+      case ND6_DELAY:      rank = 2; break;
+      case ND6_REACHABLE:  rank = 3; break;
+      case ND6_INCOMPLETE: rank = (neighbor_cache[i].q == NULL) ? 4 : 5; break;
+      default:             rank = 0; break;
+      }
+      if (candidate[rank] < 0) {
+        candidate[rank] = i;
+        if (rank == 0) {
+          break;
+        }
+      }
+    }
+    i = -1;
+    for (rank = 0; (rank < 6) && (i < 0); rank++) {
+      i = candidate[rank];
+    }
+    if (i < 0) {
+      /* No more entries to try. */
+      ND6_CACHE_STATS_INC(full);
+      return -1;
+    }
+    nd6_free_neighbor_cache_entry(i);
+    ND6_CACHE_STATS_INC(evict);
+    /* take it back off the free list */
+    nd6_neighbor_free = neighbor_cache[i].hnext;
+  }
+
+  ip6_addr_set(&(neighbor_cache[i].next_hop_address), ip6addr);
+  bucket = &nd6_neighbor_hash[nd6_neighbor_hash_index(ip6addr)];
+  neighbor_cache[i].hnext = *bucket;
+  *bucket = (u16_t)(i + 1);
+  neighbor_cache[i].lru_prev = neighbor_cache[i].lru_next = 0;
+  nd6_neighbor_lru_touch(i);
+  ND6_CACHE_STATS_INC(insert);
+  ND6_CACHE_STATS_USED(1);
+  return i;
+}
+
+/**
+ * Will free any resources associated with a neighbor cache
+ * entry, and will mark it as unused.
+ *
+ * @param i the neighbor cache entry index to free
+ */
+static void
+nd6_free_neighbor_cache_entry(s16_t i)
+{
+  u16_t link, *bucket;
+
+  if ((i < 0) || (i >= LWIP_ND6_NUM_NEIGHBORS)) {
+    return;
+  }
+  if (neighbor_cache[i].isrouter) {
+    /* isrouter needs to be cleared before deleting a neighbor cache entry */
+    return;
+  }
+  link = (u16_t)(i + 1);
+  if ((nd6_lru_head != link) && (neighbor_cache[i].lru_prev == 0)) {
+    /* not in use */
+    return;
+  }
+
+  /* Free any queued packets. */
+  if (neighbor_cache[i].q != NULL) {
+    nd6_free_q(neighbor_cache[i].q);
+    neighbor_cache[i].q = NULL;
+  }
+
+  /* Unlink from the hash bucket and the LRU list, then put on the free list. */
+  bucket = &nd6_neighbor_hash[nd6_neighbor_hash_index(&(neighbor_cache[i].next_hop_address))];
+  while (*bucket != link) {
+    LWIP_ASSERT("nd6_free_neighbor_cache_entry: entry not in its bucket", *bucket != 0);
+    bucket = &neighbor_cache[*bucket - 1].hnext;
+  }
+  *bucket = neighbor_cache[i].hnext;
+  if (neighbor_cache[i].lru_prev != 0) {
+    neighbor_cache[neighbor_cache[i].lru_prev - 1].lru_next = neighbor_cache[i].lru_next;
+  } else {
+    nd6_lru_head = neighbor_cache[i].lru_next;
+  }
+  if (neighbor_cache[i].lru_next != 0) {
+    neighbor_cache[neighbor_cache[i].lru_next - 1].lru_prev = neighbor_cache[i].lru_prev;
+  } else {
+    nd6_lru_tail = neighbor_cache[i].lru_prev;
+  }
+  neighbor_cache[i].lru_prev = neighbor_cache[i].lru_next = 0;
+  neighbor_cache[i].hnext = nd6_neighbor_free;
+  nd6_neighbor_free = link;
+  ND6_CACHE_STATS_USED(-1);
+
+  neighbor_cache[i].state = ND6_NO_ENTRY;
+  neighbor_cache[i].isrouter = 0;
+  neighbor_cache[i].netif = NULL;
+  neighbor_cache[i].counter.reachable_time = 0;
+  ip6_addr_set_zero(&(neighbor_cache[i].next_hop_address));
+}
+
+#else /* LWIP_NEIGHBOR_HASH */
+
+/**
+ * Search for a neighbor cache entry
+ *
+ * @param ip6addr the IPv6 address of the neighbor
+ * @return The neighbor cache entry index that matched, -1 if no
+ * entry is found
+ */
+static s16_t
+nd6_find_neighbor_cache_entry(const ip6_addr_t *ip6addr)
+{
+  s16_t i;
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
     if (ip6_addr_cmp(ip6addr, &(neighbor_cache[i].next_hop_address))) {
       return i;
@@ -1144,11 +1363,11 @@ nd6_find_neighbor_cache_entry(const ip6_addr_t *ip6addr)
  * @return The neighbor cache entry index that was created, -1 if no
  * entry could be created
  */
-static s8_t
-nd6_new_neighbor_cache_entry(void)
+static s16_t
+nd6_new_neighbor_cache_entry_index(void)
 {
-  s8_t i;
-  s8_t j;
+  s16_t i;
+  s16_t j;
   u32_t time;
 
 
@@ -1161,9 +1380,9 @@ nd6_new_neighbor_cache_entry(void)
 
   /* We need to recycle an entry. in general, do not recycle if it is a router. */
 
-  /* Next, try to find a Stale entry. */
+  /* Next, try to find a Stale (or static, cheap to recreate) entry. */
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
-    if ((neighbor_cache[i].state == ND6_STALE) &&
+    if (((neighbor_cache[i].state == ND6_STALE) || (neighbor_cache[i].state == ND6_STATIC)) &&
         (!neighbor_cache[i].isrouter)) {
       nd6_free_neighbor_cache_entry(i);
       return i;
@@ -1245,6 +1464,25 @@ nd6_new_neighbor_cache_entry(void)
   return -1;
 }
 
+/**
+ * Create a new neighbor cache entry for an address.
+ *
+ * @param ip6addr the IPv6 address of the neighbor
+ * @return The neighbor cache entry index that was created, -1 if no
+ * entry could be created
+ */
+static s16_t
+nd6_new_neighbor_cache_entry(const ip6_addr_t *ip6addr)
+{
+  s16_t i;
+
+  i = nd6_new_neighbor_cache_entry_index();
+  if (i >= 0) {
+    ip6_addr_set(&(neighbor_cache[i].next_hop_address), ip6addr);
+  }
+  return i;
+}
+
 /**
  * Will free any resources associated with a neighbor cache
  * entry, and will mark it as unused.
@@ -1252,7 +1490,7 @@ nd6_new_neighbor_cache_entry(void)
  * @param i the neighbor cache entry index to free
  */
 static void
-nd6_free_neighbor_cache_entry(s8_t i)
+nd6_free_neighbor_cache_entry(s16_t i)
 {
   if ((i < 0) || (i >= LWIP_ND6_NUM_NEIGHBORS)) {
     return;
@@ -1274,6 +1512,7 @@ nd6_free_neighbor_cache_entry(s8_t i)
   neighbor_cache[i].counter.reachable_time = 0;
   ip6_addr_set_zero(&(neighbor_cache[i].next_hop_address));
 }
+#endif /* LWIP_NEIGHBOR_HASH */
 
 /**
  * Search for a destination cache entry
@@ -1490,18 +1729,17 @@ nd6_new_router(const ip6_addr_t *router_addr, struct netif *netif)
 {
   s8_t router_index;
   s8_t free_router_index;
-  s8_t neighbor_index;
+  s16_t neighbor_index;
 
   /* Do we have a neighbor entry for this router? */
   neighbor_index = nd6_find_neighbor_cache_entry(router_addr);
   if (neighbor_index < 0) {
     /* Create a neighbor entry for this router. */
-    neighbor_index = nd6_new_neighbor_cache_entry();
+    neighbor_index = nd6_new_neighbor_cache_entry(router_addr);
     if (neighbor_index < 0) {
       /* Could not create neighbor entry for this router. */
       return -1;
     }
-    ip6_addr_set(&(neighbor_cache[neighbor_index].next_hop_address), router_addr);
     neighbor_cache[neighbor_index].netif = netif;
     neighbor_cache[neighbor_index].q = NULL;
     neighbor_cache[neighbor_index].state = ND6_INCOMPLETE;
@@ -1605,13 +1843,13 @@ nd6_new_onlink_prefix(ip6_addr_t *prefix, struct netif *netif)
  *         suitable next hop was found, ERR_MEM if no cache entry
  *         could be created
  */
-static s8_t
+static s16_t
 nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif)
 {
 #ifdef LWIP_HOOK_ND6_GET_GW
   const ip6_addr_t *next_hop_addr;
 #endif /* LWIP_HOOK_ND6_GET_GW */
-  s8_t i;
+  s16_t i;
 
 #if LWIP_NETIF_HWADDRHINT
   if (netif->addr_hint != NULL) {
@@ -1685,8 +1923,11 @@ nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif)
   if (ip6_addr_cmp(&(destination_cache[nd6_cached_destination_index].next_hop_addr),
                    &(neighbor_cache[nd6_cached_neighbor_index].next_hop_address))) {
     /* Cache hit. */
-    /* Do nothing. */
     ND6_STATS_INC(nd6.cachehit);
+#if LWIP_NEIGHBOR_HASH
+    /* keep the entry in use from being evicted, as a hashed lookup does */
+    nd6_neighbor_lru_touch((s16_t)nd6_cached_neighbor_index);
+#endif /* LWIP_NEIGHBOR_HASH */
   } else {
     i = nd6_find_neighbor_cache_entry(&(destination_cache[nd6_cached_destination_index].next_hop_addr));
     if (i >= 0) {
@@ -1694,7 +1935,7 @@ nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif)
       nd6_cached_neighbor_index = i;
     } else {
       /* Neighbor not in cache. Make a new entry. */
-      i = nd6_new_neighbor_cache_entry();
+      i = nd6_new_neighbor_cache_entry(&(destination_cache[nd6_cached_destination_index].next_hop_addr));
       if (i >= 0) {
         /* got new neighbor entry. make it our new cached index. */
         nd6_cached_neighbor_index = i;
@@ -1704,13 +1945,19 @@ nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif)
       }
 
       /* Initialize fields. */
-      ip6_addr_copy(neighbor_cache[i].next_hop_address,
-                   destination_cache[nd6_cached_destination_index].next_hop_addr);
       neighbor_cache[i].isrouter = 0;
       neighbor_cache[i].netif = netif;
-      neighbor_cache[i].state = ND6_INCOMPLETE;
-      neighbor_cache[i].counter.probes_sent = 1;
-      nd6_send_neighbor_cache_probe(&neighbor_cache[i], ND6_SEND_FLAG_MULTICAST_DEST);
+#ifdef LWIP_HOOK_ND6_GET_LLADDR
+      if (LWIP_HOOK_ND6_GET_LLADDR(netif, &(neighbor_cache[i].next_hop_address), neighbor_cache[i].lladdr)) {
+        /* Link-layer address is known, no need to resolve it. */
+        neighbor_cache[i].state = ND6_STATIC;
+      } else
+#endif /* LWIP_HOOK_ND6_GET_LLADDR */
+      {
+        neighbor_cache[i].state = ND6_INCOMPLETE;
+        neighbor_cache[i].counter.probes_sent = 1;
+        nd6_send_neighbor_cache_probe(&neighbor_cache[i], ND6_SEND_FLAG_MULTICAST_DEST);
+      }
     }
   }
 
@@ -1728,7 +1975,7 @@ nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif)
  * @return ERR_OK if succeeded, ERR_MEM if out of memory
  */
 static err_t
-nd6_queue_packet(s8_t neighbor_index, struct pbuf *q)
+nd6_queue_packet(s16_t neighbor_index, struct pbuf *q)
 {
   err_t result = ERR_MEM;
   struct pbuf *p;
@@ -1860,7 +2107,7 @@ nd6_free_q(struct nd6_q_entry *q)
  * @param i the neighbor to send packets to
  */
 static void
-nd6_send_q(s8_t i)
+nd6_send_q(s16_t i)
 {
   struct ip6_hdr *ip6hdr;
   ip6_addr_t dest;
@@ -1929,13 +2176,13 @@ nd6_send_q(s8_t i)
 err_t
 nd6_get_next_hop_addr_or_queue(struct netif *netif, struct pbuf *q, const ip6_addr_t *ip6addr, const u8_t **hwaddrp)
 {
-  s8_t i;
+  s16_t i;
 
   /* Get next hop record. */
   i = nd6_get_next_hop_entry(ip6addr, netif);
   if (i < 0) {
     /* failed to get a next hop neighbor record. */
-    return i;
+    return (err_t)i;
   }
 
   /* Now that we have a destination record, send or queue the packet. */
@@ -1947,7 +2194,8 @@ nd6_get_next_hop_addr_or_queue(struct netif *netif, struct pbuf *q, const ip6_ad
   /* @todo should we send or queue if PROBE? send for now, to let unicast NS pass. */
   if ((neighbor_cache[i].state == ND6_REACHABLE) ||
       (neighbor_cache[i].state == ND6_DELAY) ||
-      (neighbor_cache[i].state == ND6_PROBE)) {
+      (neighbor_cache[i].state == ND6_PROBE) ||
+      (neighbor_cache[i].state == ND6_STATIC)) {
 
     /* Tell the caller to send out the packet now. */
     *hwaddrp = neighbor_cache[i].lladdr;
@@ -2000,7 +2248,7 @@ nd6_get_destination_mtu(const ip6_addr_t *ip6addr, struct netif *netif)
 void
 nd6_reachability_hint(const ip6_addr_t *ip6addr)
 {
-  s8_t i;
+  s16_t i;
 
   /* Find destination in cache. */
   if (ip6_addr_cmp(ip6addr, &(destination_cache[nd6_cached_destination_index].destination_addr))) {
@@ -2017,6 +2265,9 @@ nd6_reachability_hint(const ip6_addr_t *ip6addr)
   if (ip6_addr_cmp(&(destination_cache[i].next_hop_addr), &(neighbor_cache[nd6_cached_neighbor_index].next_hop_address))) {
     i = nd6_cached_neighbor_index;
     ND6_STATS_INC(nd6.cachehit);
+#if LWIP_NEIGHBOR_HASH
+    nd6_neighbor_lru_touch(i);
+#endif /* LWIP_NEIGHBOR_HASH */
   } else {
     i = nd6_find_neighbor_cache_entry(&(destination_cache[i].next_hop_addr));
   }
@@ -2028,6 +2279,10 @@ nd6_reachability_hint(const ip6_addr_t *ip6addr)
   if (neighbor_cache[i].state == ND6_INCOMPLETE || neighbor_cache[i].state == ND6_NO_ENTRY) {
     return;
   }
+  /* Static entries stay static. */
+  if (neighbor_cache[i].state == ND6_STATIC) {
+    return;
+  }
 
   /* Set reachability state. */
   neighbor_cache[i].state = ND6_REACHABLE;
@@ -2043,15 +2298,24 @@ nd6_reachability_hint(const ip6_addr_t *ip6addr)
 void
 nd6_cleanup_netif(struct netif *netif)
 {
-  u8_t i;
+  s16_t i;
   s8_t router_index;
+#if LWIP_NEIGHBOR_HASH
+  u16_t next;
+#endif /* LWIP_NEIGHBOR_HASH */
   for (i = 0; i < LWIP_ND6_NUM_PREFIXES; i++) {
     if (prefix_list[i].netif == netif) {
       prefix_list[i].netif = NULL;
       prefix_list[i].flags = 0;
     }
   }
+#if LWIP_NEIGHBOR_HASH
+  for (next = nd6_lru_head; next != 0; ) {
+    i = (s16_t)(next - 1);
+    next = neighbor_cache[i].lru_next;
+#else /* LWIP_NEIGHBOR_HASH */
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
+#endif /* LWIP_NEIGHBOR_HASH */
     if (neighbor_cache[i].netif == netif) {
       for (router_index = 0; router_index < LWIP_ND6_NUM_ROUTERS; router_index++) {
         if (default_router_list[router_index].neighbor_entry == &neighbor_cache[i]) {
@@ -229,7 +229,9 @@ memp_overflow_check_all(void)
 void
 memp_init_pool(const struct memp_desc *desc)
 {
-#if MEMP_MEM_MALLOC
+#if MEMP_MEM_SLAB
+  memp_slab_init(desc);
+#elif MEMP_MEM_MALLOC
   LWIP_UNUSED_ARG(desc);
 #else
   int i;
@@ -287,6 +289,21 @@ memp_init(void)
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
 }
 
+#if MEMP_MEM_SLAB
+/* The slab keeps the statistics itself, so that neither allocating nor
+ * freeing takes SYS_ARCH_PROTECT */
+static void*
+do_memp_malloc_pool(const struct memp_desc *desc)
+{
+  void *mem = memp_slab_alloc(desc);
+  if (mem == NULL) {
+    LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in pool %s\n", desc->desc));
+  }
+  LWIP_ASSERT("memp_malloc: memp properly aligned",
+              ((mem_ptr_t)mem % MEM_ALIGNMENT) == 0);
+  return mem;
+}
+#else /* MEMP_MEM_SLAB */
 static void*
 #if !MEMP_OVERFLOW_CHECK
 do_memp_malloc_pool(const struct memp_desc *desc)
@@ -346,6 +363,7 @@ do_memp_malloc_pool_fn(const struct memp_desc *desc, const char* file, const int
   SYS_ARCH_UNPROTECT(old_level);
   return NULL;
 }
+#endif /* MEMP_MEM_SLAB */
 
 /**
  * Get an element from a custom pool.
@@ -403,6 +421,15 @@ memp_malloc_fn(memp_t type, const char* file, const int line)
   return memp;
 }
 
+#if MEMP_MEM_SLAB
+static void
+do_memp_free_pool(const struct memp_desc* desc, void *mem)
+{
+  LWIP_ASSERT("memp_free: mem properly aligned",
+                ((mem_ptr_t)mem % MEM_ALIGNMENT) == 0);
+  memp_slab_free(desc, mem);
+}
+#else /* MEMP_MEM_SLAB */
 static void
 do_memp_free_pool(const struct memp_desc* desc, void *mem)
 {
@@ -441,6 +468,7 @@ do_memp_free_pool(const struct memp_desc* desc, void *mem)
   SYS_ARCH_UNPROTECT(old_level);
 #endif /* !MEMP_MEM_MALLOC */
 }
+#endif /* MEMP_MEM_SLAB */
 
 /**
  * Put a custom pool element back into its pool.
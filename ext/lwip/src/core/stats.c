@@ -100,6 +100,21 @@ stats_display_igmp(struct stats_igmp *igmp, const char *name)
 }
 #endif /* IGMP_STATS || MLD6_STATS */
 
+#if LWIP_NEIGHBOR_HASH && (ETHARP_STATS || ND6_STATS)
+void
+stats_display_nbr(struct stats_nbr *nbr, const char *name)
+{
+  LWIP_PLATFORM_DIAG(("\n%s\n\t", name));
+  LWIP_PLATFORM_DIAG(("lookup: %"STAT_COUNTER_F"\n\t", nbr->lookup));
+  LWIP_PLATFORM_DIAG(("hit: %"STAT_COUNTER_F"\n\t", nbr->hit));
+  LWIP_PLATFORM_DIAG(("insert: %"STAT_COUNTER_F"\n\t", nbr->insert));
+  LWIP_PLATFORM_DIAG(("evict: %"STAT_COUNTER_F"\n\t", nbr->evict));
+  LWIP_PLATFORM_DIAG(("full: %"STAT_COUNTER_F"\n\t", nbr->full));
+  LWIP_PLATFORM_DIAG(("used: %"STAT_COUNTER_F"\n\t", nbr->used));
+  LWIP_PLATFORM_DIAG(("max: %"STAT_COUNTER_F"\n", nbr->max));
+}
+#endif /* LWIP_NEIGHBOR_HASH && (ETHARP_STATS || ND6_STATS) */
+
 #if MEM_STATS || MEMP_STATS
 void
 stats_display_mem(struct stats_mem *mem, const char *name)
@@ -146,10 +161,12 @@ stats_display(void)
 
   LINK_STATS_DISPLAY();
   ETHARP_STATS_DISPLAY();
+  ETHARP_CACHE_STATS_DISPLAY();
   IPFRAG_STATS_DISPLAY();
   IP6_FRAG_STATS_DISPLAY();
   IP_STATS_DISPLAY();
   ND6_STATS_DISPLAY();
+  ND6_CACHE_STATS_DISPLAY();
   IP6_STATS_DISPLAY();
   IGMP_STATS_DISPLAY();
   MLD6_STATS_DISPLAY();
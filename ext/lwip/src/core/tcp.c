@@ -108,6 +108,10 @@ static u16_t tcp_port = TCP_LOCAL_PORT_RANGE_START;
 
 /* Incremented every coarse grained timer shot (typically every 500 ms). */
 u32_t tcp_ticks;
+/* Receive window and send buffer new PCBs start with, TCP_WND and TCP_SND_BUF
+   unless lowered by tcp_set_default_bufs() */
+tcpwnd_size_t tcp_default_wnd = TCP_WND;
+tcpwnd_size_t tcp_default_snd_buf = TCP_SND_BUF;
 static const u8_t tcp_backoff[13] =
     { 1, 2, 3, 4, 5, 6, 7, 7, 7, 7, 7, 7, 7};
  /* Times per slowtmr hits */
@@ -131,6 +135,90 @@ struct tcp_pcb ** const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcb
 
 u8_t tcp_active_pcbs_changed;
 
+#if TCP_PCB_HASH
+#if (TCP_PCB_HASH_SIZE & (TCP_PCB_HASH_SIZE - 1)) != 0
+#error "TCP_PCB_HASH_SIZE must be a power of two"
+#endif
+
+struct tcp_pcb *tcp_active_hash[TCP_PCB_HASH_SIZE];
+struct tcp_pcb *tcp_tw_hash[TCP_PCB_HASH_SIZE];
+struct tcp_pcb *tcp_listen_hash[TCP_PCB_HASH_SIZE];
+
+static u32_t
+tcp_hash_ip(const ip_addr_t *ip)
+{
+#if LWIP_IPV6
+  if (IP_IS_V6(ip)) {
+    const u32_t *a = ip_2_ip6(ip)->addr;
+    return a[0] ^ a[1] ^ a[2] ^ a[3];
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  return ip4_addr_get_u32(ip_2_ip4(ip));
+#else /* LWIP_IPV4 */
+  return 0;
+#endif /* LWIP_IPV4 */
+}
+
+/**
+ * Bucket of a connection in tcp_active_hash/tcp_tw_hash. Equal for any two
+ * 4-tuples that tcp_input() considers the same connection (ip_addr_cmp).
+ */
+u32_t
+tcp_pcb_hash(const ip_addr_t *local_ip, u16_t local_port,
+             const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h = tcp_hash_ip(remote_ip);
+  h = (h ^ (h >> 16)) * 0x45d9f3b;
+  h ^= tcp_hash_ip(local_ip);
+  h = (h ^ (h >> 16)) * 0x45d9f3b;
+  h ^= ((u32_t)remote_port << 16) | local_port;
+  h = (h ^ (h >> 16)) * 0x45d9f3b;
+  return (h ^ (h >> 16)) & (TCP_PCB_HASH_SIZE - 1);
+}
+
+/* hash table mirroring a PCB list, NULL for tcp_bound_pcbs (never demuxed) */
+static struct tcp_pcb **
+tcp_pcb_hash_bucket(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  if (pcblist == &tcp_active_pcbs) {
+    return &tcp_active_hash[tcp_pcb_hash(&pcb->local_ip, pcb->local_port, &pcb->remote_ip, pcb->remote_port)];
+  } else if (pcblist == &tcp_tw_pcbs) {
+    return &tcp_tw_hash[tcp_pcb_hash(&pcb->local_ip, pcb->local_port, &pcb->remote_ip, pcb->remote_port)];
+  } else if (pcblist == &tcp_listen_pcbs.pcbs) {
+    return &tcp_listen_hash[TCP_LISTEN_HASH(pcb->local_port)];
+  }
+  return NULL;
+}
+
+/** Add a PCB that was just registered with pcblist to its hash table */
+void
+tcp_pcb_hash_add(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **bucket = tcp_pcb_hash_bucket(pcblist, pcb);
+  if (bucket != NULL) {
+    pcb->hash_next = *bucket;
+    *bucket = pcb;
+  }
+}
+
+/** Remove a PCB that was just unlinked from pcblist from its hash table */
+void
+tcp_pcb_hash_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **bucket = tcp_pcb_hash_bucket(pcblist, pcb);
+  if (bucket != NULL) {
+    for (; *bucket != NULL; bucket = &(*bucket)->hash_next) {
+      if (*bucket == pcb) {
+        *bucket = pcb->hash_next;
+        break;
+      }
+    }
+    pcb->hash_next = NULL;
+  }
+}
+#endif /* TCP_PCB_HASH */
+
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
 static u8_t tcp_timer;
 static u8_t tcp_timer_ctr;
@@ -760,7 +848,7 @@ tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
 {
   u32_t new_right_edge = pcb->rcv_nxt + pcb->rcv_wnd;
 
-  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((TCP_WND / 2), pcb->mss))) {
+  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((tcp_default_wnd / 2), pcb->mss))) {
     /* we can advertise more window */
     pcb->rcv_ann_wnd = pcb->rcv_wnd;
     return new_right_edge - pcb->rcv_ann_right_edge;
@@ -943,7 +1031,7 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   pcb->snd_lbb = iss - 1;
   /* Start with a window that does not need scaling. When window scaling is
      enabled and used, the window is enlarged when both sides agree on scaling. */
-  pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_WND);
+  pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(tcp_default_wnd);
   pcb->rcv_ann_right_edge = pcb->rcv_nxt;
   pcb->snd_wnd = TCP_WND;
   /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -1070,6 +1158,7 @@ tcp_slowtmr_start:
             pcb->ssthresh = (pcb->mss << 1);
           }
           pcb->cwnd = pcb->mss;
+          pcb->bytes_acked = 0;
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
                                        " ssthresh %"TCPWNDSIZE_F"\n",
                                        pcb->cwnd, pcb->ssthresh));
@@ -1165,6 +1254,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_active_pcbs", tcp_active_pcbs == pcb);
         tcp_active_pcbs = pcb->next;
       }
+      TCP_HASH_RMV(&tcp_active_pcbs, pcb);
 
       if (pcb_reset) {
         tcp_rst(pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
@@ -1231,6 +1321,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_tw_pcbs", tcp_tw_pcbs == pcb);
         tcp_tw_pcbs = pcb->next;
       }
+      TCP_HASH_RMV(&tcp_tw_pcbs, pcb);
       pcb2 = pcb;
       pcb = pcb->next;
       memp_free(MEMP_TCP_PCB, pcb2);
@@ -1412,6 +1503,25 @@ tcp_setprio(struct tcp_pcb *pcb, u8_t prio)
   pcb->prio = prio;
 }
 
+/**
+ * Sets the receive window and send buffer that connections created from
+ * now on start with. TCP_WND and TCP_SND_BUF are the upper bounds, values
+ * are raised to at least TCP_MSS and 2 * TCP_MSS respectively (the send
+ * buffer also to twice TCP_SNDLOWAT, so that it can become writable again).
+ * Should be called before any connection exists, the largest window of
+ * existing connections (TCP_WND_MAX) changes as well.
+ *
+ * @param wnd receive window in bytes
+ * @param snd_buf send buffer in bytes
+ */
+void
+tcp_set_default_bufs(tcpwnd_size_t wnd, tcpwnd_size_t snd_buf)
+{
+  tcp_default_wnd = (tcpwnd_size_t)LWIP_MAX(TCP_MSS, LWIP_MIN(wnd, TCP_WND));
+  tcp_default_snd_buf = (tcpwnd_size_t)LWIP_MAX(LWIP_MAX(2 * TCP_MSS, 2 * TCP_SNDLOWAT),
+                                                LWIP_MIN(snd_buf, TCP_SND_BUF));
+}
+
 #if TCP_QUEUE_OOSEQ
 /**
  * Returns a copy of the given TCP segment.
@@ -1605,10 +1715,10 @@ tcp_alloc(u8_t prio)
     /* zero out the whole pcb, so there is no need to initialize members to zero */
     memset(pcb, 0, sizeof(struct tcp_pcb));
     pcb->prio = prio;
-    pcb->snd_buf = TCP_SND_BUF;
+    pcb->snd_buf = tcp_default_snd_buf;
     /* Start with a window that does not need scaling. When window scaling is
        enabled and used, the window is enlarged when both sides agree on scaling. */
-    pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_WND);
+    pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(tcp_default_wnd);
     pcb->ttl = TCP_TTL;
     /* As initial send MSS, we use TCP_MSS but limit it to 536.
        The send MSS is updated when an MSS option is received. */
@@ -1626,7 +1736,7 @@ tcp_alloc(u8_t prio)
     initial advertised window is very small and then grows rapidly once the
     connection is established. To avoid these complications, we set ssthresh to the
     largest effective cwnd (amount of in-flight data) that the sender can have. */
-    pcb->ssthresh = TCP_SND_BUF;
+    pcb->ssthresh = tcp_default_snd_buf;
 
 #if LWIP_CALLBACK_API
     pcb->recv = tcp_recv_null;
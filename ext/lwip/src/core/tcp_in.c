@@ -58,6 +58,9 @@
 #if LWIP_ND6_TCP_REACHABILITY_HINTS
 #include "lwip/nd6.h"
 #endif /* LWIP_ND6_TCP_REACHABILITY_HINTS */
+#if LWIP_TCP_TIMESTAMPS
+#include "lwip/sys.h"
+#endif
 
 /** Initial CWND calculation as defined RFC 2581 */
 #define LWIP_TCP_CALC_INITIAL_CWND(mss) LWIP_MIN((4U * (mss)), LWIP_MAX((2U * (mss)), 4380U));
@@ -79,12 +82,25 @@ static u8_t flags;
 static u8_t recv_flags;
 static struct pbuf *recv_data;
 
+#if LWIP_TCP_TIMESTAMPS
+/* TSecr of the incoming segment, 0 if it had none */
+static u32_t tcp_ts_ecr;
+#endif /* LWIP_TCP_TIMESTAMPS */
+#if LWIP_TCP_SACK
+/* SACK blocks of the incoming segment (left and right edge of each) */
+static u32_t tcp_sack_blocks[2 * LWIP_TCP_SACK_MAX_BLOCKS];
+static u8_t tcp_sack_num;
+#endif /* LWIP_TCP_SACK */
+
 struct tcp_pcb *tcp_input_pcb;
 
 /* Forward declarations. */
 static err_t tcp_process(struct tcp_pcb *pcb);
 static void tcp_receive(struct tcp_pcb *pcb);
 static void tcp_parseopt(struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK
+static void tcp_sack_mark(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
 
 static void tcp_listen_input(struct tcp_pcb_listen *pcb);
 static void tcp_timewait_input(struct tcp_pcb *pcb);
@@ -103,13 +119,21 @@ static int tcp_input_delayed_close(struct tcp_pcb *pcb);
 void
 tcp_input(struct pbuf *p, struct netif *inp)
 {
-  struct tcp_pcb *pcb, *prev;
+  struct tcp_pcb *pcb;
   struct tcp_pcb_listen *lpcb;
+#if !TCP_PCB_HASH
+  struct tcp_pcb *prev;
 #if SO_REUSE
   struct tcp_pcb *lpcb_prev = NULL;
+#endif /* SO_REUSE */
+#endif /* !TCP_PCB_HASH */
+#if SO_REUSE
   struct tcp_pcb_listen *lpcb_any = NULL;
 #endif /* SO_REUSE */
   u8_t hdrlen_bytes;
+#if TCP_PCB_HASH
+  u32_t hash;
+#endif /* TCP_PCB_HASH */
   err_t err;
 
   LWIP_UNUSED_ARG(inp);
@@ -220,8 +244,21 @@ tcp_input(struct pbuf *p, struct netif *inp)
 
   /* Demultiplex an incoming segment. First, we check if it is destined
      for an active connection. */
+#if TCP_PCB_HASH
+  hash = tcp_pcb_hash(ip_current_dest_addr(), tcphdr->dest, ip_current_src_addr(), tcphdr->src);
+  for (pcb = tcp_active_hash[hash]; pcb != NULL; pcb = pcb->hash_next) {
+    LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
+    LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
+    LWIP_ASSERT("tcp_input: active pcb->state != LISTEN", pcb->state != LISTEN);
+    if (pcb->remote_port == tcphdr->src &&
+        pcb->local_port == tcphdr->dest &&
+        ip_addr_cmp(&pcb->remote_ip, ip_current_src_addr()) &&
+        ip_addr_cmp(&pcb->local_ip, ip_current_dest_addr())) {
+      break;
+    }
+  }
+#else /* TCP_PCB_HASH */
   prev = NULL;
-
   for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
@@ -246,11 +283,16 @@ tcp_input(struct pbuf *p, struct netif *inp)
     }
     prev = pcb;
   }
+#endif /* TCP_PCB_HASH */
 
   if (pcb == NULL) {
     /* If it did not go to an active connection, we check the connections
        in the TIME-WAIT state. */
+#if TCP_PCB_HASH
+    for (pcb = tcp_tw_hash[hash]; pcb != NULL; pcb = pcb->hash_next) {
+#else /* TCP_PCB_HASH */
     for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* TCP_PCB_HASH */
       LWIP_ASSERT("tcp_input: TIME-WAIT pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
       if (pcb->remote_port == tcphdr->src &&
           pcb->local_port == tcphdr->dest &&
@@ -268,14 +310,21 @@ tcp_input(struct pbuf *p, struct netif *inp)
 
     /* Finally, if we still did not get a match, we check all PCBs that
        are LISTENing for incoming connections. */
+#if TCP_PCB_HASH
+    for (lpcb = (struct tcp_pcb_listen *)tcp_listen_hash[TCP_LISTEN_HASH(tcphdr->dest)];
+         lpcb != NULL; lpcb = lpcb->hash_next) {
+#else /* TCP_PCB_HASH */
     prev = NULL;
     for (lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
+#endif /* TCP_PCB_HASH */
       if (lpcb->local_port == tcphdr->dest) {
         if (IP_IS_ANY_TYPE_VAL(lpcb->local_ip)) {
           /* found an ANY TYPE (IPv4/IPv6) match */
 #if SO_REUSE
           lpcb_any = lpcb;
+#if !TCP_PCB_HASH
           lpcb_prev = prev;
+#endif /* !TCP_PCB_HASH */
 #else /* SO_REUSE */
           break;
 #endif /* SO_REUSE */
@@ -287,24 +336,31 @@ tcp_input(struct pbuf *p, struct netif *inp)
             /* found an ANY-match */
 #if SO_REUSE
             lpcb_any = lpcb;
+#if !TCP_PCB_HASH
             lpcb_prev = prev;
+#endif /* !TCP_PCB_HASH */
 #else /* SO_REUSE */
             break;
  #endif /* SO_REUSE */
           }
         }
       }
+#if !TCP_PCB_HASH
       prev = (struct tcp_pcb *)lpcb;
+#endif /* !TCP_PCB_HASH */
     }
 #if SO_REUSE
     /* first try specific local IP */
     if (lpcb == NULL) {
       /* only pass to ANY if no specific local IP has been found */
       lpcb = lpcb_any;
+#if !TCP_PCB_HASH
       prev = lpcb_prev;
+#endif /* !TCP_PCB_HASH */
     }
 #endif /* SO_REUSE */
     if (lpcb != NULL) {
+#if !TCP_PCB_HASH
       /* Move this PCB to the front of the list so that subsequent
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
@@ -317,6 +373,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
       } else {
         TCP_STATS_INC(tcp.cachehit);
       }
+#endif /* !TCP_PCB_HASH */
 
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for LISTENing connection.\n"));
       tcp_listen_input(lpcb);
@@ -1022,8 +1079,12 @@ tcp_receive(struct tcp_pcb *pcb)
   s32_t off;
   s16_t m;
   u32_t right_wnd_edge;
+  tcpwnd_size_t acked;
   u16_t new_tot_len;
   int found_dupack = 0;
+#if LWIP_TCP_SACK
+  int sack_rexmit = 0;
+#endif /* LWIP_TCP_SACK */
 #if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
   u32_t ooseq_blen;
   u16_t ooseq_qlen;
@@ -1102,6 +1163,13 @@ tcp_receive(struct tcp_pcb *pcb)
               if ((u8_t)(pcb->dupacks + 1) > pcb->dupacks) {
                 ++pcb->dupacks;
               }
+#if LWIP_TCP_SACK
+              if ((pcb->flags & (TF_SACK | TF_INFR)) == (TF_SACK | TF_INFR)) {
+                /* Each dupack in recovery means a segment has left the
+                   network: send the next hole in its place (below). */
+                sack_rexmit = 1;
+              } else
+#endif /* LWIP_TCP_SACK */
               if (pcb->dupacks > 3) {
                 /* Inflate the congestion window, but not if it means that
                    the value overflows. */
@@ -1128,8 +1196,18 @@ tcp_receive(struct tcp_pcb *pcb)
          in fast retransmit. Also reset the congestion window to the
          slow start threshold. */
       if (pcb->flags & TF_INFR) {
-        pcb->flags &= ~TF_INFR;
-        pcb->cwnd = pcb->ssthresh;
+#if LWIP_TCP_SACK
+        if ((pcb->flags & TF_SACK) && TCP_SEQ_LT(ackno, pcb->recover)) {
+          /* A partial ACK: more of the window was lost, stay in fast
+             recovery and retransmit the next hole below. */
+          sack_rexmit = 1;
+        } else
+#endif /* LWIP_TCP_SACK */
+        {
+          pcb->flags &= ~TF_INFR;
+          pcb->cwnd = pcb->ssthresh;
+          pcb->bytes_acked = 0;
+        }
       }
 
       /* Reset the number of retransmissions. */
@@ -1140,20 +1218,27 @@ tcp_receive(struct tcp_pcb *pcb)
 
       /* Reset the fast retransmit variables. */
       pcb->dupacks = 0;
+      acked = (tcpwnd_size_t)(ackno - pcb->lastack);
       pcb->lastack = ackno;
 
       /* Update the congestion control variables (cwnd and
-         ssthresh). */
-      if (pcb->state >= ESTABLISHED) {
+         ssthresh). The increase follows the bytes acknowledged rather
+         than the number of ACKs (RFC 3465), so that delayed ACKs don't
+         halve the growth of the window. */
+      if ((pcb->state >= ESTABLISHED) && !(pcb->flags & TF_INFR)) {
         if (pcb->cwnd < pcb->ssthresh) {
-          if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
-            pcb->cwnd += pcb->mss;
+          tcpwnd_size_t increase = LWIP_MIN(acked, (tcpwnd_size_t)(2 * pcb->mss));
+          if ((tcpwnd_size_t)(pcb->cwnd + increase) > pcb->cwnd) {
+            pcb->cwnd += increase;
           }
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         } else {
-          tcpwnd_size_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
-          if (new_cwnd > pcb->cwnd) {
-            pcb->cwnd = new_cwnd;
+          pcb->bytes_acked += acked;
+          if (pcb->bytes_acked >= pcb->cwnd) {
+            pcb->bytes_acked -= pcb->cwnd;
+            if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+              pcb->cwnd += pcb->mss;
+            }
           }
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         }
@@ -1213,6 +1298,19 @@ tcp_receive(struct tcp_pcb *pcb)
       tcp_send_empty_ack(pcb);
     }
 
+#if LWIP_TCP_SACK
+    if ((pcb->flags & TF_SACK) && (tcp_sack_num > 0)) {
+      tcp_sack_mark(pcb);
+    }
+    if (sack_rexmit && (pcb->flags & (TF_SACK | TF_INFR)) == (TF_SACK | TF_INFR)) {
+      if (!tcp_rexmit_sack(pcb) && found_dupack &&
+          ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd)) {
+        /* No hole left to fill, inflate the window to send new data instead */
+        pcb->cwnd += pcb->mss;
+      }
+    }
+#endif /* LWIP_TCP_SACK */
+
     /* We go through the ->unsent list to see if any of the segments
        on the list are acknowledged by the ACK. This may seem
        strange since an "unsent" segment shouldn't be acked. The
@@ -1254,11 +1352,24 @@ tcp_receive(struct tcp_pcb *pcb)
     /* RTT estimation calculations. This is done by checking if the
        incoming segment acknowledges the segment we use to take a
        round-trip time measurement. */
-    if (pcb->rttest && TCP_SEQ_LT(pcb->rtseq, ackno)) {
+    m = -1;
+#if LWIP_TCP_TIMESTAMPS
+    /* With timestamps, every ACK for new data echoes when the data it
+       acknowledges was sent (RFC 7323). The sample is rounded up to whole
+       ticks, so the RTO never drops below one tick. */
+    if ((pcb->flags & TF_TIMESTAMP) && (tcp_ts_ecr != 0) && (recv_acked > 0)) {
+      u32_t rtt = sys_now() - tcp_ts_ecr;
+      if (rtt < 0x7fffU * TCP_SLOW_INTERVAL) {
+        m = (s16_t)((rtt + TCP_SLOW_INTERVAL - 1) / TCP_SLOW_INTERVAL);
+      }
+    }
+#endif /* LWIP_TCP_TIMESTAMPS */
+    if ((m < 0) && pcb->rttest && TCP_SEQ_LT(pcb->rtseq, ackno)) {
       /* diff between this shouldn't exceed 32K since this are tcp timer ticks
          and a round-trip shouldn't be that long... */
       m = (s16_t)(tcp_ticks - pcb->rttest);
-
+    }
+    if (m >= 0) {
       LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: experienced rtt %"U16_F" ticks (%"U16_F" msec).\n",
                                   m, (u16_t)(m * TCP_SLOW_INTERVAL)));
 
@@ -1543,7 +1654,13 @@ tcp_receive(struct tcp_pcb *pcb)
 
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
+#if LWIP_TCP_SACK
+        /* The ACK is sent once the segment is queued, so that its SACK
+           blocks include it. */
+        pcb->rcv_sack_last = seqno;
+#else /* LWIP_TCP_SACK */
         tcp_send_empty_ack(pcb);
+#endif /* LWIP_TCP_SACK */
 #if TCP_QUEUE_OOSEQ
         /* We queue the segment on the ->ooseq queue. */
         if (pcb->ooseq == NULL) {
@@ -1691,6 +1808,9 @@ tcp_receive(struct tcp_pcb *pcb)
         }
 #endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
 #endif /* TCP_QUEUE_OOSEQ */
+#if LWIP_TCP_SACK
+        tcp_send_empty_ack(pcb);
+#endif /* LWIP_TCP_SACK */
       }
     } else {
       /* The incoming segment is not within the window. */
@@ -1705,6 +1825,43 @@ tcp_receive(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_SACK
+/**
+ * Marks the segments on pcb->unacked that the SACK blocks of the incoming
+ * segment report as received, so that tcp_rexmit_sack() skips them.
+ *
+ * Called from tcp_receive().
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ */
+static void
+tcp_sack_mark(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t left, right, seg_left;
+  u8_t i;
+
+  for (i = 0; i < tcp_sack_num; i++) {
+    left = tcp_sack_blocks[2 * i];
+    right = tcp_sack_blocks[2 * i + 1];
+    /* ignore blocks below the cumulative ACK (D-SACK) or beyond what was sent */
+    if (!TCP_SEQ_LT(left, right) || TCP_SEQ_LEQ(left, pcb->lastack) ||
+        TCP_SEQ_GT(right, pcb->snd_nxt)) {
+      continue;
+    }
+    for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+      seg_left = lwip_ntohl(seg->tcphdr->seqno);
+      if (TCP_SEQ_GEQ(seg_left, right)) {
+        break;
+      }
+      if (TCP_SEQ_GEQ(seg_left, left) && TCP_SEQ_LEQ(seg_left + TCP_TCPLEN(seg), right)) {
+        seg->flags |= TF_SEG_SACKED;
+      }
+    }
+  }
+}
+#endif /* LWIP_TCP_SACK */
+
 static u8_t
 tcp_getoptbyte(void)
 {
@@ -1717,6 +1874,19 @@ tcp_getoptbyte(void)
   }
 }
 
+#if LWIP_TCP_TIMESTAMPS || LWIP_TCP_SACK
+/* Reads a 32 bit option field (in network byte order) */
+static u32_t
+tcp_getoptword(void)
+{
+  u32_t word = tcp_getoptbyte();
+  word = (word << 8) | tcp_getoptbyte();
+  word = (word << 8) | tcp_getoptbyte();
+  word = (word << 8) | tcp_getoptbyte();
+  return word;
+}
+#endif /* LWIP_TCP_TIMESTAMPS || LWIP_TCP_SACK */
+
 /**
  * Parses the options contained in the incoming segment.
  *
@@ -1734,6 +1904,12 @@ tcp_parseopt(struct tcp_pcb *pcb)
   u32_t tsval;
 #endif
 
+#if LWIP_TCP_TIMESTAMPS
+  tcp_ts_ecr = 0;
+#endif
+#if LWIP_TCP_SACK
+  tcp_sack_num = 0;
+#endif
   /* Parse the TCP MSS option, if present. */
   if (tcphdr_optlen != 0) {
     for (tcp_optidx = 0; tcp_optidx < tcphdr_optlen; ) {
@@ -1780,9 +1956,9 @@ tcp_parseopt(struct tcp_pcb *pcb)
           pcb->rcv_scale = TCP_RCV_SCALE;
           pcb->flags |= TF_WND_SCALE;
           /* window scaling is enabled, we can use the full receive window */
-          LWIP_ASSERT("window not at default value", pcb->rcv_wnd == TCPWND_MIN16(TCP_WND));
-          LWIP_ASSERT("window not at default value", pcb->rcv_ann_wnd == TCPWND_MIN16(TCP_WND));
-          pcb->rcv_wnd = pcb->rcv_ann_wnd = TCP_WND;
+          LWIP_ASSERT("window not at default value", pcb->rcv_wnd == TCPWND_MIN16(tcp_default_wnd));
+          LWIP_ASSERT("window not at default value", pcb->rcv_ann_wnd == TCPWND_MIN16(tcp_default_wnd));
+          pcb->rcv_wnd = pcb->rcv_ann_wnd = tcp_default_wnd;
         }
         break;
 #endif
@@ -1807,8 +1983,40 @@ tcp_parseopt(struct tcp_pcb *pcb)
         } else if (TCP_SEQ_BETWEEN(pcb->ts_lastacksent, seqno, seqno+tcplen)) {
           pcb->ts_recent = lwip_ntohl(tsval);
         }
-        /* Advance to next option (6 bytes already read) */
-        tcp_optidx += LWIP_TCP_OPT_LEN_TS - 6;
+        /* TSecr echoes our clock from when the acknowledged data was sent */
+        tcp_ts_ecr = tcp_getoptword();
+        break;
+#endif
+#if LWIP_TCP_SACK
+      case LWIP_TCP_OPT_SACK_PERM:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK_PERM\n"));
+        if (tcp_getoptbyte() != LWIP_TCP_OPT_LEN_SACK_PERM || (tcp_optidx - 2 + LWIP_TCP_OPT_LEN_SACK_PERM) > tcphdr_optlen) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        if (flags & TCP_SYN) {
+          /* We offer SACK in every SYN, so both sides agreed on it */
+          pcb->flags |= TF_SACK;
+        }
+        break;
+      case LWIP_TCP_OPT_SACK:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+        data = tcp_getoptbyte();
+        if (data < 10 || ((data - 2) % 8) != 0 || (tcp_optidx - 2 + data) > tcphdr_optlen) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        for (data = (u8_t)((data - 2) / 8); data > 0; data--) {
+          u32_t left = tcp_getoptword();
+          u32_t right = tcp_getoptword();
+          if (tcp_sack_num < LWIP_TCP_SACK_MAX_BLOCKS) {
+            tcp_sack_blocks[2 * tcp_sack_num] = left;
+            tcp_sack_blocks[2 * tcp_sack_num + 1] = right;
+            tcp_sack_num++;
+          }
+        }
         break;
 #endif
       default:
@@ -813,11 +813,17 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
       optflags |= TF_SEG_OPTS_WND_SCALE;
     }
 #endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_SACK)) {
+      /* Same as window scaling: only answer a SACK permitted option */
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK */
   }
 #if LWIP_TCP_TIMESTAMPS
-  if ((pcb->flags & TF_TIMESTAMP)) {
+  if ((pcb->flags & TF_TIMESTAMP) || ((flags & TCP_SYN) && (pcb->state != SYN_RCVD))) {
     /* Make sure the timestamp option is only included in data segments if we
-       agreed about it with the remote host. */
+       agreed about it with the remote host. It is offered in our own SYN. */
     optflags |= TF_SEG_OPTS_TS;
   }
 #endif /* LWIP_TCP_TIMESTAMPS */
@@ -909,6 +915,72 @@ tcp_build_wnd_scale_option(u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK
+/** Collect the runs of contiguous data held on pcb->ooseq as SACK blocks
+ * (RFC 2018), the one holding the latest out-of-sequence segment first.
+ *
+ * @param pcb tcp_pcb
+ * @param blocks where to store the left and right edge of each block
+ * @param max maximum number of blocks to store
+ * @return number of blocks stored
+ */
+static u8_t
+tcp_get_sack_blocks(struct tcp_pcb *pcb, u32_t *blocks, u8_t max)
+{
+  struct tcp_seg *seg;
+  u32_t left, right;
+  u8_t num = 1;
+  u8_t i;
+
+  /* blocks[0] and blocks[1] are kept for the block holding rcv_sack_last */
+  blocks[0] = blocks[1] = 0;
+  seg = pcb->ooseq;
+  while (seg != NULL) {
+    left = seg->tcphdr->seqno;
+    right = left + TCP_TCPLEN(seg);
+    for (seg = seg->next; seg != NULL && TCP_SEQ_LEQ(seg->tcphdr->seqno, right); seg = seg->next) {
+      if (TCP_SEQ_GT(seg->tcphdr->seqno + TCP_TCPLEN(seg), right)) {
+        right = seg->tcphdr->seqno + TCP_TCPLEN(seg);
+      }
+    }
+    if (TCP_SEQ_BETWEEN(pcb->rcv_sack_last, left, right - 1)) {
+      blocks[0] = left;
+      blocks[1] = right;
+    } else if (num < max) {
+      blocks[2 * num] = left;
+      blocks[2 * num + 1] = right;
+      num++;
+    }
+  }
+  if (blocks[0] == blocks[1]) {
+    /* the latest segment is no longer queued, move the others up */
+    for (i = 2; i < 2 * num; i++) {
+      blocks[i - 2] = blocks[i];
+    }
+    num--;
+  }
+  return num;
+}
+
+/** Build a SACK option (2 + 8 * num bytes long) at the specified options pointer
+ *
+ * @param blocks left and right edge of each block
+ * @param num number of blocks
+ * @param opts option pointer where to store the SACK option
+ */
+static void
+tcp_build_sack_option(const u32_t *blocks, u8_t num, u32_t *opts)
+{
+  u8_t i;
+
+  /* Pad with two NOP options to make everything nicely aligned */
+  opts[0] = lwip_htonl(0x01010500 | (LWIP_TCP_OPT_LEN_SACK_OUT(num) - 2));
+  for (i = 0; i < 2 * num; i++) {
+    opts[1 + i] = lwip_htonl(blocks[i]);
+  }
+}
+#endif /* LWIP_TCP_SACK */
+
 /**
  * Send an ACK without data.
  *
@@ -921,15 +993,26 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   struct pbuf *p;
   u8_t optlen = 0;
   struct netif *netif;
-#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP
+#if LWIP_TCP_TIMESTAMPS || LWIP_TCP_SACK || CHECKSUM_GEN_TCP
   struct tcp_hdr *tcphdr;
-#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP */
+#endif /* LWIP_TCP_TIMESTAMPS || LWIP_TCP_SACK || CHECKSUM_GEN_TCP */
+#if LWIP_TCP_SACK
+  u32_t sack_blocks[2 * LWIP_TCP_SACK_MAX_BLOCKS];
+  u8_t sack_num = 0;
+#endif /* LWIP_TCP_SACK */
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK
+  if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+    /* 40 bytes of options hold 4 blocks, or 3 next to a timestamp */
+    sack_num = tcp_get_sack_blocks(pcb, sack_blocks, (optlen != 0) ? 3 : 4);
+    optlen += LWIP_TCP_OPT_LEN_SACK_OUT(sack_num);
+  }
+#endif /* LWIP_TCP_SACK */
 
   p = tcp_output_alloc_header(pcb, optlen, 0, lwip_htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -938,9 +1021,9 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: (ACK) could not allocate pbuf\n"));
     return ERR_BUF;
   }
-#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP
+#if LWIP_TCP_TIMESTAMPS || LWIP_TCP_SACK || CHECKSUM_GEN_TCP
   tcphdr = (struct tcp_hdr *)p->payload;
-#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP */
+#endif /* LWIP_TCP_TIMESTAMPS || LWIP_TCP_SACK || CHECKSUM_GEN_TCP */
   LWIP_DEBUGF(TCP_OUTPUT_DEBUG,
               ("tcp_output: sending ACK for %"U32_F"\n", pcb->rcv_nxt));
 
@@ -952,6 +1035,13 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
     tcp_build_timestamp_option(pcb, (u32_t *)(tcphdr + 1));
   }
 #endif
+#if LWIP_TCP_SACK
+  if (sack_num > 0) {
+    /* the SACK option comes last, after the timestamp if there is one */
+    tcp_build_sack_option(sack_blocks, sack_num,
+      (u32_t *)((u8_t *)(tcphdr + 1) + optlen - LWIP_TCP_OPT_LEN_SACK_OUT(sack_num)));
+  }
+#endif /* LWIP_TCP_SACK */
 
   netif = ip_route(&pcb->local_ip, &pcb->remote_ip);
   if (netif == NULL) {
@@ -1245,6 +1335,13 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
     opts += 1;
   }
 #endif
+#if LWIP_TCP_SACK
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    /* Pad with two NOP options to make everything nicely aligned */
+    *opts = PP_HTONL(0x01010402);
+    opts += 1;
+  }
+#endif
 
   /* Set retransmission timer running if it is not currently enabled
      This must be set before checking the route. */
@@ -1404,6 +1501,15 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
     return;
   }
 
+#if LWIP_TCP_SACK
+  /* The receiver may discard data it has SACKed (RFC 2018, section 8), so
+     everything is sent again and fast recovery is over. */
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    seg->flags &= ~(TF_SEG_SACKED | TF_SEG_RTX);
+  }
+  pcb->flags &= ~TF_INFR;
+#endif /* LWIP_TCP_SACK */
+
   /* Move all unacked segments to the head of the unsent queue */
   for (seg = pcb->unacked; seg->next != NULL; seg = seg->next);
   /* concatenate unsent queue after unacked queue */
@@ -1489,6 +1595,10 @@ tcp_rexmit(struct tcp_pcb *pcb)
 void
 tcp_rexmit_fast(struct tcp_pcb *pcb)
 {
+#if LWIP_TCP_SACK
+  struct tcp_seg *seg;
+#endif /* LWIP_TCP_SACK */
+
   if (pcb->unacked != NULL && !(pcb->flags & TF_INFR)) {
     /* This is fast retransmit. Retransmit the first unacked segment. */
     LWIP_DEBUGF(TCP_FR_DEBUG,
@@ -1496,6 +1606,17 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  "), fast retransmit %"U32_F"\n",
                  (u16_t)pcb->dupacks, pcb->lastack,
                  lwip_ntohl(pcb->unacked->tcphdr->seqno)));
+#if LWIP_TCP_SACK
+    if (pcb->flags & TF_SACK) {
+      /* Recovery lasts until everything sent so far is acknowledged, and
+         the segment sent now is the first one retransmitted in it. */
+      for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+        seg->flags &= ~TF_SEG_RTX;
+      }
+      pcb->unacked->flags |= TF_SEG_RTX;
+      pcb->recover = pcb->snd_nxt;
+    }
+#endif /* LWIP_TCP_SACK */
     tcp_rexmit(pcb);
 
     /* Set ssthresh to half of the minimum of the current
@@ -1519,6 +1640,58 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_SACK
+/**
+ * Retransmit the next hole reported by SACK during fast recovery
+ *
+ * Called by tcp_receive() for each ACK that arrives in fast recovery. A hole
+ * is the first segment that was neither SACKed nor retransmitted in this
+ * recovery while a later one was SACKed (RFC 6675). It is sent right away, as
+ * it may lie beyond the window tcp_output() sends from.
+ *
+ * @param pcb the tcp_pcb for which to retransmit the next hole
+ * @return 1 if a segment was retransmitted, 0 if there was no hole to fill
+ */
+u8_t
+tcp_rexmit_sack(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg, *hole = NULL;
+  struct netif *netif;
+
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    if (seg->flags & TF_SEG_SACKED) {
+      if (hole != NULL) {
+        break;
+      }
+    } else if ((hole == NULL) && !(seg->flags & TF_SEG_RTX)) {
+      hole = seg;
+    }
+  }
+  if (seg == NULL) {
+    return 0;
+  }
+  if (hole->p->ref != 1) {
+    /* its last transmission is still queued in the netif */
+    return 1;
+  }
+
+  netif = ip_route(&pcb->local_ip, &pcb->remote_ip);
+  if (netif == NULL) {
+    return 1;
+  }
+  LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack: retransmit %"U32_F"\n",
+                             lwip_ntohl(hole->tcphdr->seqno)));
+  if (tcp_output_segment(hole, pcb, netif) == ERR_OK) {
+    hole->flags |= TF_SEG_RTX;
+    MIB2_STATS_INC(mib2.tcpretranssegs);
+  }
+
+  /* Don't take any rtt measurements after retransmitting. */
+  pcb->rttest = 0;
+  return 1;
+}
+#endif /* LWIP_TCP_SACK */
+
 
 /**
  * Send keepalive packets to keep a connection active although
@@ -108,9 +108,43 @@ const struct lwip_cyclic_timer lwip_cyclic_timers[] = {
 
 #if LWIP_TIMERS && !LWIP_TIMERS_CUSTOM
 
+static u32_t timeouts_last_time;
+#if LWIP_TIMERS_WHEEL
+#define TIMEOUTS_WHEEL_MASK       (LWIP_TIMERS_WHEEL_SIZE - 1)
+/* wraparound-safe comparisons of absolute sys_now() times */
+#define TIMEOUTS_BEFORE(a, b)     ((s32_t)((u32_t)(a) - (u32_t)(b)) < 0)
+#define TIMEOUTS_BEFORE_EQ(a, b)  ((s32_t)((u32_t)(a) - (u32_t)(b)) <= 0)
+
+#if (LWIP_TIMERS_WHEEL_SIZE & TIMEOUTS_WHEEL_MASK) != 0
+#error "LWIP_TIMERS_WHEEL_SIZE must be a power of two"
+#endif
+
+/** One slot of the timing wheel: every timeout expiring at a time congruent
+ * to the slot index, in insertion order */
+struct timeouts_slot {
+  struct sys_timeo *head;
+  struct sys_timeo *tail;
+};
+
+/** The timing wheel, indexed by expiry time (1ms per slot) */
+static struct timeouts_slot timeouts_wheel[LWIP_TIMERS_WHEEL_SIZE];
+/** Index of all timeouts by handler/arg, for sys_untimeout() */
+static struct sys_timeo *timeouts_index[LWIP_TIMERS_WHEEL_SIZE];
+static u32_t timeouts_count;
+/** Cached earliest expiry (valid if timeouts_next_valid) */
+static u32_t timeouts_next;
+static u8_t timeouts_next_valid;
+#if !NO_SYS
+/** Set while the tcpip thread is blocked in sys_timeouts_mbox_fetch() */
+static u8_t timeouts_sleeping;
+static u8_t timeouts_sleep_forever;
+static u32_t timeouts_wake_time;
+static sys_mbox_t *timeouts_mbox;
+#endif /* !NO_SYS */
+#else /* LWIP_TIMERS_WHEEL */
 /** The one and only timeout list */
 static struct sys_timeo *next_timeout;
-static u32_t timeouts_last_time;
+#endif /* LWIP_TIMERS_WHEEL */
 
 #if LWIP_TCP
 /** global variable that shows if the tcp timer is currently scheduled or not */
@@ -186,6 +220,380 @@ void sys_timeouts_init(void)
   timeouts_last_time = sys_now();
 }
 
+#if LWIP_TIMERS_WHEEL
+
+static u32_t
+timeouts_hash(sys_timeout_handler handler, void *arg)
+{
+  u32_t h = (u32_t)(mem_ptr_t)handler ^ (u32_t)((mem_ptr_t)arg >> 3);
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return h & TIMEOUTS_WHEEL_MASK;
+}
+
+/* append to the slot of its expiry time so equal expiries fire in FIFO order */
+static void
+timeouts_slot_link(struct sys_timeo *t)
+{
+  struct timeouts_slot *slot = &timeouts_wheel[t->time & TIMEOUTS_WHEEL_MASK];
+  t->next = NULL;
+  t->prev = slot->tail;
+  if (slot->tail != NULL) {
+    slot->tail->next = t;
+  } else {
+    slot->head = t;
+  }
+  slot->tail = t;
+}
+
+static void
+timeouts_slot_unlink(struct sys_timeo *t)
+{
+  struct timeouts_slot *slot = &timeouts_wheel[t->time & TIMEOUTS_WHEEL_MASK];
+  if (t->prev != NULL) {
+    t->prev->next = t->next;
+  } else {
+    slot->head = t->next;
+  }
+  if (t->next != NULL) {
+    t->next->prev = t->prev;
+  } else {
+    slot->tail = t->prev;
+  }
+}
+
+static void
+timeouts_wheel_insert(struct sys_timeo *t)
+{
+  struct sys_timeo **bucket = &timeouts_index[timeouts_hash(t->h, t->arg)];
+
+  timeouts_slot_link(t);
+  t->hprev = NULL;
+  t->hnext = *bucket;
+  if (*bucket != NULL) {
+    (*bucket)->hprev = t;
+  }
+  *bucket = t;
+
+  if (timeouts_count++ == 0) {
+    timeouts_next = t->time;
+    timeouts_next_valid = 1;
+  } else if (timeouts_next_valid && TIMEOUTS_BEFORE(t->time, timeouts_next)) {
+    timeouts_next = t->time;
+  }
+}
+
+static void
+timeouts_wheel_remove(struct sys_timeo *t)
+{
+  timeouts_slot_unlink(t);
+  if (t->hprev != NULL) {
+    t->hprev->hnext = t->hnext;
+  } else {
+    timeouts_index[timeouts_hash(t->h, t->arg)] = t->hnext;
+  }
+  if (t->hnext != NULL) {
+    t->hnext->hprev = t->hprev;
+  }
+  timeouts_count--;
+  if (t->time == timeouts_next) {
+    timeouts_next_valid = 0;
+  }
+}
+
+/* Earliest expiry of all timeouts (timeouts_count must be > 0). Slots are
+ * scanned in time order from timeouts_last_time, so the scan stops at the
+ * first slot holding a timeout due within one revolution of the wheel. */
+static u32_t
+timeouts_wheel_next(void)
+{
+  u32_t i, rel, best = 0xffffffff;
+  struct sys_timeo *t;
+
+  if (timeouts_next_valid) {
+    return timeouts_next;
+  }
+  for (i = 0; i < LWIP_TIMERS_WHEEL_SIZE; i++) {
+    for (t = timeouts_wheel[(timeouts_last_time + i) & TIMEOUTS_WHEEL_MASK].head; t != NULL; t = t->next) {
+      rel = TIMEOUTS_BEFORE(t->time, timeouts_last_time) ? 0 : t->time - timeouts_last_time;
+      if (rel < best) {
+        best = rel;
+      }
+    }
+    if (best <= i) {
+      /* every later slot only holds timeouts due at least i+1 ms from now */
+      break;
+    }
+  }
+  timeouts_next = timeouts_last_time + best;
+  timeouts_next_valid = 1;
+  return timeouts_next;
+}
+
+/**
+ * Create a one-shot timer (aka timeout). Timeouts are processed in the
+ * following cases:
+ * - while waiting for a message using sys_timeouts_mbox_fetch()
+ * - by calling sys_check_timeouts() (NO_SYS==1 only)
+ *
+ * @param msecs time in milliseconds after that the timer should expire
+ * @param handler callback function to call when msecs have elapsed
+ * @param arg argument to pass to the callback function
+ */
+#if LWIP_DEBUG_TIMERNAMES
+void
+sys_timeout_debug(u32_t msecs, sys_timeout_handler handler, void *arg, const char* handler_name)
+#else /* LWIP_DEBUG_TIMERNAMES */
+void
+sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
+#endif /* LWIP_DEBUG_TIMERNAMES */
+{
+  struct sys_timeo *timeout;
+  u32_t now;
+
+  timeout = (struct sys_timeo *)memp_malloc(MEMP_SYS_TIMEOUT);
+  if (timeout == NULL) {
+    LWIP_ASSERT("sys_timeout: timeout != NULL, pool MEMP_SYS_TIMEOUT is empty", timeout != NULL);
+    return;
+  }
+
+  now = sys_now();
+  if (timeouts_count == 0) {
+    /* nothing to catch up on */
+    timeouts_last_time = now;
+  }
+
+  timeout->h = handler;
+  timeout->arg = arg;
+  timeout->time = now + msecs;
+#if LWIP_DEBUG_TIMERNAMES
+  timeout->handler_name = handler_name;
+  LWIP_DEBUGF(TIMERS_DEBUG, ("sys_timeout: %p msecs=%"U32_F" handler=%s arg=%p\n",
+    (void *)timeout, msecs, handler_name, (void *)arg));
+#endif /* LWIP_DEBUG_TIMERNAMES */
+
+  timeouts_wheel_insert(timeout);
+
+#if !NO_SYS
+  /* called from an application thread holding the core lock while the tcpip
+     thread sleeps past this timeout: post an empty message to wake it up */
+  if (timeouts_sleeping &&
+      (timeouts_sleep_forever || TIMEOUTS_BEFORE(timeout->time, timeouts_wake_time))) {
+    timeouts_sleeping = 0;
+    sys_mbox_trypost(timeouts_mbox, NULL);
+  }
+#endif /* !NO_SYS */
+}
+
+/**
+ * Remove the matching timeout that would expire first (others with the same
+ * handler and arg remain untouched), even though it has not triggered yet.
+ *
+ * @param handler callback function that would be called by the timeout
+ * @param arg callback argument that would be passed to handler
+*/
+void
+sys_untimeout(sys_timeout_handler handler, void *arg)
+{
+  struct sys_timeo *t, *match = NULL;
+
+  /* the index is most-recent first: on equal expiries prefer the older entry */
+  for (t = timeouts_index[timeouts_hash(handler, arg)]; t != NULL; t = t->hnext) {
+    if ((t->h == handler) && (t->arg == arg) &&
+        ((match == NULL) || TIMEOUTS_BEFORE_EQ(t->time, match->time))) {
+      match = t;
+    }
+  }
+  if (match != NULL) {
+    timeouts_wheel_remove(match);
+    memp_free(MEMP_SYS_TIMEOUT, match);
+  }
+}
+
+/**
+ * @ingroup lwip_nosys
+ * Handle timeouts for NO_SYS==1 (i.e. without using
+ * tcpip_thread/sys_timeouts_mbox_fetch(). Uses sys_now() to call timeout
+ * handler functions when timeouts expire.
+ *
+ * Must be called periodically from your main loop.
+ */
+#if !NO_SYS && !defined __DOXYGEN__
+static
+#endif /* !NO_SYS */
+void
+sys_check_timeouts(void)
+{
+  struct timeouts_slot *slot;
+  struct sys_timeo *t;
+  sys_timeout_handler handler;
+  void *arg;
+  u32_t now, tick, ticks;
+
+#if !NO_SYS
+  /* For LWIP_TCPIP_CORE_LOCKING, the wheel is shared with application threads
+     calling sys_timeout(), so hold the core lock while walking it and while
+     calling the timeout handler functions. */
+  LOCK_TCPIP_CORE();
+#endif /* !NO_SYS */
+  now = sys_now();
+  ticks = now - timeouts_last_time;
+  tick = timeouts_last_time;
+  if (ticks >= LWIP_TIMERS_WHEEL_SIZE) {
+    /* one revolution visits every slot */
+    tick = now - TIMEOUTS_WHEEL_MASK;
+    ticks = TIMEOUTS_WHEEL_MASK;
+  }
+  /* visit the slots of every elapsed millisecond in order, including now */
+  for (ticks++; ticks > 0 && timeouts_count > 0; ticks--, tick++) {
+    timeouts_last_time = tick;
+    slot = &timeouts_wheel[tick & TIMEOUTS_WHEEL_MASK];
+again:
+    for (t = slot->head; t != NULL; t = t->next) {
+      if (!TIMEOUTS_BEFORE_EQ(t->time, now)) {
+        /* due in a later revolution */
+        continue;
+      }
+      PBUF_CHECK_FREE_OOSEQ();
+      timeouts_wheel_remove(t);
+      handler = t->h;
+      arg = t->arg;
+#if LWIP_DEBUG_TIMERNAMES
+      if (handler != NULL) {
+        LWIP_DEBUGF(TIMERS_DEBUG, ("sct calling h=%s arg=%p\n",
+          t->handler_name, arg));
+      }
+#endif /* LWIP_DEBUG_TIMERNAMES */
+      memp_free(MEMP_SYS_TIMEOUT, t);
+      if (handler != NULL) {
+        handler(arg);
+      }
+      LWIP_TCPIP_THREAD_ALIVE();
+      /* the handler may have changed this slot */
+      goto again;
+    }
+  }
+  timeouts_last_time = now;
+#if !NO_SYS
+  UNLOCK_TCPIP_CORE();
+#endif /* !NO_SYS */
+}
+
+/** Set back the timestamp of the last call to sys_check_timeouts()
+ * This is necessary if sys_check_timeouts() hasn't been called for a long
+ * time (e.g. while saving energy) to prevent all timer functions of that
+ * period being called.
+ */
+void
+sys_restart_timeouts(void)
+{
+  struct sys_timeo *list = NULL, *t, *next;
+  struct timeouts_slot *slot;
+  u32_t i, delta, base;
+
+  base = timeouts_last_time;
+  delta = sys_now() - base;
+  timeouts_last_time += delta;
+  if (delta == 0 || timeouts_count == 0) {
+    return;
+  }
+  /* shift every timeout by the time skipped: they all move to other slots */
+  for (i = 0; i < LWIP_TIMERS_WHEEL_SIZE; i++) {
+    slot = &timeouts_wheel[(base + i) & TIMEOUTS_WHEEL_MASK];
+    for (t = slot->head; t != NULL; t = next) {
+      next = t->next;
+      t->prev = list;
+      list = t;
+    }
+    slot->head = slot->tail = NULL;
+  }
+  /* relink oldest slot first to keep the FIFO order of equal expiries */
+  for (t = list, list = NULL; t != NULL; t = next) {
+    next = t->prev;
+    t->next = list;
+    list = t;
+  }
+  for (t = list; t != NULL; t = next) {
+    next = t->next;
+    t->time += delta;
+    timeouts_slot_link(t);
+  }
+  timeouts_next += delta;
+}
+
+/** Return the time left before the next timeout is due. If no timeouts are
+ * enqueued, returns 0xffffffff
+ */
+#if !NO_SYS
+static
+#endif /* !NO_SYS */
+u32_t
+sys_timeouts_sleeptime(void)
+{
+  u32_t next, now;
+  if (timeouts_count == 0) {
+    return 0xffffffff;
+  }
+  next = timeouts_wheel_next();
+  now = sys_now();
+  if (TIMEOUTS_BEFORE_EQ(next, now)) {
+    return 0;
+  } else {
+    return next - now;
+  }
+}
+
+#if !NO_SYS
+
+/**
+ * Wait (forever) for a message to arrive in an mbox.
+ * While waiting, timeouts are processed.
+ *
+ * @param mbox the mbox to fetch the message from
+ * @param msg the place to store the message
+ */
+void
+sys_timeouts_mbox_fetch(sys_mbox_t *mbox, void **msg)
+{
+  u32_t sleeptime, fetchtime, res;
+
+again:
+  LOCK_TCPIP_CORE();
+  sleeptime = sys_timeouts_sleeptime();
+  if (sleeptime != 0) {
+    /* let sys_timeout() wake us up if it schedules an earlier timeout */
+    timeouts_mbox = mbox;
+    timeouts_sleeping = 1;
+    timeouts_sleep_forever = (sleeptime == 0xffffffff);
+    timeouts_wake_time = sys_now() + sleeptime;
+  }
+  /* the wait is taken from the state above while still holding the lock */
+  fetchtime = timeouts_sleep_forever ? 0 : sleeptime;
+  UNLOCK_TCPIP_CORE();
+
+  if (sleeptime == 0) {
+    sys_check_timeouts();
+    goto again;
+  }
+  res = sys_arch_mbox_fetch(mbox, msg, fetchtime);
+  LOCK_TCPIP_CORE();
+  timeouts_sleeping = 0;
+  UNLOCK_TCPIP_CORE();
+  if (res == SYS_ARCH_TIMEOUT) {
+    sys_check_timeouts();
+    goto again;
+  }
+  if (*msg == NULL) {
+    /* woken up by sys_timeout() */
+    goto again;
+  }
+}
+
+#endif /* NO_SYS */
+
+#else /* LWIP_TIMERS_WHEEL */
+
 /**
  * Create a one-shot timer (aka timeout). Timeouts are processed in the
  * following cases:
@@ -424,6 +832,8 @@ again:
 
 #endif /* NO_SYS */
 
+#endif /* LWIP_TIMERS_WHEEL */
+
 #else /* LWIP_TIMERS && !LWIP_TIMERS_CUSTOM */
 /* Satisfy the TCP code which calls this function */
 void
@@ -120,6 +120,25 @@
 #if !defined LWIP_TIMERS_CUSTOM || defined __DOXYGEN__
 #define LWIP_TIMERS_CUSTOM              0
 #endif
+
+/**
+ * LWIP_TIMERS_WHEEL==1: Keep timeouts in a hashed timing wheel instead of a
+ * delta-sorted list, making sys_timeout() and sys_untimeout() O(1). The tcpip
+ * thread then sleeps until exactly the next expiry and is woken up when another
+ * thread (holding the core lock) schedules an earlier timeout.
+ */
+#if !defined LWIP_TIMERS_WHEEL || defined __DOXYGEN__
+#define LWIP_TIMERS_WHEEL               0
+#endif
+
+/**
+ * LWIP_TIMERS_WHEEL_SIZE: Number of 1ms slots in the timing wheel (and of
+ * buckets in its handler/arg index used by sys_untimeout()). Timeouts further
+ * away than this share slots with nearer ones. Must be a power of two.
+ */
+#if !defined LWIP_TIMERS_WHEEL_SIZE || defined __DOXYGEN__
+#define LWIP_TIMERS_WHEEL_SIZE          256
+#endif
 /**
  * @}
  */
@@ -239,6 +258,41 @@
 #define MEMP_MEM_MALLOC                 0
 #endif
 
+/**
+ * MEMP_MEM_SLAB==1: Together with MEMP_MEM_MALLOC, take pool elements from
+ * fixed-size slabs with per-thread caches instead of from mem_malloc().
+ * Pools still have no upper limit, MEMP_NUM_* only sizes the first slab of
+ * each pool. The port provides memp_slab_init(), memp_slab_alloc() and
+ * memp_slab_free() (see memp_priv.h).
+ */
+#if !defined MEMP_MEM_SLAB || defined __DOXYGEN__
+#define MEMP_MEM_SLAB                   0
+#endif
+
+/**
+ * MEMP_SLAB_BATCH: number of elements a thread's cache exchanges with the
+ * pool at once when it runs empty or overflows (MEMP_MEM_SLAB).
+ */
+#if !defined MEMP_SLAB_BATCH || defined __DOXYGEN__
+#define MEMP_SLAB_BATCH                 32
+#endif
+
+/**
+ * MEMP_SLAB_HUGEPAGES==1: carve slabs from an arena of MEMP_SLAB_ARENA_SIZE
+ * bytes backed by huge pages where the system provides them (MEMP_MEM_SLAB).
+ */
+#if !defined MEMP_SLAB_HUGEPAGES || defined __DOXYGEN__
+#define MEMP_SLAB_HUGEPAGES             0
+#endif
+
+/**
+ * MEMP_SLAB_ARENA_SIZE: size of the huge page arena, slabs that do not fit
+ * any more come from regular pages.
+ */
+#if !defined MEMP_SLAB_ARENA_SIZE || defined __DOXYGEN__
+#define MEMP_SLAB_ARENA_SIZE            (64 * 1024 * 1024)
+#endif
+
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
  *    4 byte alignment -> \#define MEM_ALIGNMENT 4
@@ -549,6 +603,26 @@
 #define ARP_TABLE_SIZE                  10
 #endif
 
+/**
+ * LWIP_NEIGHBOR_HASH==1: Index the ARP table and the IPv6 neighbor cache by IP
+ * address in hash tables and keep their entries in least-recently-used order,
+ * so that lookups don't scan the tables and full tables recycle the least
+ * recently used entry. Use this with large ARP_TABLE_SIZE and
+ * LWIP_ND6_NUM_NEIGHBORS (up to 0x7fff). Lookup, hit, insert and eviction
+ * counts are kept in lwip_stats.etharp_cache and lwip_stats.nd6_cache.
+ */
+#if !defined LWIP_NEIGHBOR_HASH || defined __DOXYGEN__
+#define LWIP_NEIGHBOR_HASH              0
+#endif
+
+/**
+ * LWIP_NEIGHBOR_HASH_SIZE: Number of buckets in the ARP table and neighbor
+ * cache hash tables. Must be a power of two.
+ */
+#if !defined LWIP_NEIGHBOR_HASH_SIZE || defined __DOXYGEN__
+#define LWIP_NEIGHBOR_HASH_SIZE         256
+#endif
+
 /** the time an ARP entry stays valid after its last update,
  *  for ARP_TMR_INTERVAL = 1000, this is
  *  (60 * 5) seconds = 5 minutes.
@@ -1246,6 +1320,23 @@
 #define TCP_OOSEQ_MAX_PBUFS             0
 #endif
 
+/**
+ * TCP_PCB_HASH==1: Maintain hash tables of the active, TIME-WAIT and listening
+ * PCBs alongside their lists, so that tcp_input() finds the PCB of a segment
+ * without walking the lists. Costs one pointer per PCB plus the tables.
+ */
+#if !defined TCP_PCB_HASH || defined __DOXYGEN__
+#define TCP_PCB_HASH                    0
+#endif
+
+/**
+ * TCP_PCB_HASH_SIZE: Number of buckets in each of the TCP PCB hash tables.
+ * Must be a power of two.
+ */
+#if !defined TCP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define TCP_PCB_HASH_SIZE               1024
+#endif
+
 /**
  * TCP_LISTEN_BACKLOG: Enable the backlog option for tcp listen pcb.
  */
@@ -1281,15 +1372,26 @@
 #endif
 
 /**
- * LWIP_TCP_TIMESTAMPS==1: support the TCP timestamp option.
- * The timestamp option is currently only used to help remote hosts, it is not
- * really used locally. Therefore, it is only enabled when a TS option is
- * received in the initial SYN packet from a remote host.
+ * LWIP_TCP_TIMESTAMPS==1: support the TCP timestamp option (RFC 7323).
+ * The option is offered in every SYN we send and used when the remote host
+ * agrees. The echoed timestamps then give an RTT sample for every ACK of new
+ * data, retransmissions included, instead of one timed segment per RTT.
  */
 #if !defined LWIP_TCP_TIMESTAMPS || defined __DOXYGEN__
 #define LWIP_TCP_TIMESTAMPS             0
 #endif
 
+/**
+ * LWIP_TCP_SACK==1: support selective acknowledgements (RFC 2018).
+ * Data held on the out-of-sequence queue is reported in the ACKs we send, and
+ * the SACK blocks we receive let fast recovery retransmit every missing
+ * segment of a window instead of one per round trip (RFC 6675).
+ * Needs TCP_QUEUE_OOSEQ.
+ */
+#if !defined LWIP_TCP_SACK || defined __DOXYGEN__
+#define LWIP_TCP_SACK                   0
+#endif
+
 /**
  * TCP_WND_UPDATE_THRESHOLD: difference in window to trigger an
  * explicit window update
@@ -1740,6 +1842,32 @@
 #define LWIP_SOCKET_SET_ERRNO           1
 #endif
 
+/**
+ * LWIP_SOCKET_POLL==1: Enable lwip_poll(), a poll() replacement which works on
+ * the descriptors of many sockets without building fd_sets.
+ * (only used if you use sockets.c)
+ */
+#if !defined LWIP_SOCKET_POLL || defined __DOXYGEN__
+#define LWIP_SOCKET_POLL                1
+#endif
+
+/**
+ * LWIP_SOCKET_EPOLL==1: Enable lwip_epoll_create/ctl/wait(), an epoll-style
+ * readiness API with persistent interest sets and a ready list that is filled
+ * from the socket event callback. (only used if you use sockets.c)
+ */
+#if !defined LWIP_SOCKET_EPOLL || defined __DOXYGEN__
+#define LWIP_SOCKET_EPOLL               1
+#endif
+
+/**
+ * LWIP_SOCKET_EPOLL_MAX: Maximum number of epoll instances that can be open at
+ * the same time. Their descriptors are numbered after the last socket descriptor.
+ */
+#if !defined LWIP_SOCKET_EPOLL_MAX || defined __DOXYGEN__
+#define LWIP_SOCKET_EPOLL_MAX           8
+#endif
+
 /**
  * LWIP_COMPAT_SOCKETS==1: Enable BSD-style sockets functions names through defines.
  * LWIP_COMPAT_SOCKETS==2: Same as ==1 but correctly named functions are created.
@@ -2538,6 +2666,21 @@
 #define LWIP_HOOK_ND6_GET_GW(netif, dest)
 #endif
 
+/**
+ * LWIP_HOOK_ND6_GET_LLADDR(netif, dest, lladdr):
+ * - called from nd6_get_next_hop_entry() (IPv6) before a new neighbor is solicited
+ * - netif: the netif used for sending
+ * - dest: the IPv6 address of the next hop
+ * - lladdr: buffer of netif->hwaddr_len bytes for the link-layer address
+ * Returns != 0 if the link-layer address of dest is known without address
+ * resolution (e.g. it can be derived from dest) and has been written to lladdr.
+ * The neighbor cache entry is then created in a static state that is never
+ * probed or aged; otherwise a Neighbor Solicitation is sent as usual.
+*/
+#ifdef __DOXYGEN__
+#define LWIP_HOOK_ND6_GET_LLADDR(netif, dest, lladdr)
+#endif
+
 /**
  * LWIP_HOOK_VLAN_CHECK(netif, eth_hdr, vlan_hdr):
  * - called from ethernet_input() if VLAN support is enabled
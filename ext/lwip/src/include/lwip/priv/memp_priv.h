@@ -149,6 +149,12 @@ struct memp_desc {
 
   /** First free element of each pool. Elements form a linked list. */
   struct memp **tab;
+#elif MEMP_MEM_SLAB
+  /** Number of elements the first slab is sized for */
+  u16_t num;
+
+  /** Slab state, set up by memp_slab_init() */
+  struct memp_slab **slab;
 #endif /* MEMP_MEM_MALLOC */
 };
 
@@ -168,6 +174,22 @@ struct memp_desc {
 
 void memp_init_pool(const struct memp_desc *desc);
 
+#if MEMP_MEM_SLAB
+/* Implemented by the port. Elements are aligned to at least MEM_ALIGNMENT and
+ * may be freed by a different thread than the one that allocated them. */
+void memp_slab_init(const struct memp_desc *desc);
+void *memp_slab_alloc(const struct memp_desc *desc);
+void memp_slab_free(const struct memp_desc *desc, void *mem);
+/* Runtime limits: at most num elements of a pool in use and at most bytes for
+ * all slabs and heap blocks together, including the elements threads keep in
+ * their caches, 0 for no limit. Reserved memory is never
+ * given back, memp_slab_reserved() returns how many elements a pool (all
+ * pools and the heap for desc NULL) has taken so far and their size. */
+void memp_slab_set_limit(const struct memp_desc *desc, size_t num);
+void memp_slab_set_budget(size_t bytes);
+size_t memp_slab_reserved(const struct memp_desc *desc, size_t *bytes);
+#endif /* MEMP_MEM_SLAB */
+
 #if MEMP_OVERFLOW_CHECK
 void *memp_malloc_pool_fn(const struct memp_desc* desc, const char* file, const int line);
 #define memp_malloc_pool(d) memp_malloc_pool_fn((d), __FILE__, __LINE__)
@@ -88,6 +88,14 @@ struct nd6_neighbor_cache_entry {
     u32_t probes_sent;
     u32_t stale_time;     /* ticks (ND6_TMR_INTERVAL) */
   } counter;
+#if LWIP_NEIGHBOR_HASH
+  /* links are index + 1, 0 terminates */
+  /** next entry in the same hash bucket, or on the free list */
+  u16_t hnext;
+  /** neighbours in least-recently-used order */
+  u16_t lru_prev;
+  u16_t lru_next;
+#endif /* LWIP_NEIGHBOR_HASH */
 };
 
 struct nd6_destination_cache_entry {
@@ -121,7 +129,9 @@ enum nd6_neighbor_cache_entry_state {
   ND6_REACHABLE,
   ND6_STALE,
   ND6_DELAY,
-  ND6_PROBE
+  ND6_PROBE,
+  /* link-layer address supplied by LWIP_HOOK_ND6_GET_LLADDR(), never probed or aged */
+  ND6_STATIC
 };
 
 /* Router tables. */
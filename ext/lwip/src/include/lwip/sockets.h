@@ -161,6 +161,12 @@ struct msghdr {
   int           msg_flags;
 };
 
+/** One message of lwip_sendmmsg/lwip_recvmmsg (same layout as struct mmsghdr) */
+struct lwip_mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int  msg_len;
+};
+
 /* Socket protocol types (TCP/UDP/RAW) */
 #define SOCK_STREAM     1
 #define SOCK_DGRAM      2
@@ -239,6 +245,7 @@ struct linger {
 #define MSG_OOB        0x04    /* Unimplemented: Requests out-of-band data. The significance and semantics of out-of-band data are protocol-specific */
 #define MSG_DONTWAIT   0x08    /* Nonblocking i/o for this operation only */
 #define MSG_MORE       0x10    /* Sender will send more */
+#define MSG_TRUNC      0x20    /* Returned by recvmsg: the datagram was larger than the buffers passed in */
 
 
 /*
@@ -445,6 +452,59 @@ struct timeval {
 };
 #endif /* LWIP_TIMEVAL_PRIVATE */
 
+#if LWIP_SOCKET_POLL
+/* Event flags used by lwip_poll. The values match those of Linux so that a
+ * struct pollfd array from <poll.h> can be handed to lwip_poll directly. */
+#define LWIP_POLLIN     0x001
+#define LWIP_POLLPRI    0x002
+#define LWIP_POLLOUT    0x004
+#define LWIP_POLLERR    0x008
+#define LWIP_POLLHUP    0x010
+#define LWIP_POLLNVAL   0x020
+#define LWIP_POLLRDNORM 0x040
+#define LWIP_POLLWRNORM 0x100
+
+typedef unsigned long lwip_nfds_t;
+
+/** Same layout as struct pollfd */
+struct lwip_pollfd
+{
+  int fd;
+  short events;
+  short revents;
+};
+#endif /* LWIP_SOCKET_POLL */
+
+#if LWIP_SOCKET_EPOLL
+/* Event flags and operations used by the lwip_epoll functions (same values as Linux) */
+#define LWIP_EPOLLIN      0x001U
+#define LWIP_EPOLLPRI     0x002U
+#define LWIP_EPOLLOUT     0x004U
+#define LWIP_EPOLLERR     0x008U
+#define LWIP_EPOLLHUP     0x010U
+#define LWIP_EPOLLONESHOT (1U << 30)
+#define LWIP_EPOLLET      (1U << 31)
+
+#define LWIP_EPOLL_CTL_ADD 1
+#define LWIP_EPOLL_CTL_DEL 2
+#define LWIP_EPOLL_CTL_MOD 3
+
+/** Descriptor of the first epoll instance, they follow the socket descriptors */
+#define LWIP_EPOLL_OFFSET (LWIP_SOCKET_OFFSET + MEMP_NUM_NETCONN)
+
+typedef union lwip_epoll_data {
+  void *ptr;
+  int fd;
+  u32_t u32;
+  uint64_t u64;
+} lwip_epoll_data_t;
+
+struct lwip_epoll_event {
+  u32_t events;
+  lwip_epoll_data_t data;
+};
+#endif /* LWIP_SOCKET_EPOLL */
+
 #define lwip_socket_init() /* Compatibility define, no init needed. */
 void lwip_socket_thread_init(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: initialize thread-local semaphore */
 void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destroy thread-local semaphore */
@@ -474,6 +534,7 @@ void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destro
 #define lwip_read         read
 #define lwip_write        write
 #define lwip_writev       writev
+#define lwip_readv        readv
 #undef lwip_close
 #define lwip_close        close
 #define closesocket(s)    close(s)
@@ -498,15 +559,27 @@ int lwip_recvfrom(int s, void *mem, size_t len, int flags,
       struct sockaddr *from, socklen_t *fromlen);
 int lwip_send(int s, const void *dataptr, size_t size, int flags);
 int lwip_sendmsg(int s, const struct msghdr *message, int flags);
+int lwip_sendmmsg(int s, struct lwip_mmsghdr *msgvec, unsigned int vlen, int flags);
+int lwip_recvmsg(int s, struct msghdr *message, int flags);
+int lwip_recvmmsg(int s, struct lwip_mmsghdr *msgvec, unsigned int vlen, int flags);
 int lwip_sendto(int s, const void *dataptr, size_t size, int flags,
     const struct sockaddr *to, socklen_t tolen);
 int lwip_socket(int domain, int type, int protocol);
 int lwip_write(int s, const void *dataptr, size_t size);
 int lwip_writev(int s, const struct iovec *iov, int iovcnt);
+int lwip_readv(int s, const struct iovec *iov, int iovcnt);
 int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
                 struct timeval *timeout);
 int lwip_ioctl(int s, long cmd, void *argp);
 int lwip_fcntl(int s, int cmd, int val);
+#if LWIP_SOCKET_POLL
+int lwip_poll(struct lwip_pollfd *fds, lwip_nfds_t nfds, int timeout);
+#endif /* LWIP_SOCKET_POLL */
+#if LWIP_SOCKET_EPOLL
+int lwip_epoll_create(int size);
+int lwip_epoll_ctl(int epfd, int op, int fd, struct lwip_epoll_event *event);
+int lwip_epoll_wait(int epfd, struct lwip_epoll_event *events, int maxevents, int timeout);
+#endif /* LWIP_SOCKET_EPOLL */
 
 #if LWIP_COMPAT_SOCKETS
 #if LWIP_COMPAT_SOCKETS != 2
@@ -519,6 +592,8 @@ int lwip_fcntl(int s, int cmd, int val);
 /** @ingroup socket */
 #define writev(s,iov,iovcnt)                      lwip_writev(s,iov,iovcnt)
 /** @ingroup socket */
+#define readv(s,iov,iovcnt)                       lwip_readv(s,iov,iovcnt)
+/** @ingroup socket */
 #define close(s)                                  lwip_close(s)
 /** @ingroup socket */
 #define fcntl(s,cmd,val)                          lwip_fcntl(s,cmd,val)
@@ -76,6 +76,17 @@ struct stats_proto {
   STAT_COUNTER cachehit;
 };
 
+/** Neighbor cache (ARP table, IPv6 neighbor cache) stats, see LWIP_NEIGHBOR_HASH */
+struct stats_nbr {
+  STAT_COUNTER lookup;           /* Lookups by IP address. */
+  STAT_COUNTER hit;              /* Lookups that found an entry. */
+  STAT_COUNTER insert;           /* Entries created. */
+  STAT_COUNTER evict;            /* Entries recycled to make room for new ones. */
+  STAT_COUNTER full;             /* Entries that could not be created. */
+  STAT_COUNTER used;             /* Entries in use. */
+  STAT_COUNTER max;              /* Most entries in use at once. */
+};
+
 /** IGMP stats */
 struct stats_igmp {
   STAT_COUNTER xmit;             /* Transmitted packets. */
@@ -237,6 +248,10 @@ struct stats_ {
 #if ETHARP_STATS
   /** ARP */
   struct stats_proto etharp;
+#if LWIP_NEIGHBOR_HASH
+  /** ARP table */
+  struct stats_nbr etharp_cache;
+#endif
 #endif
 #if IPFRAG_STATS
   /** Fragmentation */
@@ -293,6 +308,10 @@ struct stats_ {
 #if ND6_STATS
   /** Neighbor discovery */
   struct stats_proto nd6;
+#if LWIP_NEIGHBOR_HASH
+  /** Neighbor cache */
+  struct stats_nbr nd6_cache;
+#endif
 #endif
 #if MIB2_STATS
   /** SNMP MIB2 */
@@ -318,7 +337,7 @@ void stats_init(void);
 #define stats_init()
 #define STATS_INC(x)
 #define STATS_DEC(x)
-#define STATS_INC_USED(x)
+#define STATS_INC_USED(x, y)
 #endif /* LWIP_STATS */
 
 #if TCP_STATS
@@ -377,6 +396,16 @@ void stats_init(void);
 #define ETHARP_STATS_DISPLAY()
 #endif
 
+#if ETHARP_STATS && LWIP_NEIGHBOR_HASH
+#define ETHARP_CACHE_STATS_INC(x) STATS_INC(etharp_cache.x)
+#define ETHARP_CACHE_STATS_USED(y) STATS_INC_USED(etharp_cache, y)
+#define ETHARP_CACHE_STATS_DISPLAY() stats_display_nbr(&lwip_stats.etharp_cache, "ETHARP cache")
+#else
+#define ETHARP_CACHE_STATS_INC(x)
+#define ETHARP_CACHE_STATS_USED(y)
+#define ETHARP_CACHE_STATS_DISPLAY()
+#endif
+
 #if LINK_STATS
 #define LINK_STATS_INC(x) STATS_INC(x)
 #define LINK_STATS_DISPLAY() stats_display_proto(&lwip_stats.link, "LINK")
@@ -461,6 +490,16 @@ void stats_init(void);
 #define ND6_STATS_DISPLAY()
 #endif
 
+#if ND6_STATS && LWIP_NEIGHBOR_HASH
+#define ND6_CACHE_STATS_INC(x) STATS_INC(nd6_cache.x)
+#define ND6_CACHE_STATS_USED(y) STATS_INC_USED(nd6_cache, y)
+#define ND6_CACHE_STATS_DISPLAY() stats_display_nbr(&lwip_stats.nd6_cache, "ND cache")
+#else
+#define ND6_CACHE_STATS_INC(x)
+#define ND6_CACHE_STATS_USED(y)
+#define ND6_CACHE_STATS_DISPLAY()
+#endif
+
 #if MIB2_STATS
 #define MIB2_STATS_INC(x) STATS_INC(x)
 #else
@@ -472,6 +511,7 @@ void stats_init(void);
 void stats_display(void);
 void stats_display_proto(struct stats_proto *proto, const char *name);
 void stats_display_igmp(struct stats_igmp *igmp, const char *name);
+void stats_display_nbr(struct stats_nbr *nbr, const char *name);
 void stats_display_mem(struct stats_mem *mem, const char *name);
 void stats_display_memp(struct stats_mem *mem, int index);
 void stats_display_sys(struct stats_sys *sys);
@@ -479,6 +519,7 @@ void stats_display_sys(struct stats_sys *sys);
 #define stats_display()
 #define stats_display_proto(proto, name)
 #define stats_display_igmp(igmp, name)
+#define stats_display_nbr(nbr, name)
 #define stats_display_mem(mem, name)
 #define stats_display_memp(mem, index)
 #define stats_display_sys(sys)
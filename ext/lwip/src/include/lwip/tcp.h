@@ -135,17 +135,21 @@ typedef err_t (*tcp_connected_fn)(void *arg, struct tcp_pcb *tpcb, err_t err);
 #define RCV_WND_SCALE(pcb, wnd) (((wnd) >> (pcb)->rcv_scale))
 #define SND_WND_SCALE(pcb, wnd) (((wnd) << (pcb)->snd_scale))
 #define TCPWND16(x)             ((u16_t)LWIP_MIN((x), 0xFFFF))
-#define TCP_WND_MAX(pcb)        ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? TCP_WND : TCPWND16(TCP_WND)))
+#define TCP_WND_MAX(pcb)        ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? tcp_default_wnd : TCPWND16(tcp_default_wnd)))
 typedef u32_t tcpwnd_size_t;
 #else
 #define RCV_WND_SCALE(pcb, wnd) (wnd)
 #define SND_WND_SCALE(pcb, wnd) (wnd)
 #define TCPWND16(x)             (x)
-#define TCP_WND_MAX(pcb)        TCP_WND
+#define TCP_WND_MAX(pcb)        tcp_default_wnd
 typedef u16_t tcpwnd_size_t;
 #endif
 
-#if LWIP_WND_SCALE || TCP_LISTEN_BACKLOG || LWIP_TCP_TIMESTAMPS
+/* Receive window and send buffer of new connections, see tcp_set_default_bufs() */
+extern tcpwnd_size_t tcp_default_wnd;
+extern tcpwnd_size_t tcp_default_snd_buf;
+
+#if LWIP_WND_SCALE || TCP_LISTEN_BACKLOG || LWIP_TCP_TIMESTAMPS || LWIP_TCP_SACK
 typedef u16_t tcpflags_t;
 #else
 typedef u8_t tcpflags_t;
@@ -168,8 +172,16 @@ enum tcp_state {
 /**
  * members common to struct tcp_pcb and struct tcp_listen_pcb
  */
+#if TCP_PCB_HASH
+#define TCP_PCB_COMMON_HASH(type) \
+  type *hash_next; /* for the hash table of the list */
+#else /* TCP_PCB_HASH */
+#define TCP_PCB_COMMON_HASH(type)
+#endif /* TCP_PCB_HASH */
+
 #define TCP_PCB_COMMON(type) \
   type *next; /* for the linked list */ \
+  TCP_PCB_COMMON_HASH(type) \
   void *callback_arg; \
   enum tcp_state state; /* TCP state */ \
   u8_t prio; \
@@ -223,6 +235,9 @@ struct tcp_pcb {
 #endif
 #if LWIP_TCP_TIMESTAMPS
 #define TF_TIMESTAMP   0x0400U   /* Timestamp option enabled */
+#endif
+#if LWIP_TCP_SACK
+#define TF_SACK        0x0800U   /* SACK option enabled */
 #endif
 
   /* the rest of the fields are in host byte order
@@ -259,6 +274,7 @@ struct tcp_pcb {
   /* congestion avoidance/control variables */
   tcpwnd_size_t cwnd;
   tcpwnd_size_t ssthresh;
+  tcpwnd_size_t bytes_acked; /* acknowledged towards the next cwnd increase in congestion avoidance */
 
   /* sender variables */
   u32_t snd_nxt;   /* next new seqno to be sent */
@@ -308,6 +324,11 @@ struct tcp_pcb {
   u32_t ts_recent;
 #endif /* LWIP_TCP_TIMESTAMPS */
 
+#if LWIP_TCP_SACK
+  u32_t rcv_sack_last; /* seqno of the latest out-of-sequence segment, reported in the first SACK block */
+  u32_t recover;       /* snd_nxt when fast recovery was entered */
+#endif /* LWIP_TCP_SACK */
+
   /* idle time before KEEPALIVE is sent */
   u32_t keep_idle;
 #if LWIP_TCP_KEEPALIVE
@@ -411,6 +432,7 @@ err_t            tcp_write   (struct tcp_pcb *pcb, const void *dataptr, u16_t le
                               u8_t apiflags);
 
 void             tcp_setprio (struct tcp_pcb *pcb, u8_t prio);
+void             tcp_set_default_bufs(tcpwnd_size_t wnd, tcpwnd_size_t snd_buf);
 
 #define TCP_PRIO_MIN    1
 #define TCP_PRIO_NORMAL 64
@@ -85,9 +85,17 @@ typedef void (* sys_timeout_handler)(void *arg);
 
 struct sys_timeo {
   struct sys_timeo *next;
+  /** delta to the previous timeout, or absolute sys_now() expiry with LWIP_TIMERS_WHEEL */
   u32_t time;
   sys_timeout_handler h;
   void *arg;
+#if LWIP_TIMERS_WHEEL
+  /** previous entry in the same wheel slot */
+  struct sys_timeo *prev;
+  /** neighbours in the handler/arg index */
+  struct sys_timeo *hnext;
+  struct sys_timeo *hprev;
+#endif /* LWIP_TIMERS_WHEEL */
 #if LWIP_DEBUG_TIMERNAMES
   const char* handler_name;
 #endif /* LWIP_DEBUG_TIMERNAMES */
@@ -157,6 +157,7 @@ typedef signed char err_t;
 #define LWIP_STATUS_TMR_INTERVAL           500
 
 // #define LWIP_CHKSUM <your_checksum_routine>, See: RFC1071 for inspiration
+// (by default the SIMD routine selected by LWIP_CHKSUM_ALGORITHM 4 in lwipopts.h is used)
 #endif
 
 /****************************************************************************/
@@ -195,6 +196,59 @@ typedef signed char err_t;
  */
 #define ZT_SOCKET_MSG_BUF_SZ               ZT_SDK_MTU + ZT_LEN_SZ + ZT_ADDR_SZ
 
+/**
+ * Maximum number of segments an outbound frame may be split into when handed to the virtual
+ * wire without flattening (frames with more segments are copied into one buffer instead)
+ */
+#define ZT_MAX_FRAME_SEGMENTS              16
+
+/**
+ * Number of messages zts_sendmmsg() prepares for the network stack at a time
+ */
+#define ZT_MMSG_BATCH_SZ                   32
+
+/**
+ * Maximum number of MTU-sized frame buffers kept for handing received frames to the network
+ * stack as a single contiguous pbuf. When all of them are held by the stack, received frames
+ * fall back to a regular pbuf chain. Set to 0 to disable the pool. A memory profile may change
+ * the number at runtime (see zts_set_memory_profile()).
+ */
+#ifndef ZT_RX_FRAME_POOL_SIZE
+#define ZT_RX_FRAME_POOL_SIZE              256
+#endif
+
+/**
+ * Number of worker threads that hand outbound frames to ZeroTier, which encrypts and sends them,
+ * so that this work is spread over several cores rather than done under the stack's core lock.
+ * Frames are steered by a hash over each flow's addresses and ports, which keeps every flow in
+ * order, and the workers hold a reference to the stack's buffers rather than a copy. There is
+ * still one network stack: received frames enter it on ZeroTier's thread. Set to 0 (default) to
+ * hand frames to ZeroTier on the stack's thread.
+ */
+#ifndef ZT_STACK_SHARDS
+#define ZT_STACK_SHARDS                    0
+#endif
+
+/**
+ * IP/TCP/UDP checksums on libzt interfaces. ZeroTier already authenticates every packet, so
+ * between ZeroTier nodes these checksums only repeat that work. Frames from hosts bridged onto
+ * the network (MACs not derived from a ZeroTier address) are always verified before they reach
+ * the stack, and frames towards them or to broadcast/multicast always carry checksums.
+ *
+ * 0: the stack generates and verifies all checksums (default)
+ * 1: checksums are generated but not verified for frames from ZeroTier nodes
+ * 2: as 1, and not generated for frames to ZeroTier nodes. Only for networks where every node
+ *    is running libzt with 1 or 2, operating system stacks drop segments without checksums.
+ */
+#ifndef ZT_CHECKSUM_OFFLOAD
+#define ZT_CHECKSUM_OFFLOAD                0
+#endif
+
+/**
+ * Number of frames each shard can hold before further frames are dropped
+ */
+#define ZT_STACK_SHARD_QUEUE_LEN           1024
+
 /**
  * Polling interval (in ms) for file descriptors wrapped in the Phy I/O loop (for raw drivers only)
  */
@@ -317,6 +371,21 @@ typedef signed char err_t;
  */
 #define ZT_EXIT_ON_GENERAL_FAIL            false
 
+/**
+ * Default number of frames a VirtualWire holds in flight before it starts dropping (tail drop)
+ */
+#define ZT_VWIRE_QUEUE_LEN                 1024
+
+/**
+ * Size (in bytes, power of two) of each direction of a VirtualWire shared memory segment
+ */
+#define ZT_VWIRE_SHM_RING_SZ               (1 << 22)
+
+/**
+ * How often (in microseconds) a VirtualWire checks its shared memory segment for frames when idle
+ */
+#define ZT_VWIRE_SHM_POLL_INTERVAL         50
+
 
 /****************************************************************************/
 /* Socket API Signatures                                                    */
@@ -324,11 +393,11 @@ typedef signed char err_t;
 
 #define ZT_SETSOCKOPT_SIG int fd, int level, int optname, const void *optval, socklen_t optlen
 #define ZT_GETSOCKOPT_SIG int fd, int level, int optname, void *optval, socklen_t *optlen
-#define ZT_SENDMSG_SIG int fd, const struct msghdr *msg, int flags
+#define ZT_SENDMSG_SIG int fd, const struct zts_msghdr *msg, int flags
 #define ZT_SENDTO_SIG int fd, const void *buf, size_t len, int flags, const struct sockaddr *addr, socklen_t addrlen
 #define ZT_RECV_SIG int fd, void *buf, size_t len, int flags
 #define ZT_RECVFROM_SIG int fd, void *buf, size_t len, int flags, struct sockaddr *addr, socklen_t *addrlen
-#define ZT_RECVMSG_SIG int fd, struct msghdr *msg,int flags
+#define ZT_RECVMSG_SIG int fd, struct zts_msghdr *msg,int flags
 #define ZT_SEND_SIG int fd, const void *buf, size_t len, int flags
 #define ZT_READ_SIG int fd, void *buf, size_t len
 #define ZT_WRITE_SIG int fd, const void *buf, size_t len
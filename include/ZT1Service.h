@@ -44,7 +44,9 @@ extern "C" {
 
 namespace ZeroTier
 {
+	class Mutex;
 	extern std::vector<void*> vtaps;
+	extern ZeroTier::Mutex _vtaps_lock;
 
 	class picoTCP;
 	extern ZeroTier::picoTCP *picostack;
@@ -94,6 +96,24 @@ void *zts_start_service(void *thread_id);
  */
 void disableTaps();
 
+/**
+ * @brief Returns the VirtualTap for the given network, or NULL
+ *
+ * @usage For internal use only.
+ * @param nwid
+ * @return
+ */
+ZeroTier::VirtualTap *getTapByNWID(uint64_t nwid);
+
+/**
+ * @brief Returns the VirtualTap whose assigned subnets or managed routes contain the given address, or NULL
+ *
+ * @usage For internal use only.
+ * @param addr
+ * @return
+ */
+ZeroTier::VirtualTap *getTapByAddr(ZeroTier::InetAddress *addr);
+
 /**
  * @brief Gets the VirtualTap's (interface) IPv4 address
  *
@@ -41,6 +41,21 @@
  #include <poll.h>
 #endif
 
+// struct iovec and socklen_t of struct zts_msghdr, which libzt itself takes from the network stack
+#if !defined(_WIN32) && !defined(LWIP_HDR_SOCKETS_H)
+ #include <sys/socket.h>
+#endif
+
+// Windows has no struct iovec, it is declared as in the network stack's sockets.h, whose guard
+// on the iovec macro then skips its own declaration
+#if defined(_WIN32) && !defined(LWIP_HDR_SOCKETS_H) && !defined(iovec)
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+#define iovec iovec
+#endif
+
 #include "Debug.hpp"
 #include "Defs.h"
 
@@ -289,6 +304,83 @@ ZT_SOCKET_API void ZTCALL zts_enable_http_control_plane();
  */
 ZT_SOCKET_API void ZTCALL zts_disable_http_control_plane();
 
+/****************************************************************************/
+/* Memory                                                                   */
+/****************************************************************************/
+
+#define ZTS_MEMORY_PROFILE_DEFAULT         0
+#define ZTS_MEMORY_PROFILE_SMALL           1
+#define ZTS_MEMORY_PROFILE_LARGE           2
+
+/**
+ * Memory the network stack may use. A field left at 0 keeps the build's setting: no limit for
+ * stack_memory and the counts, the largest size the build supports for the TCP buffers. The
+ * counts limit what is in use at once. stack_memory is approximate: it also covers free
+ * elements each thread keeps cached for reuse, up to 64 per pool and thread (about an eighth of
+ * a smaller limited count), so allocations can fail somewhat before the stack uses that much
+ */
+struct zts_memory_profile
+{
+	size_t stack_memory;             // bytes for packet buffers, segments, PCBs, stack messages and mailboxes
+	unsigned int pbufs;              // pool pbufs, which hold received packets
+	unsigned int rx_frames;          // frames waiting between ZeroTier and the stack
+	unsigned int tcp_segments;       // unacknowledged or queued TCP segments of all connections
+	unsigned int tcp_connections;    // TCP connections and listening sockets, each
+	unsigned int udp_sockets;        // UDP sockets
+	unsigned int tcp_send_buffer;    // bytes each TCP connection may queue for sending
+	unsigned int tcp_receive_window; // bytes each TCP connection may receive ahead of the application
+};
+
+/**
+ * Memory the network stack has taken so far. It keeps what it took for reuse, so these are high
+ * water marks rather than current use, and the counts may run past the profile's limits by the
+ * elements cached in threads
+ */
+struct zts_memory_usage
+{
+	size_t stack_memory;             // bytes, including the pbufs below
+	size_t stack_memory_limit;       // bytes, 0 if unlimited
+	unsigned int pbufs;
+	unsigned int rx_frames;          // frame buffers of ZT_MAX_MTU bytes, on top of stack_memory
+	unsigned int tcp_segments;
+	unsigned int tcp_connections;
+	unsigned int udp_sockets;
+	unsigned int tcp_send_buffer;    // in effect for new connections
+	unsigned int tcp_receive_window; // in effect for new connections
+};
+
+/**
+ * @brief Fill in one of the predefined memory profiles
+ *
+ * @usage ZTS_MEMORY_PROFILE_SMALL suits mobile and embedded devices, ZTS_MEMORY_PROFILE_LARGE suits
+ *        gateways and other hosts with many connections. Adjust fields before passing the profile
+ *        to zts_set_memory_profile()
+ * @param profile ZTS_MEMORY_PROFILE_DEFAULT, ZTS_MEMORY_PROFILE_SMALL or ZTS_MEMORY_PROFILE_LARGE
+ * @param mp Profile to fill in
+ * @return 0 if successful, -1 for an unknown profile
+ */
+ZT_SOCKET_API int ZTCALL zts_get_memory_profile(int profile, struct zts_memory_profile *mp);
+
+/**
+ * @brief Set how much memory the network stack may use
+ *
+ * @usage Call before zts_start(), the profile is applied when the stack starts. Allocations beyond
+ *        a limit fail the way the stack handles running out of memory: packets are dropped and
+ *        socket calls fail with ENOMEM or ENOBUFS
+ * @param mp Profile to apply, see zts_get_memory_profile()
+ * @return 0 if successful, -1 if the stack is already running
+ */
+ZT_SOCKET_API int ZTCALL zts_set_memory_profile(const struct zts_memory_profile *mp);
+
+/**
+ * @brief Report how much memory the network stack has taken
+ *
+ * @usage Call after zts_start()
+ * @param mu Filled in with the stack's memory use
+ * @return 0 if successful, -1 if the stack is not running
+ */
+ZT_SOCKET_API int ZTCALL zts_get_memory_usage(struct zts_memory_usage *mu);
+
 /****************************************************************************/
 /* POSIX-like socket API                                                    */
 /****************************************************************************/
@@ -455,16 +547,82 @@ ZT_SOCKET_API int ZTCALL zts_close(int fd);
 /**
  * @brief Waits for one of a set of file descriptors to become ready to perform I/O.
  *
- * @usage Call this after zts_start() has succeeded
- * @param fds
- * @param nfds
- * @param timeout
- * @return
+ * @usage Call this after zts_start() has succeeded. Unlike zts_select() the cost of a call
+ *        depends only on nfds and not on the value of the largest descriptor.
+ * @param fds Array of descriptors and requested events (only libzt descriptors are supported)
+ * @param nfds Number of entries in fds
+ * @param timeout Time to wait in milliseconds, 0 to return immediately, negative to wait forever
+ * @return Number of entries with non-zero revents, 0 on timeout, -1 on error
  */
 #if defined(__linux__)
 int zts_poll(struct pollfd *fds, nfds_t nfds, int timeout);
 #endif
 
+/**
+ * Event flags and operations for zts_epoll_ctl() and zts_epoll_wait()
+ */
+#define ZTS_EPOLLIN                        0x001U
+#define ZTS_EPOLLPRI                       0x002U
+#define ZTS_EPOLLOUT                       0x004U
+#define ZTS_EPOLLERR                       0x008U
+#define ZTS_EPOLLHUP                       0x010U
+#define ZTS_EPOLLONESHOT                   (1U << 30)
+#define ZTS_EPOLLET                        (1U << 31)
+
+#define ZTS_EPOLL_CTL_ADD                  1
+#define ZTS_EPOLL_CTL_DEL                  2
+#define ZTS_EPOLL_CTL_MOD                  3
+
+typedef union zts_epoll_data
+{
+	void *ptr;
+	int fd;
+	uint32_t u32;
+	uint64_t u64;
+} zts_epoll_data_t;
+
+struct zts_epoll_event
+{
+	uint32_t events;
+	zts_epoll_data_t data;
+};
+
+/**
+ * @brief Create an epoll instance, a persistent set of sockets to wait on
+ *
+ * @usage Call this after zts_start() has succeeded. Release the instance with zts_close()
+ * @param size Ignored, but must be greater than zero
+ * @return File descriptor of the epoll instance, -1 on error
+ */
+ZT_SOCKET_API int ZTCALL zts_epoll_create(int size);
+
+/**
+ * @brief Add, modify or remove a socket in the interest set of an epoll instance
+ *
+ * @usage Sockets are level-triggered unless ZTS_EPOLLET is given. With ZTS_EPOLLONESHOT a socket
+ *        reports one event and is then disabled until re-armed with ZTS_EPOLL_CTL_MOD. Closed
+ *        sockets are removed from all interest sets.
+ * @param epfd File descriptor returned by zts_epoll_create()
+ * @param op ZTS_EPOLL_CTL_ADD, ZTS_EPOLL_CTL_MOD or ZTS_EPOLL_CTL_DEL
+ * @param fd Socket to watch
+ * @param event Events to watch for and data to report with them (may be NULL for ZTS_EPOLL_CTL_DEL)
+ * @return 0 if successful, -1 on error
+ */
+ZT_SOCKET_API int ZTCALL zts_epoll_ctl(int epfd, int op, int fd, struct zts_epoll_event *event);
+
+/**
+ * @brief Wait for events on the sockets of an epoll instance
+ *
+ * @usage Call this after zts_start() has succeeded. The cost of a call depends on the number of
+ *        sockets with pending events, not on the number of sockets being watched.
+ * @param epfd File descriptor returned by zts_epoll_create()
+ * @param events Array receiving the events
+ * @param maxevents Number of entries in events
+ * @param timeout Time to wait in milliseconds, 0 to return immediately, negative to wait forever
+ * @return Number of events stored in events, 0 on timeout, -1 on error
+ */
+ZT_SOCKET_API int ZTCALL zts_epoll_wait(int epfd, struct zts_epoll_event *events, int maxevents, int timeout);
+
 /**
  * @brief Monitor multiple file descriptors, waiting until one or more of the file descriptors become "ready"
  *
@@ -526,6 +684,21 @@ ZT_SOCKET_API ssize_t ZTCALL zts_send(int fd, const void *buf, size_t len, int f
  */
 ZT_SOCKET_API ssize_t ZTCALL zts_sendto(int fd, const void *buf, size_t len, int flags, const struct sockaddr *addr, socklen_t addrlen);
 
+/**
+ * Message of zts_sendmsg() and zts_recvmsg(). Fields are those of the POSIX struct msghdr, but
+ * unlike struct msghdr the layout doesn't differ between the platform and the network stack
+ */
+struct zts_msghdr
+{
+	void *msg_name;        // optional address
+	socklen_t msg_namelen; // size of msg_name
+	struct iovec *msg_iov; // buffers to send from or receive into
+	size_t msg_iovlen;     // number of elements in msg_iov
+	void *msg_control;     // ancillary data (not supported)
+	size_t msg_controllen; // size of msg_control
+	int msg_flags;         // flags of the received message
+};
+
 /**
  * @brief Send message to remote host
  *
@@ -535,7 +708,7 @@ ZT_SOCKET_API ssize_t ZTCALL zts_sendto(int fd, const void *buf, size_t len, int
  * @param flags
  * @return
  */
-ZT_SOCKET_API ssize_t ZTCALL zts_sendmsg(int fd, const struct msghdr *msg, int flags);
+ZT_SOCKET_API ssize_t ZTCALL zts_sendmsg(int fd, const struct zts_msghdr *msg, int flags);
 
 /**
  * @brief Receive data from remote host
@@ -566,13 +739,50 @@ ZT_SOCKET_API ssize_t ZTCALL zts_recvfrom(int fd, void *buf, size_t len, int fla
 /**
  * @brief Receive a message from remote host
  *
- * @usage Call this after zts_start() has succeeded
+ * @usage Call this after zts_start() has succeeded. For datagram sockets one datagram is received,
+ *        if it doesn't fit into the buffers the rest is discarded and MSG_TRUNC is set in msg_flags.
+ *        Ancillary data is not supported.
  * @param fd File descriptor (only valid for use with libzt calls)
- * @param msg
+ * @param msg Buffers to receive into, and optionally room for the source address
  * @param flags
- * @return
+ * @return Number of bytes received, -1 on error
+ */
+ZT_SOCKET_API ssize_t ZTCALL zts_recvmsg(int fd, struct zts_msghdr *msg,int flags);
+
+/**
+ * One message of zts_sendmmsg() and zts_recvmmsg()
+ */
+struct zts_mmsghdr
+{
+	struct zts_msghdr msg_hdr;
+	unsigned int msg_len; // number of bytes sent or received
+};
+
+/**
+ * @brief Send several messages with one call
+ *
+ * @usage Call this after zts_start() has succeeded. Datagrams are handed to the network stack
+ *        in batches, one round trip into the stack per batch rather than per datagram.
+ * @param fd File descriptor (only valid for use with libzt calls)
+ * @param msgvec Messages to send, msg_len is set for each message that was sent
+ * @param vlen Number of messages in msgvec
+ * @param flags
+ * @return Number of messages sent, -1 if the first message could not be sent
+ */
+ZT_SOCKET_API int ZTCALL zts_sendmmsg(int fd, struct zts_mmsghdr *msgvec, unsigned int vlen, int flags);
+
+/**
+ * @brief Receive several messages with one call
+ *
+ * @usage Call this after zts_start() has succeeded. Only the first message is waited for (unless
+ *        the socket is non-blocking), further messages are only returned if they have already arrived.
+ * @param fd File descriptor (only valid for use with libzt calls)
+ * @param msgvec Buffers for the messages, msg_len is set for each message that was received
+ * @param vlen Number of messages in msgvec
+ * @param flags
+ * @return Number of messages received, -1 if no message could be received
  */
-ZT_SOCKET_API ssize_t ZTCALL zts_recvmsg(int fd, struct msghdr *msg,int flags);
+ZT_SOCKET_API int ZTCALL zts_recvmmsg(int fd, struct zts_mmsghdr *msgvec, unsigned int vlen, int flags);
 
 /**
  * @brief Read bytes from socket onto buffer
@@ -596,6 +806,28 @@ ZT_SOCKET_API int ZTCALL zts_read(int fd, void *buf, size_t len);
  */
 ZT_SOCKET_API int ZTCALL zts_write(int fd, const void *buf, size_t len);
 
+/**
+ * @brief Read bytes from socket into several buffers
+ *
+ * @usage Call this after zts_start() has succeeded
+ * @param fd File descriptor (only valid for use with libzt calls)
+ * @param iov Buffers to fill, in order
+ * @param iovcnt Number of buffers in iov
+ * @return Number of bytes read, -1 on error
+ */
+ZT_SOCKET_API int ZTCALL zts_readv(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief Write bytes from several buffers to socket
+ *
+ * @usage Call this after zts_start() has succeeded
+ * @param fd File descriptor (only valid for use with libzt calls)
+ * @param iov Buffers to write, in order
+ * @param iovcnt Number of buffers in iov
+ * @return Number of bytes written, -1 on error
+ */
+ZT_SOCKET_API int ZTCALL zts_writev(int fd, const struct iovec *iov, int iovcnt);
+
 /**
  * @brief Shut down some aspect of a socket (read, write, or both)
  *
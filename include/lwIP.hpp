@@ -46,6 +46,27 @@
  */
 void lwip_driver_init();
 
+struct zts_memory_profile;
+struct zts_memory_usage;
+
+/**
+ * @brief Set the memory profile applied when the stack starts
+ *
+ * @usage Called by zts_set_memory_profile(), has no effect once lwip_driver_init() has run
+ * @param mp Limits for the stack's pools and TCP buffers
+ * @return 0 if successful, -1 if the stack is already running
+ */
+int lwip_set_memory_profile(const struct zts_memory_profile *mp);
+
+/**
+ * @brief Report how much memory the stack has taken
+ *
+ * @usage Called by zts_get_memory_usage()
+ * @param mu Filled in with the stack's memory use
+ * @return 0 if successful, -1 if the stack is not running
+ */
+int lwip_get_memory_usage(struct zts_memory_usage *mu);
+
 /**
  * @brief Initialize and start the DNS client
  *
@@ -65,7 +86,9 @@ void lwip_start_dhcp(void *netif);
 /**
  * @brief Set up an interface in the network stack for the VirtualTap.
  *
- * @param
+ * @usage Each VirtualTap owns one IPv4 and one IPv6 interface, created on the first address of
+ *        each family. Later IPv6 addresses are added to the existing interface, a later IPv4
+ *        address replaces the current one.
  * @param tapref Reference to VirtualTap that will be responsible for sending and receiving data
  * @param mac Virtual hardware address for this ZeroTier VirtualTap interface
  * @param ip Virtual IP address for this ZeroTier VirtualTap interface
@@ -73,6 +96,15 @@ void lwip_start_dhcp(void *netif);
  */
 void lwip_init_interface(void *tapref, const ZeroTier::MAC &mac, const ZeroTier::InetAddress &ip);
 
+/**
+ * @brief Remove the VirtualTap's interfaces from the network stack and free them.
+ *
+ * @usage Called when the VirtualTap is destroyed
+ * @param tapref Reference to VirtualTap whose interfaces should be removed
+ * @return
+ */
+void lwip_remove_interfaces(void *tapref);
+
 /**
  * @brief Called from the stack, outbound ethernet frames from the network stack enter the ZeroTier virtual wire here.
  *
@@ -45,9 +45,17 @@
 #define LWIP_PROVIDE_ERRNO          0
 
 /*
- * Provides core locking machinery
+ * Provides core locking machinery. Application threads calling the socket API (and the
+ * thread feeding frames in via tcpip_input) take the core lock and call into the stack
+ * directly instead of posting a message to the tcpip thread and waiting on a semaphore
  */
-#define LWIP_TCPIP_CORE_LOCKING     0
+#define LWIP_TCPIP_CORE_LOCKING       1
+#define LWIP_TCPIP_CORE_LOCKING_INPUT 1
+
+/*
+ * Depth of the tcpip thread's and each netconn's mailbox (rounded up to a power of two)
+ */
+#define SYS_MBOX_SIZE                 128
 
 /*
  * Provides a macro to spoof the names of the lwip socket functions
@@ -59,6 +67,12 @@
  */
 #define LWIP_TIMERS                 1
 
+/*
+ * Keeps timeouts in a timing wheel (O(1) insert and cancel) and lets the tcpip thread sleep
+ * until the next timeout is actually due
+ */
+#define LWIP_TIMERS_WHEEL           1
+
 /*
  *
  */
@@ -156,7 +170,20 @@
 
 #define LWIP_ETHERNET   1
 
-#define LWIP_CHKSUM_ALGORITHM 2
+/*
+ * SSE2/AVX2/NEON checksum chosen at runtime from the CPU's features, falls back to a
+ * portable loop (see ext/lwip/src/core/inet_chksum.c)
+ */
+#define LWIP_CHKSUM_ALGORITHM 4
+
+/*
+ * Payload copied in from the application (tcp_write, UDP sends) and frames libzt has to
+ * verify itself (see ZT_CHECKSUM_OFFLOAD in Defs.h) are summed in the same pass as the copy.
+ * Per-netif control lets libzt turn checksums off on its interfaces while they stay on elsewhere.
+ */
+#define LWIP_CHECKSUM_ON_COPY 1
+#define LWIP_CHKSUM_COPY_ALGORITHM 2
+#define LWIP_CHECKSUM_CTRL_PER_NETIF 1
 
 #undef TCP_MSS
 #define TCP_MSS 1460
@@ -165,20 +192,46 @@
 /*
 The TCP window size can be adjusted by changing the define TCP_WND. However,
 do keep in mind that this should be at least twice the size of TCP_MSS (thus
-on ethernet, where TCP_MSS is 1460, it should be set to at least 2920). If
-memory allows it, set this as high as possible (16-bit, so 0xFFFF is the highest
-value), but keep in mind that for every active connection, the full window may
+on ethernet, where TCP_MSS is 1460, it should be set to at least 2920). With
+window scaling the window may exceed 16 bits (up to 0xFFFF << TCP_RCV_SCALE),
+but keep in mind that for every active connection, the full window may
 have to be buffered until it is acknowledged by the remote side (although this
 buffer size can still be controlled by TCP_SND_BUF and TCP_SND_QUEUELEN). The
 reason for "twice" are both the nagle algorithm and delayed ACK from the
 remote peer.
+
+Virtual links often span continents, and a window has to cover the
+bandwidth-delay product to keep one busy: 2 MB fills ~110 Mbit/s at a 150 ms
+RTT, where 64 KB would stall at ~3.5 Mbit/s. Memory profiles
+(zts_set_memory_profile) lower the window and send buffer of new connections.
 */
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE  6
+#define TCP_WND        (2 * 1024 * 1024) // max = 0xffff << TCP_RCV_SCALE, min = TCP_MSS*2
 
-#define TCP_WND 0xffff // max = 0xffff, min = TCP_MSS*2
+/*
+ * Timestamps give an RTT sample for every ACK instead of one per window, and SACK lets fast
+ * recovery repair several losses in one window instead of waiting for the retransmission timer
+ */
+#define LWIP_TCP_TIMESTAMPS 1
+#define LWIP_TCP_SACK       1
+
+/*
+ * Each TCP receive mailbox has to hold a window of segments the application hasn't read, else
+ * lwIP drops further data until it can hand over what was refused. Sized when the socket is
+ * created from the window of the memory profile, with a floor for senders of small segments
+ */
+#define DEFAULT_TCP_RECVMBOX_SIZE ((int)LWIP_MAX(64, tcp_default_wnd / TCP_MSS))
 
 #define LWIP_NOASSERT 1
 #define TCP_LISTEN_BACKLOG   0
 
+/*
+ * Demultiplexes incoming segments through hash tables of the active, TIME-WAIT and
+ * listening PCBs instead of walking their lists
+ */
+#define TCP_PCB_HASH         1
+
 /*------------------------------------------------------------------------------
 ---------------------------------- Timers --------------------------------------
 ------------------------------------------------------------------------------*/
@@ -240,6 +293,33 @@ happening sooner than they should.
 #define MEM_LIBC_MALLOC 1
 #define MEMP_MEM_MALLOC 1
 
+/**
+ * MEMP_MEM_SLAB: memp pools and heap blocks of up to 4 KB come from slabs with per-thread
+ * caches (ports/unix/port/memp_slab.c), so no allocation or free takes a lock. The slab
+ * allocator needs pthreads and mmap, Windows builds keep plain malloc.
+ */
+#if !defined(_WIN32)
+#define MEMP_MEM_SLAB 1
+#else
+#define MEMP_MEM_SLAB 0
+#endif
+
+#if MEMP_MEM_SLAB
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+void *mem_slab_malloc(size_t size);
+void *mem_slab_calloc(size_t count, size_t size);
+void mem_slab_free(void *mem);
+#ifdef __cplusplus
+}
+#endif
+#define mem_clib_malloc mem_slab_malloc
+#define mem_clib_calloc mem_slab_calloc
+#define mem_clib_free mem_slab_free
+#endif /* MEMP_MEM_SLAB */
+
 
 
 /**
@@ -254,10 +334,16 @@ happening sooner than they should.
  * a lot of data that needs to be copied, this should be set high.
  */
 #define MEM_SIZE                        1024 * 1024 * 64
-#define TCP_SND_BUF                     1024 * 63
+#define TCP_SND_BUF                     (2 * 1024 * 1024)
 //#define TCP_OVERSIZE                    TCP_MSS
 
-#define TCP_SND_QUEUELEN                1024
+#define TCP_SND_QUEUELEN                (4 * (TCP_SND_BUF) / (TCP_MSS))
+
+/*
+ * Free send buffer space at which a socket polls writable again. Fixed instead of lwIP's default
+ * of half TCP_SND_BUF, so that the smaller send buffers of memory profiles can still reach it
+ */
+#define TCP_SNDLOWAT                    (4 * TCP_MSS)
 
 /*------------------------------------------------------------------------------
 -------------------------------- Pbuf Options ----------------------------------
@@ -278,6 +364,13 @@ happening sooner than they should.
  */
 #define PBUF_POOL_BUFSIZE               LWIP_MEM_ALIGN_SIZE(TCP_MSS+40+PBUF_LINK_HLEN)
 
+/**
+ * LWIP_SUPPORT_CUSTOM_PBUF==1: Allow custom pbufs. The driver uses these to hand
+ * received frames to the stack in pre-allocated contiguous frame buffers
+ * (see ZT_RX_FRAME_POOL_SIZE)
+ */
+#define LWIP_SUPPORT_CUSTOM_PBUF        1
+
 
 /*------------------------------------------------------------------------------
 -------------------------- Internal Memory Pool Sizes --------------------------
@@ -382,6 +475,14 @@ happening sooner than they should.
  */
 #define LWIP_ARP                        1
 
+/*
+ * Sized for large virtual networks; the ARP table and the IPv6 neighbor
+ * cache are indexed by hash with LRU eviction so lookups stay constant-time
+ */
+#define LWIP_NEIGHBOR_HASH              1
+#define ARP_TABLE_SIZE                  1024
+#define LWIP_ND6_NUM_NEIGHBORS          1024
+
 
 /*------------------------------------------------------------------------------
 ------------------------------------ IP options---------------------------------
@@ -394,6 +495,34 @@ happening sooner than they should.
  */
 #define IP_FORWARD                      0
 
+/**
+ * LWIP_HOOK_IP4_ROUTE_SRC: Packets with a source address leave through the interface which
+ * owns that address. Each VirtualTap has its own interface in this one stack, and without
+ * the hook the first interface whose subnet matches the destination would be picked.
+ * Packets matching no interface at all leave through the first IPv4 network joined, as
+ * netif_default is the IPv6 default. (implemented in src/lwIP.cpp)
+ */
+struct netif;
+struct ip4_addr;
+#ifdef __cplusplus
+extern "C"
+#endif
+struct netif *lwip_route_by_src(const struct ip4_addr *dest, const struct ip4_addr *src);
+#define LWIP_HOOK_IP4_ROUTE_SRC(dest, src) lwip_route_by_src(dest, src)
+
+/**
+ * LWIP_HOOK_ND6_GET_LLADDR: RFC4193 and 6PLANE addresses embed the peer's ZeroTier address,
+ * and a ZeroTier MAC is derived from that address and the network ID, so neighbors in those
+ * prefixes get a static cache entry instead of a Neighbor Solicitation round trip.
+ * (implemented in src/lwIP.cpp)
+ */
+struct ip6_addr;
+#ifdef __cplusplus
+extern "C"
+#endif
+int lwip_nd6_get_lladdr(struct netif *netif, const struct ip6_addr *dest, unsigned char *lladdr);
+#define LWIP_HOOK_ND6_GET_LLADDR(netif, dest, lladdr) lwip_nd6_get_lladdr(netif, dest, lladdr)
+
 /**
  * IP_OPTIONS: Defines the behavior for IP options.
  *      IP_OPTIONS_ALLOWED==0: All packets with IP options are dropped.
@@ -69,6 +69,9 @@ CFLAGS=$(WINDEFS) -Wno-format -Wno-deprecated -O3 -g -Wall -fPIC $(LWIPINCLUDES)
 ifeq ($(NS_DEBUG),1)
 CFLAGS+=-DLWIP_DEBUG=1
 endif
+ifeq ($(HUGEPAGES),1)
+CFLAGS+=-DMEMP_SLAB_HUGEPAGES=1
+endif
 #ifeq ($(IPV4),1)
 CFLAGS+=-DLWIP_IPV4=1 -DIPv4
 #endif
@@ -35,6 +35,21 @@
 
 #include <memory.h>
 #include <algorithm>
+#include <atomic>
+#if !defined(_WIN32)
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Assumed cache line size, used to keep the producer and consumer indices of
+ * SPSCRingBuffer from sharing a line
+ */
+#ifndef ZT_CACHE_LINE_SZ
+#define ZT_CACHE_LINE_SZ 64
+#endif
 
 namespace ZeroTier {
 
@@ -180,6 +195,314 @@ namespace ZeroTier {
 		size_t getFree() {
 			return size - count();
 		}
+
+		// struct iovec comes from sys/uio.h, which Windows does not have
+#if !defined(_WIN32)
+		/**
+		* Fill iov with the contiguous region(s) holding readable data, starting at the read
+		* index. Lengths are in bytes. Call consume() with the number of elements taken out.
+		* Returns the number of regions (0, 1 or 2).
+		*/
+		int get_readable_iov(struct iovec iov[2])
+		{
+			const size_t n = count();
+			if (n == 0) {
+				return 0;
+			}
+			const size_t first_chunk = std::min(n, size - begin);
+			iov[0].iov_base = buf + begin;
+			iov[0].iov_len = first_chunk * sizeof(T);
+			if (first_chunk == n) {
+				return 1;
+			}
+			iov[1].iov_base = buf;
+			iov[1].iov_len = (n - first_chunk) * sizeof(T);
+			return 2;
+		}
+
+		/**
+		* Fill iov with the contiguous region(s) of free space, starting at the write index.
+		* Lengths are in bytes. Call produce() with the number of elements put in.
+		* Returns the number of regions (0, 1 or 2).
+		*/
+		int get_writable_iov(struct iovec iov[2])
+		{
+			const size_t n = getFree();
+			if (n == 0) {
+				return 0;
+			}
+			const size_t first_chunk = std::min(n, size - end);
+			iov[0].iov_base = buf + end;
+			iov[0].iov_len = first_chunk * sizeof(T);
+			if (first_chunk == n) {
+				return 1;
+			}
+			iov[1].iov_base = buf;
+			iov[1].iov_len = (n - first_chunk) * sizeof(T);
+			return 2;
+		}
+#endif
  	};
+
+	/**
+	 * Lock-free single-producer/single-consumer variant of RingBuffer. One thread may call
+	 * write() and produce() while another calls read(), consume(), get_buf() and reset(),
+	 * without any additional locking. count() and getFree() may be called from either side.
+	 *
+	 * The capacity is rounded up to a power of two so that indices can be wrapped with a
+	 * mask. Both indices increase monotonically and only their difference is meaningful.
+	 *
+	 * A mirrored buffer maps the same memory twice back to back, so any readable or writable
+	 * region is contiguous even across the wrap (its capacity is also rounded up to a multiple
+	 * of the page size). If the mapping can't be set up a regular buffer is used instead.
+	 */
+	template<typename T> class SPSCRingBuffer {
+
+	private:
+		T * buf;
+		size_t size;
+		size_t mask;
+		bool mirrored;
+
+		// consumer side
+		alignas(ZT_CACHE_LINE_SZ) std::atomic<size_t> begin;
+		size_t end_cache; // last value of end seen by the consumer
+
+		// producer side
+		alignas(ZT_CACHE_LINE_SZ) std::atomic<size_t> end;
+		size_t begin_cache; // last value of begin seen by the producer
+
+		static size_t round_up(size_t n)
+		{
+			size_t p = 1;
+			while (p < n) {
+				p <<= 1;
+			}
+			return p;
+		}
+
+#if !defined(_WIN32)
+		// map len bytes of shared memory twice, back to back
+		static void *map_mirrored(size_t len)
+		{
+			int fd = -1;
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+			fd = memfd_create("zt_ringbuffer", MFD_CLOEXEC);
+#endif
+			if (fd < 0) {
+				char path[] = "/tmp/zt_ringbuffer_XXXXXX";
+				if ((fd = mkstemp(path)) < 0) {
+					return NULL;
+				}
+				unlink(path);
+			}
+			void *base = MAP_FAILED;
+			if (ftruncate(fd, len) == 0) {
+				// reserve the whole range first so that both halves end up adjacent
+				base = mmap(NULL, 2 * len, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+			}
+			if (base != MAP_FAILED) {
+				if (mmap(base, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+					|| mmap((char *)base + len, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+					munmap(base, 2 * len);
+					base = MAP_FAILED;
+				}
+			}
+			close(fd);
+			return base == MAP_FAILED ? NULL : base;
+		}
+#endif
+
+		// number of elements the consumer may read, re-reads end only when needed
+		size_t readable(size_t b, size_t want)
+		{
+			size_t n = end_cache - b;
+			if (n < want) {
+				end_cache = end.load(std::memory_order_acquire);
+				n = end_cache - b;
+			}
+			return n;
+		}
+
+		// number of elements the producer may write, re-reads begin only when needed
+		size_t writable(size_t e, size_t want)
+		{
+			size_t n = size - (e - begin_cache);
+			if (n < want) {
+				begin_cache = begin.load(std::memory_order_acquire);
+				n = size - (e - begin_cache);
+			}
+			return n;
+		}
+
+#if !defined(_WIN32)
+		// describe n elements starting at index i as at most two regions of buf
+		int get_iov(struct iovec iov[2], size_t i, size_t n)
+		{
+			if (n == 0) {
+				return 0;
+			}
+			const size_t off = i & mask;
+			const size_t first_chunk = mirrored ? n : std::min(n, size - off);
+			iov[0].iov_base = buf + off;
+			iov[0].iov_len = first_chunk * sizeof(T);
+			if (first_chunk == n) {
+				return 1;
+			}
+			iov[1].iov_base = buf;
+			iov[1].iov_len = (n - first_chunk) * sizeof(T);
+			return 2;
+		}
+#endif
+
+	public:
+		/**
+		* create a SPSCRingBuffer with space for at least size elements.
+		*/
+		explicit SPSCRingBuffer(size_t size, bool mirror = false)
+			: buf(NULL),
+			size(round_up(size)),
+			mask(round_up(size) - 1),
+			mirrored(false),
+			begin(0),
+			end_cache(0),
+			end(0),
+			begin_cache(0)
+		{
+#if !defined(_WIN32)
+			if (mirror) {
+				const size_t page_sz = sysconf(_SC_PAGESIZE);
+				while ((this->size * sizeof(T)) % page_sz) {
+					this->size <<= 1;
+				}
+				mask = this->size - 1;
+				buf = (T *)map_mirrored(this->size * sizeof(T));
+				mirrored = buf != NULL;
+			}
+#endif
+			if (buf == NULL) {
+				buf = new T[this->size];
+			}
+		}
+
+		SPSCRingBuffer(const SPSCRingBuffer<T> &) = delete;
+		SPSCRingBuffer<T> & operator=(const SPSCRingBuffer<T> &) = delete;
+
+		~SPSCRingBuffer()
+		{
+#if !defined(_WIN32)
+			if (mirrored) {
+				munmap(buf, 2 * size * sizeof(T));
+				return;
+			}
+#endif
+			delete[] buf;
+		}
+
+		// get a reference to the underlying buffer at the read index (consumer)
+		T* get_buf()
+		{
+			return buf + (begin.load(std::memory_order_relaxed) & mask);
+		}
+
+		// adjust buffer index pointer as if we copied data in (producer)
+		size_t produce(size_t n)
+		{
+			const size_t e = end.load(std::memory_order_relaxed);
+			n = std::min(n, writable(e, n));
+			if (n) {
+				end.store(e + n, std::memory_order_release);
+			}
+			return n;
+		}
+
+		// drop all readable contents (consumer)
+		void reset()
+		{
+			end_cache = end.load(std::memory_order_acquire);
+			begin.store(end_cache, std::memory_order_release);
+		}
+
+		// adjust buffer index pointer as if we copied data out (consumer)
+		size_t consume(size_t n)
+		{
+			const size_t b = begin.load(std::memory_order_relaxed);
+			n = std::min(n, readable(b, n));
+			if (n) {
+				begin.store(b + n, std::memory_order_release);
+			}
+			return n;
+		}
+
+		// (producer)
+		size_t write(const T * data, size_t n)
+		{
+			const size_t e = end.load(std::memory_order_relaxed);
+			n = std::min(n, writable(e, n));
+			if (n == 0) {
+				return n;
+			}
+			const size_t off = e & mask;
+			const size_t first_chunk = mirrored ? n : std::min(n, size - off);
+			memcpy(buf + off, data, first_chunk * sizeof(T));
+			if (first_chunk < n) {
+				memcpy(buf, data + first_chunk, (n - first_chunk) * sizeof(T));
+			}
+			end.store(e + n, std::memory_order_release);
+			return n;
+		}
+
+		// (consumer)
+		size_t read(T * dest, size_t n)
+		{
+			const size_t b = begin.load(std::memory_order_relaxed);
+			n = std::min(n, readable(b, n));
+			if (n == 0) {
+				return n;
+			}
+			const size_t off = b & mask;
+			const size_t first_chunk = mirrored ? n : std::min(n, size - off);
+			memcpy(dest, buf + off, first_chunk * sizeof(T));
+			if (first_chunk < n) {
+				memcpy(dest + first_chunk, buf, (n - first_chunk) * sizeof(T));
+			}
+			begin.store(b + n, std::memory_order_release);
+			return n;
+		}
+
+		size_t count() {
+			// begin must be loaded first, it can never pass a later value of end
+			const size_t b = begin.load(std::memory_order_acquire);
+			return end.load(std::memory_order_acquire) - b;
+		}
+
+		size_t getFree() {
+			return size - count();
+		}
+
+		size_t capacity() {
+			return size;
+		}
+
+		bool is_mirrored() {
+			return mirrored;
+		}
+
+#if !defined(_WIN32)
+		// same as RingBuffer::get_readable_iov(), a mirrored buffer yields a single region (consumer)
+		int get_readable_iov(struct iovec iov[2])
+		{
+			const size_t b = begin.load(std::memory_order_relaxed);
+			return get_iov(iov, b, readable(b, size));
+		}
+
+		// same as RingBuffer::get_writable_iov(), a mirrored buffer yields a single region (producer)
+		int get_writable_iov(struct iovec iov[2])
+		{
+			const size_t e = end.load(std::memory_order_relaxed);
+			return get_iov(iov, e, writable(e, size));
+		}
+#endif
+	};
 }
 #endif // ZT_RINGBUFFER_HPP
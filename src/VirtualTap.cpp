@@ -56,6 +56,7 @@
 #include "ZT1Service.h"
 
 #include "Utils.hpp"
+#include "OSUtils.hpp"
 #include "Mutex.hpp"
 #include "Constants.hpp"
 #include "InetAddress.hpp"
@@ -82,6 +83,7 @@ namespace ZeroTier {
 			unsigned int,unsigned int,const void *,unsigned int),
 		void *arg) :
 			_handler(handler),
+			_handler_v(NULL),
 			_homePath(homePath),
 			_arg(arg),
 			_initialized(false),
@@ -118,6 +120,12 @@ namespace ZeroTier {
 		_phy.whack();
 		Thread::join(_thread);
 		_phy.close(_unixListenSocket,false);
+#if defined(STACK_LWIP)
+		lwip_remove_interfaces((void*)this);
+#endif
+		ZeroTier::_vtaps_lock.lock();
+		ZeroTier::vtaps.erase(std::remove(ZeroTier::vtaps.begin(), ZeroTier::vtaps.end(), (void*)this), ZeroTier::vtaps.end());
+		ZeroTier::_vtaps_lock.unlock();
 	}
 
 	void VirtualTap::setEnabled(bool en)
@@ -240,9 +248,12 @@ namespace ZeroTier {
 	void VirtualTap::threadMain()
 		throw()
 	{
-		while (true) {
-			_phy.poll(ZT_PHY_POLL_INTERVAL);
+		// sleep in poll() until either the next housekeeping deadline or until woken by whack()
+		while (_run) {
 			Housekeeping();
+			uint64_t now = OSUtils::now();
+			uint64_t next_housekeeping_ts = last_housekeeping_ts + (ZT_HOUSEKEEPING_INTERVAL * 1000);
+			_phy.poll((unsigned long)(next_housekeeping_ts > now ? next_housekeeping_ts - now : 0));
 		}
 	}
 
@@ -400,9 +411,9 @@ namespace ZeroTier {
 
 	void VirtualTap::Housekeeping()
 	{
-		Mutex::Lock _l(_tcpconns_m);
-		std::time_t current_ts = std::time(nullptr);
-		if (current_ts > last_housekeeping_ts + ZT_HOUSEKEEPING_INTERVAL) {
+		// threadMain() also calls us when poll() returns early, so check the deadline before locking
+		if (OSUtils::now() >= last_housekeeping_ts + (ZT_HOUSEKEEPING_INTERVAL * 1000)) {
+			Mutex::Lock _l(_tcpconns_m);
 			// DEBUG_EXTRA();
 			// update managed routes (add/del from network stacks)
 			ZeroTier::OneService *service = ((ZeroTier::OneService *)zt1ServiceRef);
@@ -458,7 +469,7 @@ namespace ZeroTier {
 				}
 			}
 			// TODO: Clean up VirtualSocket objects
-			last_housekeeping_ts = std::time(nullptr);
+			last_housekeeping_ts = OSUtils::now();
 		}
 	}
 
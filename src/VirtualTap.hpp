@@ -50,6 +50,15 @@
 
 namespace ZeroTier {
 
+	/**
+	 * A contiguous piece of an outbound Ethernet frame payload (see VirtualTap::_handler_v)
+	 */
+	struct FrameSegment
+	{
+		const void *data;
+		unsigned int len;
+	};
+
 	/**
 	 * emulates an Ethernet tap device
 	 */
@@ -146,6 +155,17 @@ namespace ZeroTier {
 		void (*_handler)(void *, void *, uint64_t, const MAC &, const MAC &, unsigned int, unsigned int,
 			const void *, unsigned int);
 
+		/**
+		 * Optional scatter/gather variant of _handler. If set, frames which the network stack
+		 * hands us as a chain of buffers are passed along as a list of segments (followed by
+		 * the segment count and the total payload length) instead of being flattened first.
+		 * Only the VirtualWire sets it: the ZeroTier service hands frames to
+		 * Node::processVirtualNetworkFrame(), which takes one contiguous buffer, so chained
+		 * frames headed for a real network are still flattened (single buffers are not copied).
+		 */
+		void (*_handler_v)(void *, void *, uint64_t, const MAC &, const MAC &, unsigned int, unsigned int,
+			const FrameSegment *, unsigned int, unsigned int);
+
 		/**
 		 * Signals us to close the TcpVirtualSocket associated with this PhySocket
 		 */
@@ -202,6 +222,12 @@ namespace ZeroTier {
 		std::vector<std::pair<ZeroTier::InetAddress, ZeroTier::InetAddress>> routes;
 		void *zt1ServiceRef = NULL;
 
+		/**
+		 * Network stack interfaces owned by this VirtualTap (struct netif * when using lwIP)
+		 */
+		void *netif4 = NULL;
+		void *netif6 = NULL;
+
 		char vtap_full_name[64];
 		char vtap_abbr_name[16];
 
@@ -232,10 +258,10 @@ namespace ZeroTier {
 		Mutex _ips_m, _tcpconns_m, _rx_buf_m, _close_m;
 
 		/*
-		 * Timestamp of last run of housekeeping
-		 * SEE: ZT_HOUSEKEEPING_INTERVAL in libzt.h
+		 * Timestamp (in ms) of last run of housekeeping
+		 * SEE: ZT_HOUSEKEEPING_INTERVAL in Defs.h
 		 */
-		std::time_t last_housekeeping_ts = 0;
+		uint64_t last_housekeeping_ts = 0;
 
 		/****************************************************************************/
 		/* In these, we will call the stack's corresponding functions, this is      */
@@ -288,7 +314,8 @@ namespace ZeroTier {
 		int Shutdown(int how);
 
 		/**
-		 * Disposes of previously-closed VirtualSockets
+		 * Disposes of previously-closed VirtualSockets and syncs managed routes. Called from
+		 * threadMain() whenever it wakes up, does its work once every ZT_HOUSEKEEPING_INTERVAL
 		 */
 		void Housekeeping();
 
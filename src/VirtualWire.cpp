@@ -0,0 +1,438 @@
+/*
+ * ZeroTier SDK - Network Virtualization Everywhere
+ * Copyright (C) 2011-2017  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+/**
+ * @file
+ *
+ * In-process stand-in for the ZeroTier virtual wire
+ */
+
+#include <errno.h>
+#include <chrono>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "VirtualWire.hpp"
+#include "VirtualTap.hpp"
+
+#include "libzt.h"
+
+namespace ZeroTier {
+
+	/**
+	 * Shared memory segment connecting the wires of two processes, one single-producer/
+	 * single-consumer ring of frames per direction
+	 */
+	struct VirtualWire::ShmSegment
+	{
+		struct Ring
+		{
+			alignas(64) std::atomic<uint64_t> head; // advanced by the receiver
+			alignas(64) std::atomic<uint64_t> tail; // advanced by the sender
+			alignas(64) char data[ZT_VWIRE_SHM_RING_SZ];
+		} rings[2];
+	};
+
+	/**
+	 * Header of a frame in a shared memory ring, followed by the payload and padded to 8 bytes
+	 */
+	struct ShmFrameHdr
+	{
+		uint32_t len;
+		uint32_t etherType;
+		uint64_t nwid;
+		uint64_t from;
+		uint64_t to;
+	};
+
+	static uint64_t now_us()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static void ring_copy_in(char *ring, uint64_t pos, const void *src, size_t len)
+	{
+		const size_t off = pos & (ZT_VWIRE_SHM_RING_SZ - 1);
+		const size_t first_chunk = std::min(len, (size_t)ZT_VWIRE_SHM_RING_SZ - off);
+		memcpy(ring + off, src, first_chunk);
+		memcpy(ring, (const char *)src + first_chunk, len - first_chunk);
+	}
+
+	static void ring_copy_out(const char *ring, uint64_t pos, void *dest, size_t len)
+	{
+		const size_t off = pos & (ZT_VWIRE_SHM_RING_SZ - 1);
+		const size_t first_chunk = std::min(len, (size_t)ZT_VWIRE_SHM_RING_SZ - off);
+		memcpy(dest, ring + off, first_chunk);
+		memcpy((char *)dest + first_chunk, ring, len - first_chunk);
+	}
+
+	VirtualWire::VirtualWire() :
+		_latency(0),
+		_loss(0.0),
+		_bandwidth(0),
+		_queue_len(ZT_VWIRE_QUEUE_LEN),
+		_link_free_ts(0),
+		_rng(1),
+		_shm(NULL),
+		_shm_creator(false),
+		_delivered(0),
+		_dropped(0),
+		_run(true)
+	{
+		_thread = Thread::start(this);
+	}
+
+	VirtualWire::~VirtualWire()
+	{
+		{
+			std::lock_guard<std::mutex> l(_m);
+			_run = false;
+			_cv.notify_one();
+		}
+		Thread::join(_thread);
+		// taps may still hand us frames while they are torn down, these are dropped
+		while (_taps.size()) {
+			detach(_taps.back().tap);
+		}
+		for (size_t i=0; i<_owned_taps.size(); i++) {
+			delete _owned_taps[i];
+		}
+		for (size_t i=0; i<_queue.size(); i++) {
+			delete _queue[i];
+		}
+		for (size_t i=0; i<_free_frames.size(); i++) {
+			delete _free_frames[i];
+		}
+#if !defined(_WIN32)
+		if (_shm) {
+			munmap(_shm, sizeof(ShmSegment));
+			if (_shm_creator) {
+				shm_unlink(_shm_name.c_str());
+			}
+		}
+#endif
+	}
+
+	VirtualTap *VirtualWire::addTap(const MAC &mac, uint64_t nwid, unsigned int mtu)
+	{
+		VirtualTap *tap = new VirtualTap("", mac, mtu, 0, nwid, "virtual wire", onFrame, this);
+		_owned_taps.push_back(tap);
+		attach(tap);
+		return tap;
+	}
+
+	void VirtualWire::attach(VirtualTap *tap)
+	{
+		Mutex::Lock _l(_taps_m);
+		Attachment a;
+		a.tap = tap;
+		a.handler = tap->_handler;
+		a.handler_v = tap->_handler_v;
+		a.arg = tap->_arg;
+		tap->_handler = onFrame;
+		tap->_handler_v = onFrameV;
+		tap->_arg = this;
+		_taps.push_back(a);
+	}
+
+	void VirtualWire::detach(VirtualTap *tap)
+	{
+		Mutex::Lock _l(_taps_m);
+		for (size_t i=0; i<_taps.size(); i++) {
+			if (_taps[i].tap == tap) {
+				tap->_handler = _taps[i].handler;
+				tap->_handler_v = _taps[i].handler_v;
+				tap->_arg = _taps[i].arg;
+				_taps.erase(_taps.begin() + i);
+				return;
+			}
+		}
+	}
+
+	void VirtualWire::setLatency(unsigned int usecs)
+	{
+		std::lock_guard<std::mutex> l(_m);
+		_latency = usecs;
+	}
+
+	void VirtualWire::setLoss(double probability)
+	{
+		std::lock_guard<std::mutex> l(_m);
+		_loss = probability;
+	}
+
+	void VirtualWire::setBandwidth(uint64_t bps)
+	{
+		std::lock_guard<std::mutex> l(_m);
+		_bandwidth = bps;
+	}
+
+	void VirtualWire::setQueueLength(unsigned int frames)
+	{
+		std::lock_guard<std::mutex> l(_m);
+		_queue_len = frames;
+	}
+
+	bool VirtualWire::attachShm(const char *name, bool create)
+	{
+#if defined(_WIN32)
+		DEBUG_ERROR("shared memory wires are not supported on this platform");
+		return false;
+#else
+		if (_shm) {
+			DEBUG_ERROR("already attached to a shared memory segment");
+			return false;
+		}
+		int fd = shm_open(name, create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0600);
+		if (fd < 0) {
+			DEBUG_ERROR("unable to open shared memory segment %s (errno=%d)", name, errno);
+			return false;
+		}
+		if (create && ftruncate(fd, sizeof(ShmSegment)) < 0) {
+			DEBUG_ERROR("unable to size shared memory segment %s (errno=%d)", name, errno);
+			close(fd);
+			shm_unlink(name);
+			return false;
+		}
+		void *seg = mmap(NULL, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (seg == MAP_FAILED) {
+			DEBUG_ERROR("unable to map shared memory segment %s (errno=%d)", name, errno);
+			if (create) {
+				shm_unlink(name);
+			}
+			return false;
+		}
+		ShmSegment *shm = (ShmSegment *)seg;
+		if (create) {
+			for (int i=0; i<2; i++) {
+				shm->rings[i].head.store(0);
+				shm->rings[i].tail.store(0);
+			}
+		}
+		std::lock_guard<std::mutex> l(_m);
+		_shm_name = name;
+		_shm_creator = create;
+		_shm = shm;
+		_cv.notify_one();
+		return true;
+#endif
+	}
+
+	VirtualWire::Frame *VirtualWire::enqueue(uint64_t nwid, const MAC &from, const MAC &to,
+		unsigned int etherType, unsigned int len)
+	{
+		if (!_run) {
+			return NULL;
+		}
+		if (_queue.size() >= _queue_len
+			|| (_loss > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(_rng) < _loss)) {
+			_dropped++;
+			return NULL;
+		}
+		uint64_t ts = now_us();
+		if (_bandwidth) {
+			// frames are serialized one after another, ethernet header included
+			_link_free_ts = std::max(_link_free_ts, ts) + (((uint64_t)len + 14) * 8 * 1000000) / _bandwidth;
+			ts = _link_free_ts;
+		}
+		Frame *f;
+		if (_free_frames.size()) {
+			f = _free_frames.back();
+			_free_frames.pop_back();
+		}
+		else {
+			f = new Frame();
+		}
+		f->due = ts + _latency;
+		f->nwid = nwid;
+		f->from = from;
+		f->to = to;
+		f->etherType = etherType;
+		f->len = len;
+		f->remote = false;
+		if (f->data.size() < len) {
+			f->data.resize(len);
+		}
+		if (_queue.empty()) {
+			_cv.notify_one();
+		}
+		_queue.push_back(f);
+		return f;
+	}
+
+	void VirtualWire::onFrame(void *arg, void *unused, uint64_t nwid, const MAC &from, const MAC &to,
+		unsigned int etherType, unsigned int vlanId, const void *data, unsigned int len)
+	{
+		VirtualWire *wire = (VirtualWire *)arg;
+		std::lock_guard<std::mutex> l(wire->_m);
+		Frame *f = wire->enqueue(nwid, from, to, etherType, len);
+		if (f) {
+			memcpy(f->data.data(), data, len);
+		}
+	}
+
+	void VirtualWire::onFrameV(void *arg, void *unused, uint64_t nwid, const MAC &from, const MAC &to,
+		unsigned int etherType, unsigned int vlanId, const FrameSegment *segs, unsigned int nsegs,
+		unsigned int len)
+	{
+		VirtualWire *wire = (VirtualWire *)arg;
+		std::lock_guard<std::mutex> l(wire->_m);
+		Frame *f = wire->enqueue(nwid, from, to, etherType, len);
+		if (f) {
+			char *dest = f->data.data();
+			for (unsigned int i=0; i<nsegs; i++) {
+				memcpy(dest, segs[i].data, segs[i].len);
+				dest += segs[i].len;
+			}
+		}
+	}
+
+	void VirtualWire::deliver(Frame *f)
+	{
+		bool delivered = false;
+		{
+			Mutex::Lock _l(_taps_m);
+			for (size_t i=0; i<_taps.size(); i++) {
+				VirtualTap *tap = _taps[i].tap;
+				if (tap->_nwid != f->nwid) {
+					continue;
+				}
+				// a unicast frame to the sender's own MAC is looped back to it, this happens when
+				// the stack shared by all local taps talks to one of its own addresses
+				if ((f->to.isMulticast() && tap->_mac != f->from) || tap->_mac == f->to) {
+					tap->put(f->from, f->to, f->etherType, f->data.data(), f->len);
+					delivered = true;
+				}
+			}
+		}
+		if (_shm && !f->remote) {
+			delivered = shmSend(f) || delivered;
+		}
+		if (delivered) {
+			_delivered++;
+		}
+	}
+
+	bool VirtualWire::shmSend(Frame *f)
+	{
+		ShmSegment::Ring *ring = &_shm->rings[_shm_creator ? 0 : 1];
+		const uint64_t rec_len = (sizeof(ShmFrameHdr) + f->len + 7) & ~(uint64_t)7;
+		const uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+		if (ZT_VWIRE_SHM_RING_SZ - (tail - ring->head.load(std::memory_order_acquire)) < rec_len) {
+			_dropped++;
+			return false;
+		}
+		ShmFrameHdr hdr;
+		hdr.len = f->len;
+		hdr.etherType = f->etherType;
+		hdr.nwid = f->nwid;
+		hdr.from = f->from.toInt();
+		hdr.to = f->to.toInt();
+		ring_copy_in(ring->data, tail, &hdr, sizeof(hdr));
+		ring_copy_in(ring->data, tail + sizeof(hdr), f->data.data(), f->len);
+		ring->tail.store(tail + rec_len, std::memory_order_release);
+		return true;
+	}
+
+	void VirtualWire::shmReceive(Frame *f)
+	{
+		ShmSegment::Ring *ring = &_shm->rings[_shm_creator ? 1 : 0];
+		uint64_t head = ring->head.load(std::memory_order_relaxed);
+		const uint64_t tail = ring->tail.load(std::memory_order_acquire);
+		while (head != tail) {
+			// the other process writes the segment, nothing read from it is trusted
+			ShmFrameHdr hdr;
+			const uint64_t avail = tail - head;
+			if (avail >= sizeof(hdr)) {
+				ring_copy_out(ring->data, head, &hdr, sizeof(hdr));
+			}
+			if (avail > ZT_VWIRE_SHM_RING_SZ || avail < sizeof(hdr) || hdr.len > ZT_MAX_MTU
+				|| ((sizeof(ShmFrameHdr) + hdr.len + 7) & ~(uint64_t)7) > avail) {
+				DEBUG_ERROR("dropped malformed frames from shared memory segment %s", _shm_name.c_str());
+				_dropped++;
+				ring->head.store(tail, std::memory_order_release);
+				return;
+			}
+			if (f->data.size() < hdr.len) {
+				f->data.resize(hdr.len);
+			}
+			ring_copy_out(ring->data, head + sizeof(hdr), f->data.data(), hdr.len);
+			head += (sizeof(ShmFrameHdr) + hdr.len + 7) & ~(uint64_t)7;
+			ring->head.store(head, std::memory_order_release);
+			f->nwid = hdr.nwid;
+			f->from = MAC(hdr.from);
+			f->to = MAC(hdr.to);
+			f->etherType = hdr.etherType;
+			f->len = hdr.len;
+			f->remote = true;
+			deliver(f);
+		}
+	}
+
+	void VirtualWire::threadMain()
+		throw()
+	{
+		Frame rx_frame;
+		std::unique_lock<std::mutex> l(_m);
+		while (_run) {
+			while (_queue.size() && _queue.front()->due <= now_us()) {
+				Frame *f = _queue.front();
+				_queue.pop_front();
+				l.unlock();
+				deliver(f);
+				l.lock();
+				_free_frames.push_back(f);
+			}
+			if (_shm) {
+				l.unlock();
+				shmReceive(&rx_frame);
+				l.lock();
+			}
+			if (!_run) {
+				break;
+			}
+			// sleep until the next frame is due, new frames at the head of the queue wake us up
+			uint64_t wait = _shm ? ZT_VWIRE_SHM_POLL_INTERVAL : 1000000;
+			if (_queue.size()) {
+				const uint64_t now = now_us();
+				const uint64_t due = _queue.front()->due;
+				wait = std::min(wait, due > now ? due - now : 0);
+			}
+			if (wait) {
+				_cv.wait_for(l, std::chrono::microseconds(wait));
+			}
+		}
+	}
+
+} // namespace ZeroTier
@@ -0,0 +1,208 @@
+/*
+ * ZeroTier SDK - Network Virtualization Everywhere
+ * Copyright (C) 2011-2017  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+/**
+ * @file
+ *
+ * In-process stand-in for the ZeroTier virtual wire
+ */
+
+#ifndef ZT_VIRTUALWIRE_HPP
+#define ZT_VIRTUALWIRE_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Mutex.hpp"
+#include "MAC.hpp"
+#include "Thread.hpp"
+
+#include "Defs.h"
+
+namespace ZeroTier {
+
+	class VirtualTap;
+	struct FrameSegment;
+
+	/**
+	 * Connects VirtualTaps to each other without ZeroTier, a controller or a network, so that
+	 * the network stack and socket layer can be exercised and benchmarked in isolation.
+	 *
+	 * Attached taps hand their outbound frames to the wire instead of to ZeroTier, and the
+	 * wire presents them to the destination tap(s) via VirtualTap::put() after applying the
+	 * configured latency, loss and bandwidth. The wire behaves like a shared segment: unicast
+	 * frames go to the tap with the destination MAC, broadcast and multicast frames go to all
+	 * other taps on the same network. Two processes can be connected by attaching their wires
+	 * to the same shared memory segment.
+	 *
+	 * All taps of one process share one network stack, so sockets carrying traffic between
+	 * two taps in the same process should be bound to the address of their own tap.
+	 */
+	class VirtualWire
+	{
+	public:
+		VirtualWire();
+
+		/**
+		 * Stops delivery, detaches all taps and destroys the taps created by addTap()
+		 */
+		~VirtualWire();
+
+		/**
+		 * Creates a VirtualTap attached to this wire, it is owned by the wire
+		 */
+		VirtualTap *addTap(const MAC &mac, uint64_t nwid, unsigned int mtu = ZT_MAX_MTU);
+
+		/**
+		 * Attaches an existing tap, its frames are sent over this wire from now on. The tap
+		 * must stay alive until it is detached, or until the wire is destroyed.
+		 */
+		void attach(VirtualTap *tap);
+
+		/**
+		 * Detaches a tap, its frames go to the handler it had before attach() again
+		 */
+		void detach(VirtualTap *tap);
+
+		/**
+		 * One-way delay added to every frame (in microseconds)
+		 */
+		void setLatency(unsigned int usecs);
+
+		/**
+		 * Probability (0.0 - 1.0) that a frame is lost
+		 */
+		void setLoss(double probability);
+
+		/**
+		 * Bandwidth of the wire in bits per second, 0 for unlimited
+		 */
+		void setBandwidth(uint64_t bps);
+
+		/**
+		 * Number of frames held in flight before further frames are dropped
+		 */
+		void setQueueLength(unsigned int frames);
+
+		/**
+		 * Connects this wire to the wire of another process through the named POSIX shared
+		 * memory segment. One side creates the segment, the other one opens it. Frames
+		 * are impaired by the sending side only.
+		 */
+		bool attachShm(const char *name, bool create);
+
+		/**
+		 * Number of frames presented to taps (or handed to the shared memory segment) so far
+		 */
+		uint64_t framesDelivered() const { return _delivered; }
+
+		/**
+		 * Number of frames lost, either on purpose or because the queue was full
+		 */
+		uint64_t framesDropped() const { return _dropped; }
+
+		/**
+		 * Delivers frames when they are due
+		 */
+		void threadMain()
+			throw();
+
+	private:
+		struct Frame
+		{
+			uint64_t due; // in microseconds
+			uint64_t nwid;
+			MAC from;
+			MAC to;
+			unsigned int etherType;
+			unsigned int len;
+			bool remote; // arrived through shared memory, isn't sent back there
+			std::vector<char> data;
+		};
+
+		struct ShmSegment;
+
+		// an attached tap and the handler it had before, restored by detach()
+		struct Attachment
+		{
+			VirtualTap *tap;
+			void (*handler)(void *, void *, uint64_t, const MAC &, const MAC &, unsigned int,
+				unsigned int, const void *, unsigned int);
+			void (*handler_v)(void *, void *, uint64_t, const MAC &, const MAC &, unsigned int,
+				unsigned int, const FrameSegment *, unsigned int, unsigned int);
+			void *arg;
+		};
+
+		static void onFrame(void *arg, void *unused, uint64_t nwid, const MAC &from, const MAC &to,
+			unsigned int etherType, unsigned int vlanId, const void *data, unsigned int len);
+		static void onFrameV(void *arg, void *unused, uint64_t nwid, const MAC &from, const MAC &to,
+			unsigned int etherType, unsigned int vlanId, const FrameSegment *segs, unsigned int nsegs,
+			unsigned int len);
+
+		// returns a frame to fill (with _m held), or NULL if it is to be dropped
+		Frame *enqueue(uint64_t nwid, const MAC &from, const MAC &to, unsigned int etherType,
+			unsigned int len);
+		void deliver(Frame *f);
+		bool shmSend(Frame *f);
+		void shmReceive(Frame *f);
+
+		std::vector<Attachment> _taps;
+		std::vector<VirtualTap *> _owned_taps;
+		Mutex _taps_m;
+
+		std::deque<Frame *> _queue;
+		std::vector<Frame *> _free_frames;
+		std::mutex _m;
+		std::condition_variable _cv;
+
+		unsigned int _latency;
+		double _loss;
+		uint64_t _bandwidth;
+		unsigned int _queue_len;
+		uint64_t _link_free_ts; // when the wire is done transmitting queued frames
+		std::minstd_rand _rng;
+
+		ShmSegment *_shm;
+		std::string _shm_name;
+		bool _shm_creator; // the creator sends on the first ring and receives on the second
+
+		std::atomic<uint64_t> _delivered;
+		std::atomic<uint64_t> _dropped;
+
+		volatile bool _run;
+		Thread _thread;
+	};
+
+} // namespace ZeroTier
+
+#endif // ZT_VIRTUALWIRE_HPP
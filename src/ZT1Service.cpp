@@ -104,8 +104,8 @@ ZeroTier::VirtualTap *getTapByAddr(ZeroTier::InetAddress *addr)
 				}
 			}
 		}
-		// check managed routes
-		if (tap == NULL) {
+		// check managed routes (none until the service is running)
+		if (tap == NULL && ZeroTier::zt1Service) {
 			std::vector<ZT_VirtualNetworkRoute> *managed_routes = ZeroTier::zt1Service->getRoutes(s->_nwid);
 			ZeroTier::InetAddress target, nm, via;
 			for (size_t i=0; i<managed_routes->size(); i++) {
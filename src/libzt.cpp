@@ -37,6 +37,7 @@
 #include "lwip/sys.h"
 #include "lwip/ip_addr.h"
 #include "lwip/netdb.h"
+#include "lwip/tcpip.h"
 #include "dns.h"
 #endif
 #if defined(NO_STACK)
@@ -45,6 +46,12 @@
 
 #include "libzt.h"
 
+#if defined(STACK_LWIP)
+// from lwIP.hpp, which can't be included next to the stack's socket headers
+int lwip_set_memory_profile(const struct zts_memory_profile *mp);
+int lwip_get_memory_usage(struct zts_memory_usage *mu);
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -326,8 +333,26 @@ int zts_poll(struct pollfd *fds, nfds_t nfds, int timeout)
 {
 	int err = -1;
 #if defined(STACK_LWIP)
-	DEBUG_ERROR("warning, this is not implemented");
-	return poll(fds, nfds, timeout);
+	// lwIP's pollfd mirrors the Linux layout and flag values, so the array can be passed as-is
+	static_assert(sizeof(struct pollfd) == sizeof(struct lwip_pollfd), "struct pollfd layout mismatch");
+	static_assert(POLLIN == LWIP_POLLIN && POLLOUT == LWIP_POLLOUT && POLLERR == LWIP_POLLERR
+		&& POLLNVAL == LWIP_POLLNVAL, "poll event flag mismatch");
+	err = lwip_poll((struct lwip_pollfd *)fds, (lwip_nfds_t)nfds, timeout);
+#endif
+#if defined(STCK_PICO)
+#endif
+#if defined(NO_STACK)
+#endif
+	return err;
+}
+#endif
+
+int zts_epoll_create(int size)
+{
+	int err = -1;
+	DEBUG_EXTRA("size=%d", size);
+#if defined(STACK_LWIP)
+	err = lwip_epoll_create(size);
 #endif
 #if defined(STCK_PICO)
 #endif
@@ -335,7 +360,40 @@ int zts_poll(struct pollfd *fds, nfds_t nfds, int timeout)
 #endif
 	return err;
 }
+
+int zts_epoll_ctl(int epfd, int op, int fd, struct zts_epoll_event *event)
+{
+	int err = -1;
+	DEBUG_EXTRA("epfd=%d, op=%d, fd=%d", epfd, op, fd);
+#if defined(STACK_LWIP)
+	// the zts_ epoll types and flags mirror lwIP's, so they can be passed as-is
+	static_assert(sizeof(struct zts_epoll_event) == sizeof(struct lwip_epoll_event), "epoll event layout mismatch");
+	static_assert(ZTS_EPOLLIN == LWIP_EPOLLIN && ZTS_EPOLLOUT == LWIP_EPOLLOUT && ZTS_EPOLLERR == LWIP_EPOLLERR
+		&& ZTS_EPOLLET == LWIP_EPOLLET && ZTS_EPOLLONESHOT == LWIP_EPOLLONESHOT, "epoll event flag mismatch");
+	static_assert(ZTS_EPOLL_CTL_ADD == LWIP_EPOLL_CTL_ADD && ZTS_EPOLL_CTL_DEL == LWIP_EPOLL_CTL_DEL
+		&& ZTS_EPOLL_CTL_MOD == LWIP_EPOLL_CTL_MOD, "epoll operation mismatch");
+	err = lwip_epoll_ctl(epfd, op, fd, (struct lwip_epoll_event *)event);
+#endif
+#if defined(STCK_PICO)
+#endif
+#if defined(NO_STACK)
+#endif
+	return err;
+}
+
+int zts_epoll_wait(int epfd, struct zts_epoll_event *events, int maxevents, int timeout)
+{
+	int err = -1;
+	//DEBUG_EXTRA();
+#if defined(STACK_LWIP)
+	err = lwip_epoll_wait(epfd, (struct lwip_epoll_event *)events, maxevents, timeout);
 #endif
+#if defined(STCK_PICO)
+#endif
+#if defined(NO_STACK)
+#endif
+	return err;
+}
 
 int zts_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, 
 	struct timeval *timeout)
@@ -424,12 +482,40 @@ ssize_t zts_send(int fd, const void *buf, size_t len, int flags)
 	return err;
 }
 
-ssize_t zts_sendmsg(int fd, const struct msghdr *msg, int flags)
+#if defined(STACK_LWIP)
+/* struct zts_msghdr has the same layout in the application as here, where struct msghdr is the
+	network stack's own. The stack's message is filled in from it field by field, and an address
+	is copied to storage for the stack so that the caller's message is left untouched */
+static void zts_msghdr_to_stack(const struct zts_msghdr *zmsg, struct msghdr *msg,
+	struct sockaddr_storage *addr)
+{
+	msg->msg_name = zmsg->msg_name;
+	msg->msg_namelen = zmsg->msg_namelen;
+	msg->msg_iov = zmsg->msg_iov;
+	msg->msg_iovlen = (int)zmsg->msg_iovlen;
+	msg->msg_control = zmsg->msg_control;
+	msg->msg_controllen = (socklen_t)zmsg->msg_controllen;
+	msg->msg_flags = zmsg->msg_flags;
+	if (addr && msg->msg_name && msg->msg_namelen <= sizeof(*addr)) {
+		memcpy(addr, msg->msg_name, msg->msg_namelen);
+		fix_addr_socket_family((struct sockaddr*)addr);
+		msg->msg_name = addr;
+	}
+}
+#endif
+
+ssize_t zts_sendmsg(int fd, const struct zts_msghdr *msg, int flags)
 {
 	int err = -1;
 	DEBUG_TRANS("fd=%d", fd);
 #if defined(STACK_LWIP)
-	err = lwip_sendmsg(fd, msg, flags);
+	struct msghdr hdr;
+	struct sockaddr_storage addr;
+	if (msg == NULL) {
+		return lwip_sendmsg(fd, NULL, flags);
+	}
+	zts_msghdr_to_stack(msg, &hdr, &addr);
+	err = lwip_sendmsg(fd, &hdr, flags);
 #endif
 #if defined(STCK_PICO)
 #endif
@@ -467,11 +553,81 @@ ssize_t zts_recvfrom(int fd, void *buf, size_t len, int flags,
 	return err;
 }
 
-ssize_t zts_recvmsg(int fd, struct msghdr *msg,int flags)
+ssize_t zts_recvmsg(int fd, struct zts_msghdr *msg,int flags)
 {
 	DEBUG_TRANS("fd=%d", fd);
 	int err = -1;
 #if defined(STACK_LWIP)
+	struct msghdr hdr;
+	if (msg == NULL) {
+		return lwip_recvmsg(fd, NULL, flags);
+	}
+	zts_msghdr_to_stack(msg, &hdr, NULL);
+	err = lwip_recvmsg(fd, &hdr, flags);
+	// the stack reports the source address length, MSG_TRUNC and how much ancillary data it returned
+	msg->msg_namelen = hdr.msg_namelen;
+	msg->msg_controllen = hdr.msg_controllen;
+	msg->msg_flags = hdr.msg_flags;
+#endif
+#if defined(STCK_PICO)
+#endif
+#if defined(NO_STACK)
+#endif
+	return err;
+}
+
+int zts_sendmmsg(int fd, struct zts_mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+	int err = -1;
+	DEBUG_TRANS("fd=%d, vlen=%d", fd, vlen);
+#if defined(STACK_LWIP)
+	// the stack's message headers are built from the caller's in batches
+	struct lwip_mmsghdr msgs[ZT_MMSG_BATCH_SZ];
+	struct sockaddr_storage addrs[ZT_MMSG_BATCH_SZ];
+	unsigned int done = 0;
+	while (done < vlen) {
+		unsigned int n = vlen - done < ZT_MMSG_BATCH_SZ ? vlen - done : ZT_MMSG_BATCH_SZ;
+		for (unsigned int i=0; i<n; i++) {
+			zts_msghdr_to_stack(&msgvec[done+i].msg_hdr, &msgs[i].msg_hdr, &addrs[i]);
+			msgs[i].msg_len = 0;
+		}
+		int sent = lwip_sendmmsg(fd, msgs, n, flags);
+		if (sent < 0) {
+			break;
+		}
+		for (int i=0; i<sent; i++) {
+			msgvec[done+i].msg_len = msgs[i].msg_len;
+		}
+		done += sent;
+		if ((unsigned int)sent < n) {
+			break;
+		}
+	}
+	err = done > 0 ? done : (vlen ? -1 : 0);
+#endif
+#if defined(STCK_PICO)
+#endif
+#if defined(NO_STACK)
+#endif
+	return err;
+}
+
+int zts_recvmmsg(int fd, struct zts_mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+	int err = -1;
+	DEBUG_TRANS("fd=%d, vlen=%d", fd, vlen);
+#if defined(STACK_LWIP)
+	// as lwip_recvmmsg(), one message at a time so that each is converted back into the caller's
+	unsigned int done = 0;
+	for (; done < vlen; done++) {
+		// only the first message is waited for
+		ssize_t ret = zts_recvmsg(fd, &msgvec[done].msg_hdr, done > 0 ? (flags | MSG_DONTWAIT) : flags);
+		if (ret < 0) {
+			break;
+		}
+		msgvec[done].msg_len = (unsigned int)ret;
+	}
+	err = done > 0 ? done : -1;
 #endif
 #if defined(STCK_PICO)
 #endif
@@ -508,6 +664,32 @@ int zts_write(int fd, const void *buf, size_t len)
 	return err;
 }
 
+int zts_readv(int fd, const struct iovec *iov, int iovcnt)
+{
+	int err = -1;
+#if defined(STACK_LWIP)
+	err = lwip_readv(fd, iov, iovcnt);
+#endif
+#if defined(STCK_PICO)
+#endif
+#if defined(NO_STACK)
+#endif
+	return err;
+}
+
+int zts_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	int err = -1;
+#if defined(STACK_LWIP)
+	err = lwip_writev(fd, iov, iovcnt);
+#endif
+#if defined(STCK_PICO)
+#endif
+#if defined(NO_STACK)
+#endif
+	return err;
+}
+
 int zts_shutdown(int fd, int how)
 {
 	int err = -1;
@@ -531,7 +713,9 @@ int zts_add_dns_nameserver(struct sockaddr *addr)
 	static ip4_addr_t ipaddr;
 	ipaddr.addr = in4->sin_addr.s_addr;
 	// TODO: manage DNS server indices 
+	LOCK_TCPIP_CORE();
 	dns_setserver(0, (const ip_addr_t*)&ipaddr);
+	UNLOCK_TCPIP_CORE();
 	err = 0;
 #endif
 #if defined(STCK_PICO)
@@ -554,6 +738,60 @@ int zts_del_dns_nameserver(struct sockaddr *addr)
 	return err;
 }
 
+int zts_get_memory_profile(int profile, struct zts_memory_profile *mp)
+{
+	DEBUG_EXTRA("profile=%d", profile);
+	memset(mp, 0, sizeof(*mp));
+	switch (profile) {
+		case ZTS_MEMORY_PROFILE_DEFAULT:
+			return 0;
+		case ZTS_MEMORY_PROFILE_SMALL:
+			mp->stack_memory = 8 * 1024 * 1024;
+			mp->pbufs = 256;
+			mp->rx_frames = 64;
+			mp->tcp_segments = 256;
+			mp->tcp_connections = 32;
+			mp->udp_sockets = 32;
+			mp->tcp_send_buffer = 16 * 1024;
+			mp->tcp_receive_window = 16 * 1024;
+			return 0;
+		case ZTS_MEMORY_PROFILE_LARGE:
+			// no limits and the largest TCP buffers, plus more frames in flight than the default
+			mp->rx_frames = 4096;
+			return 0;
+	}
+	DEBUG_ERROR("unknown memory profile %d", profile);
+	return -1;
+}
+
+int zts_set_memory_profile(const struct zts_memory_profile *mp)
+{
+	DEBUG_EXTRA();
+	int err = -1;
+#if defined(STACK_LWIP)
+	err = lwip_set_memory_profile(mp);
+#endif
+#if defined(STCK_PICO)
+#endif
+#if defined(NO_STACK)
+#endif
+	return err;
+}
+
+int zts_get_memory_usage(struct zts_memory_usage *mu)
+{
+	DEBUG_EXTRA();
+	int err = -1;
+#if defined(STACK_LWIP)
+	err = lwip_get_memory_usage(mu);
+#endif
+#if defined(STCK_PICO)
+#endif
+#if defined(NO_STACK)
+#endif
+	return err;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -50,6 +50,7 @@
 #include "lwip/priv/tcp_priv.h" /* for tcp_debug_print_pcbs() */
 #include "lwip/timeouts.h"
 #include "lwip/stats.h"
+#include "lwip/inet_chksum.h"
 #include "lwip/ethip6.h"
 
 #include "dns.h"
@@ -57,18 +58,25 @@
 
 #include "lwIP.hpp"
 
-// lwIP netif interfaces used by virtual taps
-netif lwipdev, lwipdev6, n1;
-struct netif lwip_interfaces[10];
-static int num_lwip_interfaces = 0;
-
-
-
+#include <algorithm>
 
+#if ZT_STACK_SHARDS > 0
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "Thread.hpp"
+#endif
 
 bool lwip_driver_initialized = false;
 ZeroTier::Mutex driver_m;
 
+// Memory profile applied when the stack starts, see zts_set_memory_profile()
+static struct zts_memory_profile memory_profile;
+#if ZT_RX_FRAME_POOL_SIZE > 0
+static unsigned int rx_frame_pool_size = ZT_RX_FRAME_POOL_SIZE;
+#endif
+
 err_t tapif_init(struct netif *netif)
 {
 	// we do the actual initialization in elsewhere
@@ -87,15 +95,52 @@ static void tcp_timeout(void *data)
 }
 */
 
+int lwip_set_memory_profile(const struct zts_memory_profile *mp)
+{
+	ZeroTier::Mutex::Lock _l(driver_m);
+	if (lwip_driver_initialized) {
+		DEBUG_ERROR("the memory profile can only be set before the stack starts");
+		return -1;
+	}
+	memory_profile = *mp;
+	return 0;
+}
+
+// Called from the tcpip thread before anything but the stack itself has allocated memory
+static void lwip_apply_memory_profile()
+{
+	const struct zts_memory_profile &mp = memory_profile;
+#if MEMP_MEM_SLAB
+	// the counts are exact, the budget also pays for free elements in the threads' caches
+	memp_slab_set_budget(mp.stack_memory);
+	memp_slab_set_limit(memp_pools[MEMP_PBUF_POOL], mp.pbufs);
+	memp_slab_set_limit(memp_pools[MEMP_TCP_SEG], mp.tcp_segments);
+	memp_slab_set_limit(memp_pools[MEMP_TCP_PCB], mp.tcp_connections);
+	memp_slab_set_limit(memp_pools[MEMP_TCP_PCB_LISTEN], mp.tcp_connections);
+	memp_slab_set_limit(memp_pools[MEMP_UDP_PCB], mp.udp_sockets);
+#else
+	if (mp.stack_memory || mp.pbufs || mp.tcp_segments || mp.tcp_connections || mp.udp_sockets) {
+		DEBUG_ERROR("pool limits need MEMP_MEM_SLAB, ignoring them");
+	}
+#endif
+#if ZT_RX_FRAME_POOL_SIZE > 0
+	if (mp.rx_frames) {
+		rx_frame_pool_size = mp.rx_frames;
+	}
+#endif
+	unsigned int wnd = mp.tcp_receive_window ? std::min<unsigned int>(mp.tcp_receive_window, TCP_WND) : TCP_WND;
+	unsigned int snd_buf = mp.tcp_send_buffer ? std::min<unsigned int>(mp.tcp_send_buffer, TCP_SND_BUF) : TCP_SND_BUF;
+	tcp_set_default_bufs((tcpwnd_size_t)wnd, (tcpwnd_size_t)snd_buf);
+}
+
 // callback for when the TCPIP thread has been successfully started
 static void tcpip_init_done(void *arg)
 {
 	DEBUG_EXTRA("tcpip-thread");
 	sys_sem_t *sem;
 	sem = (sys_sem_t *)arg;
-	netif_set_up(&lwipdev);
+	lwip_apply_memory_profile();
 	lwip_driver_initialized = true;
-	driver_m.unlock();
 	// sys_timeout(5000, tcp_timeout, NULL);
 	sys_sem_signal(sem);
 }
@@ -104,57 +149,464 @@ static void tcpip_init_done(void *arg)
 static void main_thread(void *arg)
 {
 	sys_sem_t sem;
-	LWIP_UNUSED_ARG(arg);
 	if (sys_sem_new(&sem, 0) != ERR_OK) {
 		DEBUG_ERROR("failed to create semaphore", 0);
 	}
 	tcpip_init(tcpip_init_done, &sem);
 	sys_sem_wait(&sem);
 	DEBUG_EXTRA("stack thread init complete");
+	sys_sem_signal((sys_sem_t *)arg); // wake lwip_driver_init()
 	sys_sem_wait(&sem); // block forever
 }
 
+static void lwip_eth_input(ZeroTier::VirtualTap *tap, const ZeroTier::MAC &from, const ZeroTier::MAC &to,
+	unsigned int etherType, const void *data, unsigned int len);
+
+// Describes the payload of an outbound frame (everything behind the ethernet header) as a list of
+// segments of the pbuf chain. Returns the number of segments, 0 if there are more than fit in segs
+static unsigned int lwip_tx_segments(struct pbuf *p, ZeroTier::FrameSegment segs[ZT_MAX_FRAME_SEGMENTS])
+{
+	unsigned int nsegs = 0;
+	if (p->len > sizeof(struct eth_hdr)) {
+		segs[nsegs].data = (char *)p->payload + sizeof(struct eth_hdr);
+		segs[nsegs].len = p->len - sizeof(struct eth_hdr);
+		nsegs++;
+	}
+	for (struct pbuf *q = p->next; q != NULL; q = q->next) {
+		if (q->len) {
+			if (nsegs == ZT_MAX_FRAME_SEGMENTS) {
+				return 0;
+			}
+			segs[nsegs].data = q->payload;
+			segs[nsegs].len = q->len;
+			nsegs++;
+		}
+	}
+	return nsegs;
+}
+
+#if ZT_STACK_SHARDS > 0
+// An outbound frame waiting for its shard. The shard holds a reference to the stack's pbuf rather
+// than a copy, TCP leaves segments alone while they are referenced (see tcp_output_segment())
+struct shard_frame
+{
+	ZeroTier::VirtualTap *tap;
+	struct pbuf *p;
+	ZeroTier::MAC from;
+	ZeroTier::MAC to;
+	unsigned int etherType;
+	unsigned int len;
+	unsigned int nsegs;
+	ZeroTier::FrameSegment segs[ZT_MAX_FRAME_SEGMENTS];
+};
+
+// Worker thread which hands outbound frames to ZeroTier, which encrypts and sends them, outside of
+// the core lock. The stack itself stays single-threaded: frames of one flow always go to the same
+// shard so that they stay in order, received frames enter the stack on ZeroTier's thread
+class StackShard
+{
+public:
+	StackShard() : _current(NULL)
+	{
+		for (int i=0; i<ZT_STACK_SHARD_QUEUE_LEN; i++) {
+			_free.push_back(new shard_frame());
+		}
+		_thread = ZeroTier::Thread::start(this);
+	}
+
+	// returns a free frame, or NULL if this shard is backed up
+	shard_frame *get()
+	{
+		std::lock_guard<std::mutex> l(_m);
+		if (_free.empty()) {
+			return NULL;
+		}
+		shard_frame *f = _free.back();
+		_free.pop_back();
+		return f;
+	}
+
+	// gives back a frame taken with get() which is not pushed after all
+	void put(shard_frame *f)
+	{
+		std::lock_guard<std::mutex> l(_m);
+		_free.push_back(f);
+	}
+
+	void push(shard_frame *f)
+	{
+		{
+			std::lock_guard<std::mutex> l(_m);
+			_queue.push_back(f);
+		}
+		_cv.notify_one();
+	}
+
+	// drops queued frames for a tap which is going away and waits for one in flight to finish
+	void forget(ZeroTier::VirtualTap *tap)
+	{
+		std::unique_lock<std::mutex> l(_m);
+		for (std::deque<shard_frame*>::iterator it = _queue.begin(); it != _queue.end();) {
+			if ((*it)->tap == tap) {
+				pbuf_free((*it)->p);
+				_free.push_back(*it);
+				it = _queue.erase(it);
+			}
+			else {
+				it++;
+			}
+		}
+		while (_current == tap) {
+			_idle.wait(l);
+		}
+	}
+
+	void threadMain()
+		throw()
+	{
+		std::unique_lock<std::mutex> l(_m);
+		for (;;) {
+			while (_queue.empty()) {
+				_cv.wait(l);
+			}
+			shard_frame *f = _queue.front();
+			_queue.pop_front();
+			_current = f->tap;
+			l.unlock();
+			ZeroTier::VirtualTap *tap = f->tap;
+			if (f->nsegs == 1) {
+				tap->_handler(tap->_arg, NULL, tap->_nwid, f->from, f->to, f->etherType, 0, f->segs[0].data, f->len);
+			}
+			else if (tap->_handler_v) {
+				tap->_handler_v(tap->_arg, NULL, tap->_nwid, f->from, f->to, f->etherType, 0, f->segs, f->nsegs, f->len);
+			}
+			else {
+				unsigned int off = 0;
+				for (unsigned int i=0; i<f->nsegs; i++) {
+					memcpy(_buf + off, f->segs[i].data, f->segs[i].len);
+					off += f->segs[i].len;
+				}
+				tap->_handler(tap->_arg, NULL, tap->_nwid, f->from, f->to, f->etherType, 0, _buf, f->len);
+			}
+			pbuf_free(f->p);
+			l.lock();
+			_current = NULL;
+			_free.push_back(f);
+			_idle.notify_all();
+		}
+	}
+
+private:
+	std::mutex _m;
+	std::condition_variable _cv;
+	std::condition_variable _idle;
+	std::deque<shard_frame*> _queue;
+	std::vector<shard_frame*> _free;
+	ZeroTier::VirtualTap *_current;
+	ZeroTier::Thread _thread;
+	char _buf[ZT_MAX_MTU]; // frames for taps without _handler_v are flattened here
+};
+
+static StackShard *shards[ZT_STACK_SHARDS];
+
+// Symmetric hash over the addresses, protocol and ports of an IP packet so that both directions of
+// a flow land on the same shard and frames of one flow stay in order. Anything else goes to shard 0
+static unsigned int flow_hash(unsigned int etherType, const unsigned char *ip, unsigned int len)
+{
+	uint32_t addrs = 0, ports = 0, proto = 0;
+	unsigned int l4 = 0;
+	if (etherType == 0x0800 && len >= 20) {
+		uint32_t src, dst;
+		memcpy(&src, ip + 12, 4);
+		memcpy(&dst, ip + 16, 4);
+		addrs = src ^ dst;
+		proto = ip[9];
+		// only the first fragment carries the ports
+		if ((((ip[6] & 0x1f) << 8) | ip[7]) == 0) {
+			l4 = (ip[0] & 0x0f) * 4;
+		}
+	}
+	else if (etherType == 0x86dd && len >= 40) {
+		uint32_t w[8];
+		memcpy(w, ip + 8, 32);
+		for (int i=0; i<4; i++) {
+			addrs ^= w[i] ^ w[i+4];
+		}
+		proto = ip[6];
+		l4 = 40;
+	}
+	else {
+		return 0;
+	}
+	if ((proto == 6 || proto == 17) && l4 && len >= l4 + 4) {
+		uint16_t sport, dport;
+		memcpy(&sport, ip + l4, 2);
+		memcpy(&dport, ip + l4 + 2, 2);
+		ports = sport ^ dport;
+	}
+	uint32_t h = (addrs ^ (ports << 16) ^ proto) * 0x9e3779b1;
+	return h >> 16;
+}
+
+static void lwip_shards_init()
+{
+	for (int i=0; i<ZT_STACK_SHARDS; i++) {
+		shards[i] = new StackShard();
+	}
+}
+#endif
+
 // initialize the lwIP stack
 void lwip_driver_init()
 {
 	DEBUG_EXTRA();
-	driver_m.lock(); // unlocked from callback indicating completion of driver init
+	driver_m.lock();
 	if (lwip_driver_initialized == true) {
+		driver_m.unlock();
 		return;
 	}
 #if defined(__MINGW32__)
 	sys_init(); // required for win32 initializtion of critical sections
 #endif
+	sys_sem_t init_done;
+	if (sys_sem_new(&init_done, 0) != ERR_OK) {
+		DEBUG_ERROR("failed to create semaphore", 0);
+	}
 	sys_thread_new("main_thread", main_thread,
-		NULL, DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+		&init_done, DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+	// wait for the stack to come up, the core lock doesn't exist until then
+	sys_sem_wait(&init_done);
+	sys_sem_free(&init_done);
+#if ZT_STACK_SHARDS > 0
+	lwip_shards_init();
+#endif
+	driver_m.unlock();
+}
+
+// Checksums the stack handles on libzt interfaces, see ZT_CHECKSUM_OFFLOAD
+#if ZT_CHECKSUM_OFFLOAD > 1
+#define ZT_NETIF_CHECKSUM_FLAGS (NETIF_CHECKSUM_GEN_ICMP | NETIF_CHECKSUM_GEN_ICMP6 \
+	| NETIF_CHECKSUM_CHECK_ICMP | NETIF_CHECKSUM_CHECK_ICMP6)
+#elif ZT_CHECKSUM_OFFLOAD > 0
+#define ZT_NETIF_CHECKSUM_FLAGS (NETIF_CHECKSUM_ENABLE_ALL \
+	& ~(NETIF_CHECKSUM_CHECK_IP | NETIF_CHECKSUM_CHECK_UDP | NETIF_CHECKSUM_CHECK_TCP))
+#else
+#define ZT_NETIF_CHECKSUM_FLAGS NETIF_CHECKSUM_ENABLE_ALL
+#endif
+
+// Range of a received IP packet whose TCP/UDP checksum libzt verifies itself
+struct l4_chksum
+{
+	unsigned int off; // start of the TCP/UDP header
+	unsigned int end; // end of the IP packet (0 if there is nothing to verify)
+	uint32_t pseudo;  // sum of the pseudo header
+};
+
+#if ZT_CHECKSUM_OFFLOAD > 0
+// ZeroTier derives the MACs of its nodes from their addresses, anything else is a bridged host
+static inline bool lwip_is_zt_mac(const ZeroTier::MAC &mac, uint64_t nwid)
+{
+	return (unsigned char)(mac.toInt() >> 40) == ZeroTier::MAC::firstOctetForNetwork(nwid);
+}
+
+// Checks the IPv4 header checksum of a received packet and finds the TCP/UDP checksum to verify
+// while the packet is copied. Returns false if the packet is to be dropped. Malformed packets are
+// left for the stack to drop, fragments are not verified
+static bool lwip_rx_chksum_prepare(unsigned int etherType, const unsigned char *ip, unsigned int len,
+	struct l4_chksum *c)
+{
+	unsigned int proto, total;
+	c->off = c->end = 0;
+	if (etherType == 0x0800 && len >= 20) {
+		c->off = (ip[0] & 0x0f) * 4;
+		total = (ip[2] << 8) | ip[3];
+		if (c->off < 20 || c->off > total || total > len) {
+			return true;
+		}
+		if (inet_chksum(ip, c->off) != 0) {
+			return false;
+		}
+		if ((((ip[6] & 0x3f) << 8) | ip[7]) != 0) {
+			return true;
+		}
+		proto = ip[9];
+		// a UDP checksum of zero means the sender did not compute one
+		if (proto == 17 && total >= c->off + 8 && ip[c->off + 6] == 0 && ip[c->off + 7] == 0) {
+			return true;
+		}
+		c->pseudo = (u16_t)~inet_chksum(ip + 12, 8);
+	}
+	else if (etherType == 0x86dd && len >= 40) {
+		c->off = 40;
+		total = 40 + ((ip[4] << 8) | ip[5]);
+		if (total > len) {
+			return true;
+		}
+		proto = ip[6];
+		c->pseudo = (u16_t)~inet_chksum(ip + 8, 32);
+	}
+	else {
+		return true;
+	}
+	if (proto == 6 || proto == 17) {
+		c->end = total;
+		c->pseudo += ZeroTier::Utils::hton((uint16_t)proto) + ZeroTier::Utils::hton((uint16_t)(total - c->off));
+	}
+	return true;
 }
+#endif
+
+#if ZT_CHECKSUM_OFFLOAD > 1
+// Fills in the checksums the stack left out, for frames leaving towards bridged hosts or sent to
+// broadcast/multicast. The stack builds all headers in the first pbuf of the chain
+static void lwip_tx_fill_checksums(struct pbuf *p)
+{
+	unsigned char *ip = (unsigned char *)p->payload + sizeof(struct eth_hdr);
+	unsigned int avail = p->len - sizeof(struct eth_hdr);
+	unsigned int etherType = ZeroTier::Utils::ntoh((uint16_t)((struct eth_hdr *)p->payload)->type);
+	unsigned int hlen, proto, l4len, at;
+	u16_t sum;
+	if (etherType == 0x0800 && avail >= 20) {
+		hlen = (ip[0] & 0x0f) * 4;
+		if (hlen < 20 || hlen > avail) {
+			return;
+		}
+		ip[10] = ip[11] = 0;
+		sum = inet_chksum(ip, hlen);
+		memcpy(ip + 10, &sum, 2);
+		// the transport checksum of a fragmented datagram covers data we do not have
+		if ((((ip[6] & 0x3f) << 8) | ip[7]) != 0) {
+			return;
+		}
+		l4len = ((ip[2] << 8) | ip[3]) - hlen;
+		proto = ip[9];
+	}
+	else if (etherType == 0x86dd && avail >= 40) {
+		hlen = 40;
+		l4len = (ip[4] << 8) | ip[5];
+		proto = ip[6];
+	}
+	else {
+		return;
+	}
+	if (proto == 6) {
+		at = hlen + 16;
+	}
+	else if (proto == 17) {
+		at = hlen + 6;
+	}
+	else {
+		return;
+	}
+	if (avail < at + 2 || p->tot_len < sizeof(struct eth_hdr) + hlen + l4len) {
+		return;
+	}
+	ip[at] = ip[at + 1] = 0;
+	pbuf_header(p, -(s16_t)(sizeof(struct eth_hdr) + hlen));
+	if (etherType == 0x0800) {
+		ip4_addr_t src, dst;
+		memcpy(&src.addr, ip + 12, 4);
+		memcpy(&dst.addr, ip + 16, 4);
+		sum = inet_chksum_pseudo(p, (u8_t)proto, (u16_t)l4len, &src, &dst);
+	}
+	else {
+		ip6_addr_t src, dst;
+		memcpy(src.addr, ip + 8, 16);
+		memcpy(dst.addr, ip + 24, 16);
+		sum = ip6_chksum_pseudo(p, (u8_t)proto, (u16_t)l4len, &src, &dst);
+	}
+	pbuf_header(p, (s16_t)(sizeof(struct eth_hdr) + hlen));
+	if (proto == 17 && sum == 0) {
+		sum = 0xffff;
+	}
+	memcpy(ip + at, &sum, 2);
+}
+#endif
 
 err_t lwip_eth_tx(struct netif *netif, struct pbuf *p)
 {
-	struct pbuf *q;
-	char buf[ZT_MAX_MTU+32];
-	char *bufptr;
-	int totalLength = 0;
+	int totalLength = p->tot_len;
 
 	ZeroTier::VirtualTap *tap = (ZeroTier::VirtualTap*)netif->state;
-	bufptr = buf;
-	for (q = p; q != NULL; q = q->next) {
-		memcpy(bufptr, q->payload, q->len);
-		bufptr += q->len;
-		totalLength += q->len;
+	// the ethernet header is always written into the first pbuf of the chain
+	if (p->len < sizeof(struct eth_hdr)) {
+		DEBUG_ERROR("dropped frame: first pbuf smaller than ethernet header");
+		return ERR_BUF;
+	}
+	if (totalLength > ZT_MAX_MTU + (int)sizeof(struct eth_hdr)) {
+		DEBUG_ERROR("dropped frame: len=%d exceeds ZT_MAX_MTU", totalLength);
+		return ERR_BUF;
 	}
 	struct eth_hdr *ethhdr;
-	ethhdr = (struct eth_hdr *)buf;
+	ethhdr = (struct eth_hdr *)p->payload;
 
 	ZeroTier::MAC src_mac;
 	ZeroTier::MAC dest_mac;
 	src_mac.setTo(ethhdr->src.addr, 6);
 	dest_mac.setTo(ethhdr->dest.addr, 6);
+#if ZT_CHECKSUM_OFFLOAD > 1
+	if (!lwip_is_zt_mac(dest_mac, tap->_nwid)) {
+		lwip_tx_fill_checksums(p);
+	}
+#endif
 
-	char *data = buf + sizeof(struct eth_hdr);
 	int len = totalLength - sizeof(struct eth_hdr);
 	int proto = ZeroTier::Utils::ntoh((uint16_t)ethhdr->type);
-	tap->_handler(tap->_arg, NULL, tap->_nwid, src_mac, dest_mac, proto, 0, data, len);
+
+#if ZT_STACK_SHARDS > 0
+	// hand the frame to its flow's shard, ZeroTier processes it there (outside of the core lock)
+	unsigned char hdr[60];
+	u16_t hdrlen = pbuf_copy_partial(p, hdr, sizeof(hdr), sizeof(struct eth_hdr));
+	StackShard *shard = shards[flow_hash(proto, hdr, hdrlen) % ZT_STACK_SHARDS];
+	shard_frame *f = shard->get();
+	if (f == NULL) {
+		DEBUG_ERROR("dropped frame: shard queue full");
+		return ERR_MEM;
+	}
+	f->nsegs = lwip_tx_segments(p, f->segs);
+	if (f->nsegs > 0) {
+		pbuf_ref(p);
+		f->p = p;
+	}
+	else {
+		// too many segments to describe, the shard gets a flat copy instead
+		f->p = pbuf_alloc(PBUF_RAW, (u16_t)len, PBUF_RAM);
+		if (f->p == NULL) {
+			shard->put(f);
+			DEBUG_ERROR("dropped frame: no memory to flatten it");
+			return ERR_MEM;
+		}
+		pbuf_copy_partial(p, f->p->payload, len, sizeof(struct eth_hdr));
+		f->segs[0].data = f->p->payload;
+		f->segs[0].len = len;
+		f->nsegs = 1;
+	}
+	f->tap = tap;
+	f->from = src_mac;
+	f->to = dest_mac;
+	f->etherType = proto;
+	f->len = len;
+	shard->push(f);
+#else
+	if (p->next == NULL) {
+		// single pbuf, hand its payload to the virtual wire as-is
+		char *data = (char *)p->payload + sizeof(struct eth_hdr);
+		tap->_handler(tap->_arg, NULL, tap->_nwid, src_mac, dest_mac, proto, 0, data, len);
+	}
+	else {
+		ZeroTier::FrameSegment segs[ZT_MAX_FRAME_SEGMENTS];
+		unsigned int nsegs = tap->_handler_v ? lwip_tx_segments(p, segs) : 0;
+		if (nsegs > 0) {
+			tap->_handler_v(tap->_arg, NULL, tap->_nwid, src_mac, dest_mac, proto, 0, segs, nsegs, len);
+		}
+		else {
+			// no scatter/gather support on the wire (the ZeroTier service path, or too many segments), flatten the payload
+			char buf[ZT_MAX_MTU];
+			pbuf_copy_partial(p, buf, len, sizeof(struct eth_hdr));
+			tap->_handler(tap->_arg, NULL, tap->_nwid, src_mac, dest_mac, proto, 0, buf, len);
+		}
+	}
+#endif
 
 	if (ZT_MSG_TRANSFER == true) {
 		char flagbuf[32];
@@ -172,7 +624,9 @@ err_t lwip_eth_tx(struct netif *netif, struct pbuf *p)
 
 void lwip_dns_init()
 {
+	LOCK_TCPIP_CORE();
 	dns_init();
+	UNLOCK_TCPIP_CORE();
 }
 
 void lwip_start_dhcp(void *netif)
@@ -182,99 +636,374 @@ void lwip_start_dhcp(void *netif)
 #endif
 }
 
+// lwIP has a single default interface, it is used for IPv6. The IPv4 one is returned by lwip_route_by_src()
+static struct netif *netif_default4 = NULL;
+
+// Traffic not matching any interface's subnet leaves via the first network joined of each address family.
+// Called under the core lock after an interface was removed, netif_list starts with the newest interface
+static void lwip_select_default_netifs()
+{
+	struct netif *default6 = NULL;
+	netif_default4 = NULL;
+	for (struct netif *n = netif_list; n != NULL; n = n->next) {
+		ZeroTier::VirtualTap *tap = (ZeroTier::VirtualTap*)n->state;
+		if (tap == NULL) {
+			continue;
+		}
+		if (tap->netif4 == n) {
+			netif_default4 = n;
+		}
+		if (tap->netif6 == n) {
+			default6 = n;
+		}
+	}
+	netif_set_default(default6);
+}
+
 void lwip_init_interface(void *tapref, const ZeroTier::MAC &mac, const ZeroTier::InetAddress &ip)
 {
 	char ipbuf[INET6_ADDRSTRLEN], nmbuf[INET6_ADDRSTRLEN];
+	ZeroTier::VirtualTap *tap = (ZeroTier::VirtualTap*)tapref;
+	// called from application threads, netif code is only safe to call under the core lock
+	LOCK_TCPIP_CORE();
 #if defined(LIBZT_IPV4)
 	if (ip.isV4()) {
-		static ip4_addr_t ipaddr, netmask, gw;
+		ip4_addr_t ipaddr, netmask, gw;
 		IP4_ADDR(&gw,127,0,0,1);
 		ipaddr.addr = *((u32_t *)ip.rawIpData());
 		netmask.addr = *((u32_t *)ip.netmask().rawIpData());
-		netif_add(&(lwipdev),&ipaddr, &netmask, &gw, NULL, tapif_init, tcpip_input);
-		lwipdev.state = tapref;
-		lwipdev.output = etharp_output;
-		lwipdev.mtu = ZT_MAX_MTU;
-		lwipdev.name[0] = 'l';
-		lwipdev.name[1] = '4';
-		lwipdev.linkoutput = lwip_eth_tx;
-		lwipdev.hwaddr_len = 6;
-		mac.copyTo(lwipdev.hwaddr, lwipdev.hwaddr_len);
-		lwipdev.flags = NETIF_FLAG_BROADCAST
+		struct netif *n = (struct netif *)tap->netif4;
+		if (n != NULL) {
+			// each netif holds a single IPv4 address, the newest assignment replaces the old one
+			netif_set_addr(n, &ipaddr, &netmask, &gw);
+			DEBUG_INFO("updated netif address to [addr=%s, nm=%s]", ip.toString(ipbuf), ip.netmask().toString(nmbuf));
+			UNLOCK_TCPIP_CORE();
+			return;
+		}
+		n = new struct netif();
+		// lwip_eth_input() holds the core lock while it feeds frames in
+		netif_add(n, &ipaddr, &netmask, &gw, NULL, tapif_init, ethernet_input);
+		NETIF_SET_CHECKSUM_CTRL(n, ZT_NETIF_CHECKSUM_FLAGS);
+		n->state = tapref;
+		n->output = etharp_output;
+		n->mtu = ZT_MAX_MTU;
+		n->name[0] = 'l';
+		n->name[1] = '4';
+		n->linkoutput = lwip_eth_tx;
+		n->hwaddr_len = 6;
+		mac.copyTo(n->hwaddr, n->hwaddr_len);
+		n->flags = NETIF_FLAG_BROADCAST
 			| NETIF_FLAG_ETHARP
 			| NETIF_FLAG_IGMP
 			| NETIF_FLAG_LINK_UP
 			| NETIF_FLAG_UP;
-		netif_set_default(&lwipdev);
-		netif_set_link_up(&lwipdev);
-		netif_set_up(&lwipdev);
+		// traffic not matching any interface's subnet leaves via the first network we joined
+		if (netif_default4 == NULL) {
+			netif_default4 = n;
+		}
+		netif_set_link_up(n);
+		netif_set_up(n);
+		tap->netif4 = (void*)n;
 		char macbuf[ZT_MAC_ADDRSTRLEN];
-		mac2str(macbuf, ZT_MAC_ADDRSTRLEN, lwipdev.hwaddr);
+		mac2str(macbuf, ZT_MAC_ADDRSTRLEN, n->hwaddr);
 		DEBUG_INFO("initialized netif as [mac=%s, addr=%s, nm=%s]", macbuf, ip.toString(ipbuf), ip.netmask().toString(nmbuf));
 	}
 #endif
 #if defined(LIBZT_IPV6)
 	if (ip.isV6()) {
-		static ip6_addr_t ipaddr;
+		ip6_addr_t ipaddr;
 		memcpy(&(ipaddr.addr), ip.rawIpData(), sizeof(ipaddr.addr));
-		
-		lwipdev6.mtu = ZT_MAX_MTU; 
-		lwipdev6.name[0] = 'l'; 
-		lwipdev6.name[1] = '6'; 
-		lwipdev6.hwaddr_len = 6; 
-		lwipdev6.linkoutput = lwip_eth_tx; 
-		lwipdev6.ip6_autoconfig_enabled = 1; 
-
-		mac.copyTo(lwipdev6.hwaddr, lwipdev6.hwaddr_len); 
-		netif_add(&lwipdev6, NULL, NULL, NULL, NULL, tapif_init, ethernet_input); 
-		lwipdev6.output_ip6 = ethip6_output; 
-		lwipdev6.state = tapref;
-
-		netif_create_ip6_linklocal_address(&lwipdev6, 1); 
-		s8_t idx = 1;
-		netif_add_ip6_address(&lwipdev6, &ipaddr, &idx);
-		netif_set_default(&lwipdev6); 
-		netif_set_up(&lwipdev6);	
-		netif_set_link_up(&lwipdev6);
-		netif_ip6_addr_set_state(&lwipdev6, 1, IP6_ADDR_TENTATIVE);
+		struct netif *n = (struct netif *)tap->netif6;
+		if (n == NULL) {
+			n = new struct netif();
+			n->mtu = ZT_MAX_MTU;
+			n->name[0] = 'l';
+			n->name[1] = '6';
+			n->hwaddr_len = 6;
+			n->linkoutput = lwip_eth_tx;
+			n->ip6_autoconfig_enabled = 1;
+
+			mac.copyTo(n->hwaddr, n->hwaddr_len);
+			// lwip_eth_input() holds the core lock while it feeds frames in
+			netif_add(n, NULL, NULL, NULL, NULL, tapif_init, ethernet_input);
+			NETIF_SET_CHECKSUM_CTRL(n, ZT_NETIF_CHECKSUM_FLAGS);
+			n->flags |= NETIF_FLAG_ETHERNET;
+			n->output_ip6 = ethip6_output;
+			n->state = tapref;
+
+			netif_create_ip6_linklocal_address(n, 1);
+			if (netif_default == NULL) {
+				netif_set_default(n);
+			}
+			netif_set_up(n);
+			netif_set_link_up(n);
+			tap->netif6 = (void*)n;
+		}
+		s8_t idx = -1;
+		if (netif_add_ip6_address(n, &ipaddr, &idx) != ERR_OK) {
+			DEBUG_ERROR("unable to add address %s to netif, no free address slots", ip.toString(ipbuf));
+			UNLOCK_TCPIP_CORE();
+			return;
+		}
+		netif_ip6_addr_set_state(n, idx, IP6_ADDR_TENTATIVE);
 
 		char macbuf[ZT_MAC_ADDRSTRLEN];
-		mac2str(macbuf, ZT_MAC_ADDRSTRLEN, lwipdev6.hwaddr);
-		DEBUG_INFO("initialized netif as [mac=%s, addr=%s]", macbuf, ip.toString(ipbuf)); 		
+		mac2str(macbuf, ZT_MAC_ADDRSTRLEN, n->hwaddr);
+		DEBUG_INFO("initialized netif as [mac=%s, addr=%s]", macbuf, ip.toString(ipbuf));
+	}
+#endif
+	UNLOCK_TCPIP_CORE();
+}
+
+void lwip_remove_interfaces(void *tapref)
+{
+	ZeroTier::VirtualTap *tap = (ZeroTier::VirtualTap*)tapref;
+	struct netif *n;
+	LOCK_TCPIP_CORE();
+	if ((n = (struct netif *)tap->netif4) != NULL) {
+		tap->netif4 = NULL;
+		netif_set_down(n);
+		netif_remove(n);
+		delete n;
+	}
+	if ((n = (struct netif *)tap->netif6) != NULL) {
+		tap->netif6 = NULL;
+		netif_set_down(n);
+		netif_remove(n);
+		delete n;
+	}
+	// the removed interfaces may have been the defaults, the next oldest network takes over
+	lwip_select_default_netifs();
+#if ZT_STACK_SHARDS > 0
+	// the stack can't send through the tap any more, drop what it sent before (shards never take the lock)
+	for (int i=0; i<ZT_STACK_SHARDS; i++) {
+		if (shards[i]) {
+			shards[i]->forget(tap);
+		}
+	}
+#endif
+	UNLOCK_TCPIP_CORE();
+}
+
+extern "C" struct netif *lwip_route_by_src(const ip4_addr_t *dest, const ip4_addr_t *src)
+{
+	// called from the stack's thread, src is NULL when no interface matched the destination
+	if (src == NULL) {
+		struct netif *n = netif_default4;
+		return (n != NULL && netif_is_up(n) && netif_is_link_up(n)) ? n : NULL;
+	}
+	// unbound sockets, ip4_route() matches the destination against each interface's subnet first
+	if (ip4_addr_isany(src)) {
+		return NULL;
+	}
+	for (struct netif *n = netif_list; n != NULL; n = n->next) {
+		if (netif_is_up(n) && netif_is_link_up(n) && ip4_addr_cmp(src, netif_ip4_addr(n))) {
+			return n;
+		}
+	}
+	return NULL;
+}
+
+#if defined(LIBZT_IPV6)
+extern "C" int lwip_nd6_get_lladdr(struct netif *netif, const ip6_addr_t *dest, unsigned char *lladdr)
+{
+	// called from the stack's thread, only addresses in a prefix the controller assigned to us are derived
+	ZeroTier::VirtualTap *tap = (ZeroTier::VirtualTap*)netif->state;
+	if (tap == NULL || netif->hwaddr_len != 6) {
+		return 0;
+	}
+	const u8_t *d = (const u8_t *)dest->addr;
+	uint64_t nwid = tap->_nwid;
+	uint32_t nwid32 = (uint32_t)((nwid ^ (nwid >> 32)) & 0xffffffff);
+	uint64_t node = 0;
+	for (int i=0; i<LWIP_IPV6_NUM_ADDRESSES && !node; i++) {
+		if (ip6_addr_isinvalid(netif_ip6_addr_state(netif, i))) {
+			continue;
+		}
+		const u8_t *a = (const u8_t *)netif_ip6_addr(netif, i)->addr;
+		bool rfc4193 = a[0] == 0xfd && a[9] == 0x99 && a[10] == 0x93;
+		for (int j=0; rfc4193 && j<8; j++) {
+			rfc4193 = a[1+j] == (u8_t)(nwid >> (56 - 8*j));
+		}
+		bool sixplane = a[0] == 0xfc;
+		for (int j=0; sixplane && j<4; j++) {
+			sixplane = a[1+j] == (u8_t)(nwid32 >> (24 - 8*j));
+		}
+		// RFC4193: fd + nwid + 9993 + node, 6PLANE: fc + nwid32 + node + host bits
+		if (rfc4193 && memcmp(d, a, 11) == 0) {
+			for (int j=11; j<16; j++) {
+				node = (node << 8) | d[j];
+			}
+		}
+		else if (sixplane && memcmp(d, a, 5) == 0) {
+			for (int j=5; j<10; j++) {
+				node = (node << 8) | d[j];
+			}
+		}
+	}
+	if (!node) {
+		return 0;
+	}
+	ZeroTier::MAC(ZeroTier::Address(node), nwid).copyTo(lladdr, 6);
+	return 1;
+}
+#endif
+
+#if ZT_RX_FRAME_POOL_SIZE > 0
+// Contiguous buffer large enough for any frame ZeroTier can hand us, lent to the stack as a custom pbuf
+struct rx_frame_buf
+{
+	struct pbuf_custom pc; // must be first, the stack hands this back to us as a pbuf
+	struct rx_frame_buf *next;
+	char data[ZT_MAX_MTU + sizeof(struct eth_hdr)];
+};
+
+static struct rx_frame_buf *rx_frame_free_list = NULL;
+static unsigned int rx_frame_bufs_allocated = 0;
+ZeroTier::Mutex rx_frame_m;
+
+// called by the stack (usually from the tcpip thread) once the last reference to a frame is released
+static void rx_frame_buf_free(struct pbuf *p)
+{
+	struct rx_frame_buf *fb = (struct rx_frame_buf *)p;
+	ZeroTier::Mutex::Lock _l(rx_frame_m);
+	fb->next = rx_frame_free_list;
+	rx_frame_free_list = fb;
+}
+
+// returns a single pbuf with room for len bytes, or NULL if all frame buffers are currently in use
+static struct pbuf *rx_frame_buf_alloc(unsigned int len)
+{
+	struct rx_frame_buf *fb = NULL;
+	if (len > sizeof(fb->data)) {
+		return NULL;
+	}
+	{
+		ZeroTier::Mutex::Lock _l(rx_frame_m);
+		if (rx_frame_free_list) {
+			fb = rx_frame_free_list;
+			rx_frame_free_list = fb->next;
+		}
+		else if (rx_frame_bufs_allocated < rx_frame_pool_size) {
+			fb = new rx_frame_buf;
+			rx_frame_bufs_allocated++;
+		}
+	}
+	if (fb == NULL) {
+		return NULL;
+	}
+	fb->next = NULL;
+	fb->pc.custom_free_function = rx_frame_buf_free;
+	// PBUF_RAM (rather than PBUF_REF) so that the stack may move back over headers it has already parsed
+	return pbuf_alloced_custom(PBUF_RAW, (u16_t)len, PBUF_RAM, &fb->pc, fb->data, (u16_t)sizeof(fb->data));
+}
+#endif
+
+int lwip_get_memory_usage(struct zts_memory_usage *mu)
+{
+	if (lwip_driver_initialized == false) {
+		return -1;
+	}
+	memset(mu, 0, sizeof(*mu));
+#if MEMP_MEM_SLAB
+	memp_slab_reserved(NULL, &mu->stack_memory);
+	mu->stack_memory_limit = memory_profile.stack_memory;
+	mu->pbufs = memp_slab_reserved(memp_pools[MEMP_PBUF_POOL], NULL);
+	mu->tcp_segments = memp_slab_reserved(memp_pools[MEMP_TCP_SEG], NULL);
+	mu->tcp_connections = memp_slab_reserved(memp_pools[MEMP_TCP_PCB], NULL);
+	mu->udp_sockets = memp_slab_reserved(memp_pools[MEMP_UDP_PCB], NULL);
+#endif
+#if ZT_RX_FRAME_POOL_SIZE > 0
+	{
+		ZeroTier::Mutex::Lock _l(rx_frame_m);
+		mu->rx_frames = rx_frame_bufs_allocated;
 	}
 #endif
+	mu->tcp_send_buffer = tcp_default_snd_buf;
+	mu->tcp_receive_window = tcp_default_wnd;
+	return 0;
+}
+
+// Copies a received frame's payload into a pbuf chain behind the ethernet header. The bytes in
+// [c.off, c.end) are summed in the same pass, returns that (unfolded) sum
+static uint32_t lwip_rx_copy(struct pbuf *p, const char *data, unsigned int len, const struct l4_chksum &c)
+{
+	uint32_t acc = 0;
+	unsigned int pos = 0, skip = sizeof(struct eth_hdr);
+	for (struct pbuf *q = p; q != NULL && pos < len; q = q->next) {
+		char *dst = (char *)q->payload + skip;
+		unsigned int end = pos + std::min(len - pos, (unsigned int)q->len - skip);
+		unsigned int from = std::min(std::max(pos, c.off), end);
+		unsigned int to = std::max(std::min(end, c.end), from);
+		skip = 0;
+		memcpy(dst, data + pos, from - pos);
+		if (to > from) {
+			u16_t sum = LWIP_CHKSUM_COPY(dst + (from - pos), data + from, (u16_t)(to - from));
+			// words pair up from c.off, a piece starting at an odd distance from it sums byte-swapped
+			acc += ((from - c.off) & 1) ? SWAP_BYTES_IN_WORD(sum) : sum;
+		}
+		memcpy(dst + (to - pos), data + to, end - to);
+		pos = end;
+	}
+	return acc;
 }
 
 void lwip_eth_rx(ZeroTier::VirtualTap *tap, const ZeroTier::MAC &from, const ZeroTier::MAC &to, unsigned int etherType,
 	const void *data, unsigned int len)
 {
-	struct pbuf *p,*q;
+	lwip_eth_input(tap, from, to, etherType, data, len);
+}
+
+// builds a pbuf from a received frame and feeds it into the stack
+static void lwip_eth_input(ZeroTier::VirtualTap *tap, const ZeroTier::MAC &from, const ZeroTier::MAC &to,
+	unsigned int etherType, const void *data, unsigned int len)
+{
+	struct pbuf *p;
 	struct eth_hdr ethhdr;
 	from.copyTo(ethhdr.src.addr, 6);
 	to.copyTo(ethhdr.dest.addr, 6);
 	ethhdr.type = ZeroTier::Utils::hton((uint16_t)etherType);
 
-	p = pbuf_alloc(PBUF_RAW, len+sizeof(struct eth_hdr), PBUF_POOL);
-	if (p != NULL) {
-		const char *dataptr = reinterpret_cast<const char *>(data);
+	// the stack does not verify checksums of frames from ZeroTier nodes, those from bridged hosts
+	// are verified here while they are copied in
+	struct l4_chksum chksum = { 0, 0, 0 };
+#if ZT_CHECKSUM_OFFLOAD > 0
+	if (!lwip_is_zt_mac(from, tap->_nwid)
+		&& !lwip_rx_chksum_prepare(etherType, (const unsigned char *)data, len, &chksum)) {
+		DEBUG_ERROR("dropped packet: bad IP header checksum from bridged host");
+		return;
+	}
+#endif
+
+	p = NULL;
+#if ZT_RX_FRAME_POOL_SIZE > 0
+	// frame and header fit in one contiguous buffer, so only a single copy is needed
+	p = rx_frame_buf_alloc(len+sizeof(struct eth_hdr));
+#endif
+	if (p == NULL) {
+		p = pbuf_alloc(PBUF_RAW, len+sizeof(struct eth_hdr), PBUF_POOL);
+		if (p == NULL) {
+			DEBUG_ERROR("dropped packet: no pbufs available");
+			return;
+		}
 		// First pbuf gets ethernet header at start
-		q = p;
-		if (q->len < sizeof(ethhdr)) {
+		if (p->len < sizeof(ethhdr)) {
 			DEBUG_ERROR("dropped packet: first pbuf smaller than ethernet header");
+			pbuf_free(p);
 			return;
 		}
-		memcpy(q->payload,&ethhdr,sizeof(ethhdr));
-		memcpy((char*)q->payload + sizeof(ethhdr),dataptr,q->len - sizeof(ethhdr));
-		dataptr += q->len - sizeof(ethhdr);
-		// Remaining pbufs (if any) get rest of data
-		while ((q = q->next)) {
-			memcpy(q->payload,dataptr,q->len);
-			dataptr += q->len;
-		}
 	}
-	else {
-		DEBUG_ERROR("dropped packet: no pbufs available");
-		return;
+	memcpy(p->payload, &ethhdr, sizeof(ethhdr));
+	uint32_t sum = lwip_rx_copy(p, reinterpret_cast<const char *>(data), len, chksum);
+	if (chksum.end) {
+		sum += chksum.pseudo;
+		sum = FOLD_U32T(sum);
+		sum = FOLD_U32T(sum);
+		if (sum != 0xffff) {
+			DEBUG_ERROR("dropped packet: bad TCP/UDP checksum from bridged host");
+			pbuf_free(p);
+			return;
+		}
 	}
 	if (ZT_MSG_TRANSFER == true) {
 		char flagbuf[32];
@@ -287,26 +1016,38 @@ void lwip_eth_rx(ZeroTier::VirtualTap *tap, const ZeroTier::MAC &from, const Zer
 		DEBUG_TRANS("len=%5d dst=%s [%s RX --> %s] proto=0x%04x %s %s", len, macBuf, nodeBuf, tap->nodeId().c_str(),
 			ZeroTier::Utils::ntoh(ethhdr.type), beautify_eth_proto_nums(ZeroTier::Utils::ntoh(ethhdr.type)), flagbuf);
 	}
-	{
-		// TODO: Routing logic
-
+	// lwip_remove_interfaces() clears and frees the tap's interfaces under the core lock, so they
+	// are only looked up once we hold it
+	LOCK_TCPIP_CORE();
+	struct netif *n = NULL;
 #if defined(LIBZT_IPV4)
-		// feed in IPV4 and ARP
-		if (ZeroTier::Utils::ntoh(ethhdr.type) == 0x800 || ZeroTier::Utils::ntoh(ethhdr.type) == 0x0806) {
-			DEBUG_INFO("Inputting to lwipdev");
-			if (lwipdev.input(p, &lwipdev) != ERR_OK) {
-				DEBUG_ERROR("error while feeding frame into stack interface (ipv4)");
-			}
+	// feed in IPV4 and ARP
+	if (etherType == 0x800 || etherType == 0x0806) {
+		n = (struct netif *)tap->netif4;
+		if (n == NULL) {
+			DEBUG_ERROR("dropped packet: no ipv4 interface for this tap");
 		}
+	}
 #endif
 #if defined(LIBZT_IPV6)
-		if (ZeroTier::Utils::ntoh(ethhdr.type) == 0x86dd) {
-			DEBUG_INFO("Inputting to lwipdev6");
-			if (lwipdev6.input(p, &lwipdev6) != ERR_OK) {
-				DEBUG_ERROR("error while feeding frame into stack interface (ipv6)");
-			}
+	if (etherType == 0x86dd) {
+		n = (struct netif *)tap->netif6;
+		if (n == NULL) {
+			DEBUG_ERROR("dropped packet: no ipv6 interface for this tap");
 		}
+	}
 #endif
+	if (n != NULL) {
+		DEBUG_INFO("Inputting to %c%c%d", n->name[0], n->name[1], n->num);
+		if (n->input(p, n) != ERR_OK) {
+			DEBUG_ERROR("error while feeding frame into stack interface");
+			pbuf_free(p);
+		}
+	}
+	else {
+		// no interface, or not a protocol we feed into the stack
+		pbuf_free(p);
 	}
+	UNLOCK_TCPIP_CORE();
 }
 
@@ -0,0 +1,719 @@
+/*
+ * ZeroTier SDK - Network Virtualization Everywhere
+ * Copyright (C) 2011-2017  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+/**
+ * @file
+ *
+ * Benchmarks for the socket layer and network stack.
+ *
+ * Built as `bench` (libzt, -D__SELFTEST__) and `nativebench` (system sockets, -D__NATIVETEST__)
+ * by `make bench`. The libzt build connects two VirtualTaps over an in-process VirtualWire, so
+ * neither ZeroTier nodes nor a network are needed. The native build runs the same benchmarks
+ * over the loopback interface as a baseline. Results are written as JSON. The libzt build also
+ * runs a bulk transfer over a wire with a large bandwidth-delay product and some loss
+ * (tcp_bulk_wan), whatever the wire is configured to otherwise.
+ *
+ * Usage: bench [-s scale] [-l latency_us] [-b bandwidth_bps] [-p loss] [-o file.json]
+ */
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SELFTEST__)
+#include "libzt.h"
+#include "VirtualTap.hpp"
+#include "VirtualWire.hpp"
+#include "InetAddress.hpp"
+#include "MAC.hpp"
+#endif
+
+// If running against libzt, use libzt calls
+#if defined(__SELFTEST__)
+#define SOCKET zts_socket
+#define BIND zts_bind
+#define LISTEN zts_listen
+#define ACCEPT zts_accept
+#define CONNECT zts_connect
+#define READ zts_read
+#define WRITE zts_write
+#define RECVFROM zts_recvfrom
+#define SENDTO zts_sendto
+#define SENDMMSG zts_sendmmsg
+#define RECVMMSG zts_recvmmsg
+#define MMSGHDR zts_mmsghdr
+#define SETSOCKOPT zts_setsockopt
+#define FCNTL zts_fcntl
+#define POLL zts_poll
+#define CLOSE zts_close
+#define BENCH_MODE             "libzt"
+#define BENCH_SERVER_ADDR      "10.101.0.2"
+#define BENCH_CLIENT_ADDR      "10.101.0.1"
+#endif
+
+// If running the native baseline, use system calls
+#if defined(__NATIVETEST__)
+#define SOCKET socket
+#define BIND bind
+#define LISTEN listen
+#define ACCEPT accept
+#define CONNECT connect
+#define READ read
+#define WRITE write
+#define RECVFROM recvfrom
+#define SENDTO sendto
+#define SENDMMSG sendmmsg
+#define RECVMMSG(fd, msgvec, vlen, flags) recvmmsg(fd, msgvec, vlen, flags, NULL)
+#define MMSGHDR mmsghdr
+#define SETSOCKOPT setsockopt
+#define FCNTL fcntl
+#define POLL poll
+#define CLOSE close
+#define BENCH_MODE             "native"
+#define BENCH_SERVER_ADDR      "127.0.0.1"
+#define BENCH_CLIENT_ADDR      "127.0.0.1"
+#endif
+
+#define BENCH_NWID             0x0b0b0b0b0b0b0b0bULL
+#define BENCH_ROUTE_NWID       0x0c0c0c0c0c0c0c0cULL
+#define BENCH_ROUTE_SERVER     "10.102.0.2"
+#define BENCH_ROUTE_CLIENT     "10.102.0.1"
+#define BENCH_MTU              2800
+#define BENCH_BULK_BUF_SZ      1024*64
+#define BENCH_BULK_BYTES       1024*1024*64
+#define BENCH_RPC_MSG_SZ       64
+#define BENCH_RPC_ROUND_TRIPS  20000
+#define BENCH_UDP_MSG_SZ       64
+#define BENCH_UDP_SECONDS      2
+#define BENCH_MMSG_BATCH       32
+#define BENCH_CONN_COUNT       500
+#define BENCH_SCALING_SECONDS  2
+#define BENCH_WAN_LATENCY_US   40000
+#define BENCH_WAN_BANDWIDTH    100000000
+#define BENCH_WAN_LOSS         0.0001
+#define BENCH_WAN_BYTES        1024*1024*32
+
+struct bench_metric
+{
+	std::string name;
+	double value;
+};
+
+struct bench_result
+{
+	std::string name;
+	std::vector<bench_metric> metrics;
+};
+
+static std::vector<bench_result> results;
+static double scale = 1.0;
+static int next_port = 0;
+
+static uint64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void record(const char *name, const std::vector<bench_metric> &metrics)
+{
+	bench_result r;
+	r.name = name;
+	r.metrics = metrics;
+	results.push_back(r);
+	fprintf(stderr, "%-24s", name);
+	for (size_t i=0; i<metrics.size(); i++) {
+		fprintf(stderr, " %s=%.2f", metrics[i].name.c_str(), metrics[i].value);
+	}
+	fprintf(stderr, "\n");
+}
+
+static void write_json(FILE *f, const char *wire)
+{
+	fprintf(f, "{\n  \"mode\": \"%s\",\n  \"wire\": %s,\n  \"scale\": %g,\n  \"results\": [\n", BENCH_MODE, wire, scale);
+	for (size_t i=0; i<results.size(); i++) {
+		fprintf(f, "    { \"name\": \"%s\"", results[i].name.c_str());
+		for (size_t j=0; j<results[i].metrics.size(); j++) {
+			fprintf(f, ", \"%s\": %.3f", results[i].metrics[j].name.c_str(), results[i].metrics[j].value);
+		}
+		fprintf(f, " }%s\n", i+1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+}
+
+static void make_addr(struct sockaddr_in *addr, const char *ip, int port)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(port);
+	inet_pton(AF_INET, ip, &addr->sin_addr);
+}
+
+static int tcp_listener(int port, int backlog)
+{
+	struct sockaddr_in addr;
+	make_addr(&addr, BENCH_SERVER_ADDR, port);
+	int fd = SOCKET(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || BIND(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || LISTEN(fd, backlog) < 0) {
+		fprintf(stderr, "unable to listen on port %d (errno=%d)\n", port, errno);
+		exit(1);
+	}
+	return fd;
+}
+
+static int tcp_connect_to(int port)
+{
+	struct sockaddr_in local, remote;
+	make_addr(&local, BENCH_CLIENT_ADDR, 0);
+	make_addr(&remote, BENCH_SERVER_ADDR, port);
+	int fd = SOCKET(AF_INET, SOCK_STREAM, 0);
+	// all taps share one stack, so the client side has to pick its own tap explicitly
+	if (fd < 0 || BIND(fd, (struct sockaddr *)&local, sizeof(local)) < 0
+		|| CONNECT(fd, (struct sockaddr *)&remote, sizeof(remote)) < 0) {
+		fprintf(stderr, "unable to connect to port %d (errno=%d)\n", port, errno);
+		exit(1);
+	}
+	return fd;
+}
+
+static void set_nodelay(int fd)
+{
+	int one = 1;
+	SETSOCKOPT(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static bool read_full(int fd, char *buf, size_t len)
+{
+	size_t got = 0;
+	while (got < len) {
+		int n = READ(fd, buf + got, len - got);
+		if (n <= 0) {
+			return false;
+		}
+		got += n;
+	}
+	return true;
+}
+
+static bool write_full(int fd, const char *buf, size_t len)
+{
+	size_t sent = 0;
+	while (sent < len) {
+		int n = WRITE(fd, buf + sent, len - sent);
+		if (n <= 0) {
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+static double percentile(std::vector<uint64_t> &sorted, double p)
+{
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t i = (size_t)(p * (sorted.size() - 1));
+	return (double)sorted[i];
+}
+
+/****************************************************************************/
+/* Benchmarks                                                               */
+/****************************************************************************/
+
+// one connection, one writer and one reader, as fast as possible
+static std::vector<bench_metric> tcp_bulk(size_t total)
+{
+	const int port = next_port++;
+	int ls = tcp_listener(port, 1);
+	size_t got = 0;
+	std::thread server([&]() {
+		int fd = ACCEPT(ls, NULL, NULL);
+		char *buf = new char[BENCH_BULK_BUF_SZ];
+		while (got < total) {
+			int n = READ(fd, buf, BENCH_BULK_BUF_SZ);
+			if (n <= 0) {
+				break;
+			}
+			got += n;
+		}
+		CLOSE(fd);
+		delete[] buf;
+	});
+	int fd = tcp_connect_to(port);
+	char *buf = new char[BENCH_BULK_BUF_SZ];
+	memset(buf, 0x5a, BENCH_BULK_BUF_SZ);
+	uint64_t start = now_us();
+	for (size_t sent = 0; sent < total; ) {
+		int n = WRITE(fd, buf, std::min((size_t)BENCH_BULK_BUF_SZ, total - sent));
+		if (n <= 0) {
+			break;
+		}
+		sent += n;
+	}
+	server.join();
+	double secs = (now_us() - start) / 1e6;
+	CLOSE(fd);
+	CLOSE(ls);
+	delete[] buf;
+	return {{"bytes", (double)got}, {"seconds", secs}, {"mbit_per_s", got * 8 / secs / 1e6}};
+}
+
+static void bench_tcp_bulk()
+{
+	record("tcp_bulk", tcp_bulk((size_t)(BENCH_BULK_BYTES * scale)));
+}
+
+#if defined(__SELFTEST__)
+// bulk transfer over a long fat link: at 80 ms RTT and 100 Mbit/s a window of 1 MB is in
+// flight, and the occasional lost frame has to be repaired without draining it. The wire is
+// switched over for this benchmark only.
+static void bench_tcp_bulk_wan(ZeroTier::VirtualWire *vwire, unsigned int latency,
+	unsigned long long bandwidth, double loss)
+{
+	vwire->setLatency(BENCH_WAN_LATENCY_US);
+	vwire->setBandwidth(BENCH_WAN_BANDWIDTH);
+	vwire->setLoss(BENCH_WAN_LOSS);
+	uint64_t dropped = vwire->framesDropped();
+	std::vector<bench_metric> metrics = tcp_bulk((size_t)(BENCH_WAN_BYTES * scale));
+	metrics.push_back({"frames_dropped", (double)(vwire->framesDropped() - dropped)});
+	vwire->setLatency(latency);
+	vwire->setBandwidth(bandwidth);
+	vwire->setLoss(loss);
+	record("tcp_bulk_wan", metrics);
+}
+#endif
+
+#if defined(__SELFTEST__)
+// a second network on its own subnet: a connect from an unbound socket has to leave through
+// the interface on the destination's subnet, not through the first network joined
+static void check_unbound_route(ZeroTier::VirtualWire *vwire)
+{
+	ZeroTier::InetAddress client_ip, server_ip;
+	client_ip.fromString(BENCH_ROUTE_CLIENT "/24");
+	server_ip.fromString(BENCH_ROUTE_SERVER "/24");
+	// the newest interface comes first in the stack's list, so the client tap is the one
+	// the stack picks for the subnet (it has no loopback to reach its own addresses)
+	vwire->addTap(ZeroTier::MAC(0x32bbbb000003ULL), BENCH_ROUTE_NWID, BENCH_MTU)->addIp(server_ip);
+	vwire->addTap(ZeroTier::MAC(0x32bbbb000004ULL), BENCH_ROUTE_NWID, BENCH_MTU)->addIp(client_ip);
+	const int port = next_port++;
+	struct sockaddr_in addr, name;
+	make_addr(&addr, BENCH_ROUTE_SERVER, port);
+	int lfd = SOCKET(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0 || BIND(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || LISTEN(lfd, 1) < 0) {
+		fprintf(stderr, "unbound_route: unable to listen (errno=%d)\n", errno);
+		exit(1);
+	}
+	int fd = SOCKET(AF_INET, SOCK_STREAM, 0);
+	FCNTL(fd, F_SETFL, O_NONBLOCK);
+	int err = 0;
+	socklen_t len = sizeof(err);
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+	if (CONNECT(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+		err = errno;
+	}
+	else if (POLL(&pfd, 1, 5000) != 1) {
+		err = ETIMEDOUT;
+	}
+	else {
+		zts_getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+	}
+	memset(&name, 0, sizeof(name));
+	len = sizeof(name);
+	if (err == 0 && zts_getsockname(fd, (struct sockaddr *)&name, &len) < 0) {
+		err = errno;
+	}
+	char src[INET_ADDRSTRLEN] = "";
+	inet_ntop(AF_INET, &name.sin_addr, src, sizeof(src));
+	if (err != 0 || strcmp(src, BENCH_ROUTE_CLIENT) != 0) {
+		fprintf(stderr, "unbound_route: connect to %s failed (errno=%d, source %s)\n",
+			BENCH_ROUTE_SERVER, err, src);
+		exit(1);
+	}
+	int afd = ACCEPT(lfd, NULL, NULL);
+	if (afd >= 0) {
+		CLOSE(afd);
+	}
+	CLOSE(fd);
+	CLOSE(lfd);
+}
+#endif
+
+// small request/response messages on one connection, one at a time
+static void bench_tcp_rpc_latency()
+{
+	const int round_trips = (int)(BENCH_RPC_ROUND_TRIPS * scale);
+	const int port = next_port++;
+	int ls = tcp_listener(port, 1);
+	std::thread server([&]() {
+		int fd = ACCEPT(ls, NULL, NULL);
+		set_nodelay(fd);
+		char buf[BENCH_RPC_MSG_SZ];
+		while (read_full(fd, buf, sizeof(buf)) && write_full(fd, buf, sizeof(buf))) { }
+		CLOSE(fd);
+	});
+	int fd = tcp_connect_to(port);
+	set_nodelay(fd);
+	char buf[BENCH_RPC_MSG_SZ];
+	memset(buf, 0x5a, sizeof(buf));
+	std::vector<uint64_t> rtts;
+	rtts.reserve(round_trips);
+	uint64_t start = now_us();
+	for (int i=0; i<round_trips; i++) {
+		uint64_t t = now_us();
+		if (!write_full(fd, buf, sizeof(buf)) || !read_full(fd, buf, sizeof(buf))) {
+			break;
+		}
+		rtts.push_back(now_us() - t);
+	}
+	double secs = (now_us() - start) / 1e6;
+	CLOSE(fd);
+	server.join();
+	CLOSE(ls);
+	std::sort(rtts.begin(), rtts.end());
+	record("tcp_rpc_latency", {{"round_trips", (double)rtts.size()}, {"rpc_per_s", rtts.size() / secs},
+		{"p50_us", percentile(rtts, 0.50)}, {"p99_us", percentile(rtts, 0.99)},
+		{"p999_us", percentile(rtts, 0.999)}});
+}
+
+// small datagrams from one sender to one receiver for a fixed time
+static void bench_udp_pps()
+{
+	const int port = next_port++;
+	struct sockaddr_in local, remote;
+	make_addr(&local, BENCH_CLIENT_ADDR, 0);
+	make_addr(&remote, BENCH_SERVER_ADDR, port);
+	int rx = SOCKET(AF_INET, SOCK_DGRAM, 0);
+	int tx = SOCKET(AF_INET, SOCK_DGRAM, 0);
+	if (rx < 0 || tx < 0 || BIND(rx, (struct sockaddr *)&remote, sizeof(remote)) < 0
+		|| BIND(tx, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		fprintf(stderr, "unable to set up UDP sockets (errno=%d)\n", errno);
+		exit(1);
+	}
+	FCNTL(rx, F_SETFL, O_NONBLOCK);
+	std::atomic<bool> sending(true);
+	uint64_t received = 0;
+	std::thread receiver([&]() {
+		char buf[BENCH_UDP_MSG_SZ];
+		struct pollfd pfd;
+		pfd.fd = rx;
+		pfd.events = POLLIN;
+		for (;;) {
+			pfd.revents = 0;
+			int ready = POLL(&pfd, 1, 100);
+			if (ready == 0 && !sending) {
+				break;
+			}
+			while (RECVFROM(rx, buf, sizeof(buf), 0, NULL, NULL) > 0) {
+				received++;
+			}
+		}
+	});
+	char buf[BENCH_UDP_MSG_SZ];
+	memset(buf, 0x5a, sizeof(buf));
+	uint64_t sent = 0, failed = 0;
+	const uint64_t start = now_us();
+	const uint64_t end = start + (uint64_t)(BENCH_UDP_SECONDS * scale * 1e6);
+	while (now_us() < end) {
+		for (int i=0; i<64; i++) {
+			if (SENDTO(tx, buf, sizeof(buf), 0, (struct sockaddr *)&remote, sizeof(remote)) > 0) {
+				sent++;
+			}
+			else {
+				failed++;
+			}
+		}
+	}
+	double secs = (now_us() - start) / 1e6;
+	sending = false;
+	receiver.join();
+	CLOSE(tx);
+	CLOSE(rx);
+	record("udp_pps", {{"sent_pps", sent / secs}, {"received_pps", received / secs},
+		{"send_failures", (double)failed}, {"loss", sent ? 1.0 - (double)received / sent : 0}});
+}
+
+// small datagrams sent and received BENCH_MMSG_BATCH at a time, every received message is checked
+static void bench_udp_mmsg()
+{
+	const int port = next_port++;
+	const int src_port = next_port++;
+	struct sockaddr_in local, remote;
+	make_addr(&local, BENCH_CLIENT_ADDR, src_port);
+	make_addr(&remote, BENCH_SERVER_ADDR, port);
+	int rx = SOCKET(AF_INET, SOCK_DGRAM, 0);
+	int tx = SOCKET(AF_INET, SOCK_DGRAM, 0);
+	if (rx < 0 || tx < 0 || BIND(rx, (struct sockaddr *)&remote, sizeof(remote)) < 0
+		|| BIND(tx, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		fprintf(stderr, "unable to set up UDP sockets (errno=%d)\n", errno);
+		exit(1);
+	}
+	FCNTL(rx, F_SETFL, O_NONBLOCK);
+	std::atomic<bool> sending(true);
+	uint64_t received = 0, malformed = 0;
+	std::thread receiver([&]() {
+		char bufs[BENCH_MMSG_BATCH][BENCH_UDP_MSG_SZ];
+		struct iovec iovs[BENCH_MMSG_BATCH];
+		struct sockaddr_in from[BENCH_MMSG_BATCH];
+		struct MMSGHDR msgs[BENCH_MMSG_BATCH];
+		struct pollfd pfd;
+		pfd.fd = rx;
+		pfd.events = POLLIN;
+		for (;;) {
+			pfd.revents = 0;
+			int ready = POLL(&pfd, 1, 100);
+			if (ready == 0 && !sending) {
+				break;
+			}
+			for (;;) {
+				memset(msgs, 0, sizeof(msgs));
+				for (int i=0; i<BENCH_MMSG_BATCH; i++) {
+					iovs[i].iov_base = bufs[i];
+					iovs[i].iov_len = sizeof(bufs[i]);
+					msgs[i].msg_hdr.msg_name = &from[i];
+					msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+					msgs[i].msg_hdr.msg_iov = &iovs[i];
+					msgs[i].msg_hdr.msg_iovlen = 1;
+					msgs[i].msg_hdr.msg_flags = -1; // overwritten for each message received
+				}
+				int n = RECVMMSG(rx, msgs, BENCH_MMSG_BATCH, 0);
+				if (n <= 0) {
+					break;
+				}
+				for (int i=0; i<n; i++) {
+					if (msgs[i].msg_len != BENCH_UDP_MSG_SZ || msgs[i].msg_hdr.msg_flags != 0
+						|| from[i].sin_port != local.sin_port || bufs[i][BENCH_UDP_MSG_SZ-1] != 0x5a) {
+						malformed++;
+					}
+				}
+				received += n;
+			}
+		}
+	});
+	char buf[BENCH_UDP_MSG_SZ];
+	memset(buf, 0x5a, sizeof(buf));
+	struct iovec iov;
+	iov.iov_base = buf;
+	iov.iov_len = sizeof(buf);
+	struct MMSGHDR msgs[BENCH_MMSG_BATCH];
+	memset(msgs, 0, sizeof(msgs));
+	for (int i=0; i<BENCH_MMSG_BATCH; i++) {
+		msgs[i].msg_hdr.msg_name = &remote;
+		msgs[i].msg_hdr.msg_namelen = sizeof(remote);
+		msgs[i].msg_hdr.msg_iov = &iov;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	uint64_t sent = 0, failed = 0;
+	const uint64_t start = now_us();
+	const uint64_t end = start + (uint64_t)(BENCH_UDP_SECONDS * scale * 1e6);
+	while (now_us() < end) {
+		int n = SENDMMSG(tx, msgs, BENCH_MMSG_BATCH, 0);
+		n = n < 0 ? 0 : n;
+		for (int i=0; i<n; i++) {
+			if (msgs[i].msg_len != BENCH_UDP_MSG_SZ) {
+				malformed++;
+			}
+		}
+		sent += n;
+		failed += BENCH_MMSG_BATCH - n;
+	}
+	double secs = (now_us() - start) / 1e6;
+	sending = false;
+	receiver.join();
+	CLOSE(tx);
+	CLOSE(rx);
+	if (malformed) {
+		fprintf(stderr, "udp_mmsg: %llu messages with wrong length, flags, address or data\n",
+			(unsigned long long)malformed);
+		exit(1);
+	}
+	record("udp_mmsg", {{"sent_pps", sent / secs}, {"received_pps", received / secs},
+		{"send_failures", (double)failed}, {"loss", sent ? 1.0 - (double)received / sent : 0}});
+}
+
+// connect, accept and close, one connection at a time
+static void bench_tcp_connection_rate()
+{
+	const int count = (int)(BENCH_CONN_COUNT * scale);
+	const int port = next_port++;
+	int ls = tcp_listener(port, 16);
+	int accepted = 0;
+	std::thread server([&]() {
+		for (int i=0; i<count; i++) {
+			int fd = ACCEPT(ls, NULL, NULL);
+			if (fd < 0) {
+				break;
+			}
+			accepted++;
+			CLOSE(fd);
+		}
+	});
+	uint64_t start = now_us();
+	for (int i=0; i<count; i++) {
+		CLOSE(tcp_connect_to(port));
+	}
+	server.join();
+	double secs = (now_us() - start) / 1e6;
+	CLOSE(ls);
+	record("tcp_connection_rate", {{"connections", (double)accepted}, {"connections_per_s", accepted / secs}});
+}
+
+// request/response traffic on several connections at once, one client thread per connection
+static void bench_tcp_concurrency(int conns)
+{
+	const int port = next_port++;
+	int ls = tcp_listener(port, conns);
+	std::vector<std::thread> servers, clients;
+	std::vector<int> client_fds;
+	for (int i=0; i<conns; i++) {
+		client_fds.push_back(tcp_connect_to(port));
+		int fd = ACCEPT(ls, NULL, NULL);
+		servers.push_back(std::thread([fd]() {
+			set_nodelay(fd);
+			char buf[BENCH_RPC_MSG_SZ];
+			while (read_full(fd, buf, sizeof(buf)) && write_full(fd, buf, sizeof(buf))) { }
+			CLOSE(fd);
+		}));
+	}
+	std::atomic<uint64_t> total(0);
+	const uint64_t start = now_us();
+	const uint64_t end = start + (uint64_t)(BENCH_SCALING_SECONDS * scale * 1e6);
+	for (int i=0; i<conns; i++) {
+		int fd = client_fds[i];
+		clients.push_back(std::thread([fd, end, &total]() {
+			set_nodelay(fd);
+			char buf[BENCH_RPC_MSG_SZ];
+			memset(buf, 0x5a, sizeof(buf));
+			uint64_t n = 0;
+			while (now_us() < end && write_full(fd, buf, sizeof(buf)) && read_full(fd, buf, sizeof(buf))) {
+				n++;
+			}
+			total += n;
+		}));
+	}
+	for (int i=0; i<conns; i++) {
+		clients[i].join();
+	}
+	double secs = (now_us() - start) / 1e6;
+	for (int i=0; i<conns; i++) {
+		CLOSE(client_fds[i]);
+		servers[i].join();
+	}
+	CLOSE(ls);
+	char name[64];
+	snprintf(name, sizeof(name), "tcp_concurrency_%d", conns);
+	record(name, {{"connections", (double)conns}, {"rpc_per_s", total / secs}});
+}
+
+/****************************************************************************/
+/* Main                                                                     */
+/****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+	unsigned int latency = 0;
+	unsigned long long bandwidth = 0;
+	double loss = 0;
+	const char *outfile = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:l:b:p:o:")) != -1) {
+		switch (opt) {
+			case 's': scale = atof(optarg); break;
+			case 'l': latency = atoi(optarg); break;
+			case 'b': bandwidth = strtoull(optarg, NULL, 10); break;
+			case 'p': loss = atof(optarg); break;
+			case 'o': outfile = optarg; break;
+			default:
+				fprintf(stderr, "usage: %s [-s scale] [-l latency_us] [-b bandwidth_bps] [-p loss] [-o file.json]\n", argv[0]);
+				return 1;
+		}
+	}
+	srand((unsigned int)time(NULL));
+	next_port = 20000 + rand() % 20000;
+	char wire[256];
+#if defined(__SELFTEST__)
+	ZeroTier::VirtualWire *vwire = new ZeroTier::VirtualWire();
+	vwire->setLatency(latency);
+	vwire->setBandwidth(bandwidth);
+	vwire->setLoss(loss);
+	ZeroTier::InetAddress client_ip, server_ip;
+	client_ip.fromString(BENCH_CLIENT_ADDR "/24");
+	server_ip.fromString(BENCH_SERVER_ADDR "/24");
+	vwire->addTap(ZeroTier::MAC(0x32bbbb000001ULL), BENCH_NWID, BENCH_MTU)->addIp(client_ip);
+	vwire->addTap(ZeroTier::MAC(0x32bbbb000002ULL), BENCH_NWID, BENCH_MTU)->addIp(server_ip);
+	snprintf(wire, sizeof(wire), "{ \"latency_us\": %u, \"bandwidth_bps\": %llu, \"loss\": %g }",
+		latency, bandwidth, loss);
+#else
+	snprintf(wire, sizeof(wire), "null");
+#endif
+
+#if defined(__SELFTEST__)
+	check_unbound_route(vwire);
+#endif
+	bench_tcp_bulk();
+#if defined(__SELFTEST__)
+	bench_tcp_bulk_wan(vwire, latency, bandwidth, loss);
+#endif
+	bench_tcp_rpc_latency();
+	bench_udp_pps();
+	bench_udp_mmsg();
+	bench_tcp_connection_rate();
+	bench_tcp_concurrency(1);
+	bench_tcp_concurrency(4);
+	bench_tcp_concurrency(8);
+
+	FILE *f = outfile ? fopen(outfile, "w") : stdout;
+	if (f == NULL) {
+		fprintf(stderr, "unable to open %s\n", outfile);
+		return 1;
+	}
+	write_json(f, wire);
+	if (outfile) {
+		fclose(f);
+	}
+#if defined(__SELFTEST__)
+	delete vwire;
+#endif
+	return 0;
+}
@@ -0,0 +1,690 @@
+/*
+ * ZeroTier SDK - Network Virtualization Everywhere
+ * Copyright (C) 2011-2017  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+/**
+ * @file
+ *
+ * Microbenchmarks for small hot functions in the socket layer and stack driver.
+ *
+ * Exercises RingBuffer, the lwIP checksum routines, tap lookup, address helpers and the
+ * frame <-> pbuf conversion in lwip_eth_rx/lwip_eth_tx. Taps are created directly and their
+ * interfaces are replaced with sinks, so no ZeroTier node is started and nothing is sent.
+ *
+ * Usage: microbench [-n iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "lwip/pbuf.h"
+#include "lwip/memp.h"
+#include "lwip/priv/memp_priv.h"
+#include "lwip/mem.h"
+#include "lwip/netif.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/ethernet.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/ip4.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/etharp.h"
+#include "lwip/prot/etharp.h"
+
+#include "libzt.h"
+#include "RingBuffer.hpp"
+#include "VirtualTap.hpp"
+#include "ZT1Service.h"
+#include "Utilities.h"
+#include "lwIP.hpp"
+#include "InetAddress.hpp"
+#include "MAC.hpp"
+
+// not in a public header, lwIP is compiled as C++ (see make-liblwip.mk)
+u16_t lwip_standard_chksum(const void *dataptr, int len);
+extern "C" void fix_addr_socket_family(struct sockaddr *addr);
+
+#define MICROBENCH_NWID       0x0c0c0c0c0c0c0c0cULL
+#define MICROBENCH_TAPS       8
+#define MICROBENCH_FRAME_SZ   1400
+
+static uint64_t iterations = 1000000;
+static volatile uint64_t sink;
+
+static uint64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// reference cycles (TSC) where available, otherwise 0 and bytes/cycle is not reported
+static uint64_t now_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// run fn() n times and report per-op cost, bytes is what one call touches (0 if not meaningful)
+template<typename F>
+static void run(const char *name, uint64_t n, size_t bytes, F fn)
+{
+	for (uint64_t i=0; i<n/100+1; i++) {
+		fn();
+	}
+	uint64_t t = now_ns(), c = now_cycles();
+	for (uint64_t i=0; i<n; i++) {
+		fn();
+	}
+	double ns = (double)(now_ns() - t) / n;
+	double cycles = (double)(now_cycles() - c) / n;
+	printf("%-40s %12.1f ns/op %10.1f cycles/op", name, ns, cycles);
+	if (bytes && cycles > 0) {
+		printf(" %8.2f bytes/cycle", bytes / cycles);
+	}
+	printf("\n");
+}
+
+/****************************************************************************/
+/* RingBuffer                                                               */
+/****************************************************************************/
+
+static void bench_ringbuffer()
+{
+	const size_t chunk = MICROBENCH_FRAME_SZ;
+	char src[MICROBENCH_FRAME_SZ], dst[MICROBENCH_FRAME_SZ];
+	memset(src, 0x5a, sizeof(src));
+
+	ZeroTier::RingBuffer<char> rb(1024*64);
+	run("RingBuffer::write+read", iterations, chunk, [&]() {
+		rb.write(src, chunk);
+		sink += rb.read(dst, chunk);
+	});
+	// zero-copy path as used by ztproxy: fill the writable spans in place, then hand back the readable ones
+	run("RingBuffer::produce+consume (iovec)", iterations, chunk, [&]() {
+		struct iovec iov[2];
+		size_t copied = 0;
+		int n = rb.get_writable_iov(iov);
+		for (int i=0; i<n && copied < chunk; i++) {
+			size_t len = std::min(iov[i].iov_len, chunk - copied);
+			memcpy(iov[i].iov_base, src + copied, len);
+			copied += len;
+		}
+		rb.produce(copied);
+		n = rb.get_readable_iov(iov);
+		for (int i=0; i<n; i++) {
+			sink += ((char *)iov[i].iov_base)[0];
+		}
+		sink += rb.consume(copied);
+	});
+	ZeroTier::SPSCRingBuffer<char> spsc(1024*64);
+	run("SPSCRingBuffer::write+read", iterations, chunk, [&]() {
+		spsc.write(src, chunk);
+		sink += spsc.read(dst, chunk);
+	});
+	ZeroTier::SPSCRingBuffer<char> mirrored(1024*64, true);
+	run("SPSCRingBuffer::write+read (mirrored)", iterations, chunk, [&]() {
+		mirrored.write(src, chunk);
+		sink += mirrored.read(dst, chunk);
+	});
+}
+
+/****************************************************************************/
+/* Checksums                                                                */
+/****************************************************************************/
+
+// lwIP's portable checksum (LWIP_CHKSUM_ALGORITHM 2), the result the configured routine must reproduce
+static u16_t reference_chksum(const void *dataptr, int len)
+{
+	const u8_t *pb = (const u8_t *)dataptr;
+	u16_t t = 0;
+	u32_t sum = 0;
+	int odd = ((uintptr_t)pb & 1);
+	if (odd && len > 0) {
+		((u8_t *)&t)[1] = *pb++;
+		len--;
+	}
+	while (len > 1) {
+		u16_t w;
+		memcpy(&w, pb, 2);
+		sum += w;
+		pb += 2;
+		len -= 2;
+	}
+	if (len > 0) {
+		((u8_t *)&t)[0] = *pb;
+	}
+	sum += t;
+	sum = FOLD_U32T(sum);
+	sum = FOLD_U32T(sum);
+	if (odd) {
+		sum = SWAP_BYTES_IN_WORD(sum);
+	}
+	return (u16_t)sum;
+}
+
+// every offset and length up to a jumbo frame, over random, all-zero and all-ones data. The
+// copying variant is also checked against a different destination alignment
+static void verify_checksum()
+{
+	static u8_t data[9000 + 64], copy[9000 + 64];
+	const u8_t fills[] = { 0x00, 0xff };
+	uint32_t seed = 1;
+	for (int pattern=0; pattern<3; pattern++) {
+		for (size_t i=0; i<sizeof(data); i++) {
+			seed = seed * 1103515245 + 12345;
+			data[i] = pattern < 2 ? fills[pattern] : (u8_t)(seed >> 16);
+		}
+		for (int off=0; off<64; off++) {
+			for (int len=0; len<=9000; len += (len < 2048 ? 1 : 61)) {
+				u16_t got = lwip_standard_chksum(data + off, len), want = reference_chksum(data + off, len);
+				if (got != want) {
+					fprintf(stderr, "lwip_standard_chksum mismatch (off=%d, len=%d): 0x%04x != 0x%04x\n", off, len, got, want);
+					exit(1);
+				}
+				u8_t *dst = copy + ((off * 7) & 63);
+				memset(copy, 0x5a, sizeof(copy));
+				got = lwip_chksum_copy(dst, data + off, (u16_t)len);
+				if (got != want || memcmp(dst, data + off, len) != 0 || (dst > copy && dst[-1] != 0x5a)
+					|| dst[len] != 0x5a) {
+					fprintf(stderr, "lwip_chksum_copy mismatch (off=%d, len=%d): 0x%04x != 0x%04x\n", off, len, got, want);
+					exit(1);
+				}
+			}
+		}
+	}
+}
+
+static void bench_checksum()
+{
+	verify_checksum();
+	static char data[9000];
+	for (size_t i=0; i<sizeof(data); i++) {
+		data[i] = (char)(i * 31);
+	}
+	const int sizes[] = { 64, 576, 1500, 9000 };
+	char name[64];
+	for (size_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+		snprintf(name, sizeof(name), "lwip_standard_chksum (%d)", sizes[i]);
+		run(name, iterations, sizes[i], [&]() {
+			sink += lwip_standard_chksum(data, sizes[i]);
+		});
+	}
+	// odd-aligned start, as seen when a header of odd length precedes the payload
+	run("lwip_standard_chksum (1499, unaligned)", iterations, 1499, [&]() {
+		sink += lwip_standard_chksum(data + 1, 1499);
+	});
+	// a TCP segment's worth of application data going into a pbuf, copied then summed vs in one pass
+	static char seg[TCP_MSS];
+	run("memcpy + lwip_standard_chksum (1460)", iterations, TCP_MSS, [&]() {
+		memcpy(seg, data, TCP_MSS);
+		sink += lwip_standard_chksum(seg, TCP_MSS);
+	});
+	run("lwip_chksum_copy (1460)", iterations, TCP_MSS, [&]() {
+		sink += lwip_chksum_copy(seg, data, TCP_MSS);
+	});
+	// three segments, like a TCP segment split across pbufs
+	struct pbuf *p = pbuf_alloc(PBUF_RAW, 500, PBUF_RAM);
+	pbuf_cat(p, pbuf_alloc(PBUF_RAW, 500, PBUF_RAM));
+	pbuf_cat(p, pbuf_alloc(PBUF_RAW, 500, PBUF_RAM));
+	pbuf_take(p, data, 1500);
+	run("inet_chksum_pbuf (3x500)", iterations, 1500, [&]() {
+		sink += inet_chksum_pbuf(p);
+	});
+	pbuf_free(p);
+}
+
+/****************************************************************************/
+/* Tap lookup and address helpers                                           */
+/****************************************************************************/
+
+static ZeroTier::InetAddress make_addr(int family, const char *ip, unsigned int bits)
+{
+	ZeroTier::InetAddress addr;
+	unsigned char raw[16];
+	inet_pton(family, ip, raw);
+	addr.set(raw, family == AF_INET ? 4 : 16, bits);
+	return addr;
+}
+
+static void bench_lookup(std::vector<ZeroTier::VirtualTap*> &taps)
+{
+	char ip[64];
+	for (size_t i=0; i<taps.size(); i++) {
+		snprintf(ip, sizeof(ip), "10.%d.0.1", (int)i+1);
+		taps[i]->addIp(make_addr(AF_INET, ip, 24));
+		snprintf(ip, sizeof(ip), "fd00:%x::1", (int)i+1);
+		taps[i]->addIp(make_addr(AF_INET6, ip, 64));
+	}
+	snprintf(ip, sizeof(ip), "10.%d.0.77", (int)taps.size());
+	ZeroTier::InetAddress last4 = make_addr(AF_INET, ip, 0);
+	snprintf(ip, sizeof(ip), "fd00:%x::77", (int)taps.size());
+	ZeroTier::InetAddress last6 = make_addr(AF_INET6, ip, 0);
+	ZeroTier::InetAddress none4 = make_addr(AF_INET, "192.168.1.1", 0);
+
+	run("getTapByAddr (ipv4, last tap)", iterations, 0, [&]() {
+		sink += (uintptr_t)getTapByAddr(&last4);
+	});
+	run("getTapByAddr (ipv6, last tap)", iterations, 0, [&]() {
+		sink += (uintptr_t)getTapByAddr(&last6);
+	});
+	run("getTapByAddr (ipv4, no match)", iterations, 0, [&]() {
+		sink += (uintptr_t)getTapByAddr(&none4);
+	});
+
+	ZeroTier::InetAddress subnet = make_addr(AF_INET6, "fd00:1::1", 64);
+	ZeroTier::InetAddress inside = make_addr(AF_INET6, "fd00:1::1234", 0);
+	run("ipv6_in_subnet", iterations, 0, [&]() {
+		sink += ipv6_in_subnet(&subnet, &inside);
+	});
+
+	struct sockaddr_in6 in6;
+	memset(&in6, 0, sizeof(in6));
+	run("fix_addr_socket_family", iterations, 0, [&]() {
+		in6.sin6_family = AF_INET6;
+		fix_addr_socket_family((struct sockaddr *)&in6);
+		sink += in6.sin6_family;
+	});
+}
+
+/****************************************************************************/
+/* Frame <-> pbuf conversion                                                */
+/****************************************************************************/
+
+static err_t sink_input(struct pbuf *p, struct netif *netif)
+{
+	sink += p->tot_len;
+	pbuf_free(p);
+	return ERR_OK;
+}
+
+static void sink_handler(void *, void *, uint64_t, const ZeroTier::MAC &, const ZeroTier::MAC &,
+	unsigned int, unsigned int, const void *data, unsigned int len)
+{
+	sink += len;
+}
+
+static void sink_handler_v(void *, void *, uint64_t, const ZeroTier::MAC &, const ZeroTier::MAC &,
+	unsigned int, unsigned int, const ZeroTier::FrameSegment *, unsigned int, unsigned int len)
+{
+	sink += len;
+}
+
+static void bench_frames(ZeroTier::VirtualTap *tap)
+{
+	static struct netif sink_netif;
+	sink_netif.input = sink_input;
+	sink_netif.state = tap;
+	// frames go to the sink instead of the stack, the tap's own netif and handlers are put back afterwards
+	void *netif4 = tap->netif4;
+	auto handler = tap->_handler;
+	auto handler_v = tap->_handler_v;
+	tap->netif4 = &sink_netif;
+	tap->_handler = sink_handler;
+	tap->_handler_v = NULL;
+
+	char frame[MICROBENCH_FRAME_SZ];
+	memset(frame, 0x5a, sizeof(frame));
+	ZeroTier::MAC from(0x32cccc000001ULL), to(0x32cccc000002ULL);
+	run("lwip_eth_rx (frame -> pbuf)", iterations, sizeof(frame), [&]() {
+		lwip_eth_rx(tap, from, to, 0x800, frame, sizeof(frame));
+	});
+
+	const size_t len = MICROBENCH_FRAME_SZ + sizeof(struct eth_hdr);
+	struct pbuf *single = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+	pbuf_take(single, frame, sizeof(struct eth_hdr));
+	run("lwip_eth_tx (single pbuf)", iterations, len, [&]() {
+		lwip_eth_tx(&sink_netif, single);
+	});
+	// header pbuf followed by payload, as produced by the TCP output path
+	struct pbuf *chain = pbuf_alloc(PBUF_RAW, sizeof(struct eth_hdr) + 54, PBUF_RAM);
+	pbuf_cat(chain, pbuf_alloc(PBUF_RAW, MICROBENCH_FRAME_SZ - 54, PBUF_RAM));
+	pbuf_take(chain, frame, sizeof(struct eth_hdr));
+	run("lwip_eth_tx (chain, flattened)", iterations, len, [&]() {
+		lwip_eth_tx(&sink_netif, chain);
+	});
+	tap->_handler_v = sink_handler_v;
+	run("lwip_eth_tx (chain, segments)", iterations, len, [&]() {
+		lwip_eth_tx(&sink_netif, chain);
+	});
+	pbuf_free(single);
+	pbuf_free(chain);
+	tap->netif4 = netif4;
+	tap->_handler = handler;
+	tap->_handler_v = handler_v;
+}
+
+/****************************************************************************/
+/* Timeouts                                                                 */
+/****************************************************************************/
+
+static void noop_timeout(void *arg)
+{
+	sink++;
+}
+
+static void bench_timeouts()
+{
+	// pending timeouts spread over a minute, as with many TCP connections' timers
+	const int pending[] = { 100, 10000 };
+	char name[64];
+	uint32_t seed = 1;
+	LOCK_TCPIP_CORE();
+	for (size_t i=0; i<sizeof(pending)/sizeof(pending[0]); i++) {
+		for (int j=0; j<pending[i]; j++) {
+			seed = seed * 1103515245 + 12345;
+			sys_timeout(1000 + (seed >> 8) % 60000, noop_timeout, (void*)(uintptr_t)(j + 1));
+		}
+		snprintf(name, sizeof(name), "sys_timeout+sys_untimeout (%d pending)", pending[i]);
+		run(name, iterations / 100, 0, [&]() {
+			seed = seed * 1103515245 + 12345;
+			sys_timeout(1000 + (seed >> 8) % 60000, noop_timeout, NULL);
+			sys_untimeout(noop_timeout, NULL);
+		});
+		for (int j=0; j<pending[i]; j++) {
+			sys_untimeout(noop_timeout, (void*)(uintptr_t)(j + 1));
+		}
+	}
+	UNLOCK_TCPIP_CORE();
+}
+
+/****************************************************************************/
+/* TCP segment demultiplexing                                               */
+/****************************************************************************/
+
+static err_t demux_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+	return ERR_OK;
+}
+
+static err_t demux_netif_init(struct netif *netif)
+{
+	netif->output = demux_output;
+	netif->mtu = 1500;
+	return ERR_OK;
+}
+
+// pure ACKs for established connections, round-robin so no lookup benefits from locality
+static void bench_tcp_demux()
+{
+	const int conns[] = { 16, 4096 };
+	const u16_t local_port = 80;
+	static struct netif demux_netif;
+	ip4_addr_t local, mask, gw;
+	IP4_ADDR(&local, 10, 9, 0, 1);
+	IP4_ADDR(&mask, 255, 255, 0, 0);
+	ip4_addr_set_zero(&gw);
+	char name[64];
+	LOCK_TCPIP_CORE();
+	netif_add(&demux_netif, &local, &mask, &gw, NULL, demux_netif_init, ip4_input);
+	netif_set_up(&demux_netif);
+	for (size_t i=0; i<sizeof(conns)/sizeof(conns[0]); i++) {
+		std::vector<struct tcp_pcb*> pcbs;
+		std::vector<std::vector<u8_t> > segs;
+		for (int j=0; j<conns[i]; j++) {
+			ip_addr_t remote;
+			IP_ADDR4(&remote, 10, 8, (j >> 8) & 0xff, j & 0xff);
+			struct tcp_pcb *pcb = tcp_new();
+			ip_addr_copy_from_ip4(pcb->local_ip, local);
+			ip_addr_copy(pcb->remote_ip, remote);
+			pcb->local_port = local_port;
+			pcb->remote_port = (u16_t)(1024 + j);
+			pcb->state = ESTABLISHED;
+			pcb->rcv_nxt = 1000;
+			pcb->snd_nxt = pcb->lastack = pcb->snd_wl2 = 5000;
+			TCP_REG_ACTIVE(pcb);
+			pcbs.push_back(pcb);
+
+			struct pbuf *p = pbuf_alloc(PBUF_RAW, IP_HLEN + TCP_HLEN, PBUF_RAM);
+			struct ip_hdr *iphdr = (struct ip_hdr *)p->payload;
+			memset(iphdr, 0, IP_HLEN + TCP_HLEN);
+			IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+			IPH_LEN_SET(iphdr, lwip_htons(IP_HLEN + TCP_HLEN));
+			IPH_TTL_SET(iphdr, 64);
+			IPH_PROTO_SET(iphdr, IP_PROTO_TCP);
+			ip4_addr_copy(iphdr->src, *ip_2_ip4(&remote));
+			ip4_addr_copy(iphdr->dest, local);
+			IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+			pbuf_header(p, -IP_HLEN);
+			struct tcp_hdr *tcphdr = (struct tcp_hdr *)p->payload;
+			tcphdr->src = lwip_htons(pcb->remote_port);
+			tcphdr->dest = lwip_htons(local_port);
+			tcphdr->seqno = lwip_htonl(pcb->rcv_nxt);
+			tcphdr->ackno = lwip_htonl(pcb->snd_nxt);
+			TCPH_HDRLEN_FLAGS_SET(tcphdr, TCP_HLEN / 4, TCP_ACK);
+			tcphdr->wnd = lwip_htons(TCPWND16(TCP_WND));
+			tcphdr->chksum = ip_chksum_pseudo(p, IP_PROTO_TCP, TCP_HLEN, &remote, &pcb->local_ip);
+			pbuf_header(p, IP_HLEN);
+			segs.push_back(std::vector<u8_t>((u8_t*)p->payload, (u8_t*)p->payload + IP_HLEN + TCP_HLEN));
+			pbuf_free(p);
+		}
+		size_t next = 0;
+		snprintf(name, sizeof(name), "ip4_input+tcp_input (%d connections)", conns[i]);
+		run(name, iterations / 10, IP_HLEN + TCP_HLEN, [&]() {
+			struct pbuf *p = pbuf_alloc(PBUF_RAW, IP_HLEN + TCP_HLEN, PBUF_RAM);
+			memcpy(p->payload, segs[next].data(), IP_HLEN + TCP_HLEN);
+			ip4_input(p, &demux_netif);
+			next = (next + 1) % segs.size();
+		});
+		for (size_t j=0; j<pcbs.size(); j++) {
+			tcp_abort(pcbs[j]);
+		}
+	}
+	netif_remove(&demux_netif);
+	UNLOCK_TCPIP_CORE();
+}
+
+/****************************************************************************/
+/* ARP table lookups                                                        */
+/****************************************************************************/
+
+static err_t arp_linkoutput(struct netif *netif, struct pbuf *p)
+{
+	return ERR_OK;
+}
+
+static err_t arp_netif_init(struct netif *netif)
+{
+	netif->output = etharp_output;
+	netif->linkoutput = arp_linkoutput;
+	netif->mtu = 1500;
+	netif->hwaddr_len = ETH_HWADDR_LEN;
+	memset(netif->hwaddr, 0x32, ETH_HWADDR_LEN);
+	netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP;
+	return ERR_OK;
+}
+
+// etharp_output to neighbours learned from ARP replies, round-robin so the last-entry cache never hits
+static void bench_etharp()
+{
+	const int neighbors[] = { 16, 1000 };
+	static struct netif arp_netif;
+	ip4_addr_t local, mask, gw;
+	IP4_ADDR(&local, 10, 7, 0, 1);
+	IP4_ADDR(&mask, 255, 255, 0, 0);
+	ip4_addr_set_zero(&gw);
+	char name[64];
+	LOCK_TCPIP_CORE();
+	netif_add(&arp_netif, &local, &mask, &gw, NULL, arp_netif_init, ip4_input);
+	netif_set_up(&arp_netif);
+	for (size_t i=0; i<sizeof(neighbors)/sizeof(neighbors[0]); i++) {
+		std::vector<ip4_addr_t> addrs;
+		for (int j=0; j<neighbors[i]; j++) {
+			ip4_addr_t remote;
+			IP4_ADDR(&remote, 10, 7, 1 + ((j >> 8) & 0xff), j & 0xff);
+			addrs.push_back(remote);
+			struct pbuf *p = pbuf_alloc(PBUF_RAW, SIZEOF_ETHARP_HDR, PBUF_RAM);
+			struct etharp_hdr *hdr = (struct etharp_hdr *)p->payload;
+			hdr->hwtype = PP_HTONS(HWTYPE_ETHERNET);
+			hdr->proto = PP_HTONS(ETHTYPE_IP);
+			hdr->hwlen = ETH_HWADDR_LEN;
+			hdr->protolen = sizeof(ip4_addr_t);
+			hdr->opcode = PP_HTONS(ARP_REPLY);
+			memset(&hdr->shwaddr, 0x02, ETH_HWADDR_LEN);
+			hdr->shwaddr.addr[5] = (u8_t)j;
+			IPADDR2_COPY(&hdr->sipaddr, &remote);
+			memcpy(&hdr->dhwaddr, arp_netif.hwaddr, ETH_HWADDR_LEN);
+			IPADDR2_COPY(&hdr->dipaddr, &local);
+			etharp_input(p, &arp_netif);
+		}
+		size_t next = 0;
+		snprintf(name, sizeof(name), "etharp_output (%d neighbors)", neighbors[i]);
+		run(name, iterations / 10, 0, [&]() {
+			struct pbuf *p = pbuf_alloc(PBUF_IP, 0, PBUF_RAM);
+			etharp_output(&arp_netif, p, &addrs[next]);
+			pbuf_free(p);
+			next = (next + 1) % addrs.size();
+		});
+		etharp_cleanup_netif(&arp_netif);
+	}
+	netif_remove(&arp_netif);
+	UNLOCK_TCPIP_CORE();
+}
+
+/****************************************************************************/
+/* Memory pools                                                             */
+/****************************************************************************/
+
+#if MEMP_MEM_SLAB
+// a limited pool can be allocated up to its limit from one thread after another thread freed
+// everything, even though that thread's cache keeps some of the free elements
+static void verify_memp_limit()
+{
+	const size_t limit = 64;
+	std::vector<void*> held(limit);
+	bool ok = true;
+	memp_slab_set_limit(memp_pools[MEMP_UDP_PCB], limit);
+	for (size_t i=0; i<limit; i++) {
+		held[i] = memp_malloc(MEMP_UDP_PCB);
+		ok = ok && held[i] != NULL;
+	}
+	ok = ok && memp_malloc(MEMP_UDP_PCB) == NULL;
+	for (size_t i=0; i<limit; i++) {
+		if (held[i] != NULL) {
+			memp_free(MEMP_UDP_PCB, held[i]);
+		}
+	}
+	std::thread other([&]() {
+		for (size_t i=0; i<limit; i++) {
+			held[i] = memp_malloc(MEMP_UDP_PCB);
+			ok = ok && held[i] != NULL;
+		}
+		for (size_t i=0; i<limit; i++) {
+			if (held[i] != NULL) {
+				memp_free(MEMP_UDP_PCB, held[i]);
+			}
+		}
+	});
+	other.join();
+	memp_slab_set_limit(memp_pools[MEMP_UDP_PCB], 0);
+	if (!ok) {
+		fprintf(stderr, "memp limit of %d UDP PCBs not available to a second thread\n", (int)limit);
+		exit(1);
+	}
+}
+#endif
+
+static void bench_memp()
+{
+#if MEMP_MEM_SLAB
+	verify_memp_limit();
+#endif
+	run("memp_malloc+memp_free (TCP_SEG)", iterations, 0, [&]() {
+		void *m = memp_malloc(MEMP_TCP_SEG);
+		memp_free(MEMP_TCP_SEG, m);
+	});
+	// more elements than a per-thread cache holds, so the pool's shared state is hit too
+	std::vector<void*> held(256);
+	run("memp_malloc+memp_free (PBUF_POOL, x256)", iterations / 256 + 1, 0, [&]() {
+		for (size_t i=0; i<held.size(); i++) {
+			held[i] = memp_malloc(MEMP_PBUF_POOL);
+		}
+		for (size_t i=0; i<held.size(); i++) {
+			memp_free(MEMP_PBUF_POOL, held[i]);
+		}
+	});
+	run("mem_malloc+mem_free (1500)", iterations, 0, [&]() {
+		void *m = mem_malloc(1500);
+		mem_free(m);
+	});
+	run("pbuf_alloc+pbuf_free (PBUF_RAM, 1500)", iterations, 0, [&]() {
+		pbuf_free(pbuf_alloc(PBUF_RAW, 1500, PBUF_RAM));
+	});
+}
+
+/****************************************************************************/
+/* Main                                                                     */
+/****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+			case 'n': iterations = strtoull(optarg, NULL, 10); break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+				return 1;
+		}
+	}
+	// creating a tap starts the stack, but taps are never attached to a ZeroTier node
+	std::vector<ZeroTier::VirtualTap*> taps;
+	for (int i=0; i<MICROBENCH_TAPS; i++) {
+		taps.push_back(new ZeroTier::VirtualTap(".", ZeroTier::MAC(0x32cccc000010ULL + i), ZT_MAX_MTU, 0,
+			MICROBENCH_NWID + i, "microbench", sink_handler, NULL));
+	}
+	ZeroTier::VirtualTap *frame_tap = new ZeroTier::VirtualTap(".", ZeroTier::MAC(0x32cccc000001ULL), ZT_MAX_MTU, 0,
+		MICROBENCH_NWID, "microbench", sink_handler, NULL);
+
+	bench_ringbuffer();
+	bench_checksum();
+	bench_lookup(taps);
+	bench_frames(frame_tap);
+	bench_timeouts();
+	bench_tcp_demux();
+	bench_etharp();
+	bench_memp();
+
+	delete frame_tap;
+	for (size_t i=0; i<taps.size(); i++) {
+		delete taps[i];
+	}
+	return 0;
+}